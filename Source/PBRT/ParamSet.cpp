@@ -2,20 +2,32 @@
 #include <iostream>
 #include <memory>
 #include "../system.h"
+#include "../incremental.h"
 
 #define PARAM_SET_DECL(type,vec)	void ParamSet::add##type(const std::string& name, std::vector<type> d){ \
 								erase##type(name);												\
-								(vec).push_back( Item<type>( name , d ) );	}								\
+								(vec).push_back( Item<type>( name , std::move(d) ) );	}								\
+								void ParamSet::addLazy##type(const std::string& name, LazyArray<type> d){ \
+								erase##type(name);												\
+								(vec).push_back( Item<type>( name , std::move(d) ) );	}								\
+								size_t ParamSet::get##type##Count(const std::string& n) const{			\
+								for(const auto& i : (vec) ){											\
+									if(i.name == n) return i.size();								\
+								} return 0;}														\
 								bool ParamSet::erase##type(const std::string& n) {						\
 								for(auto i = (vec).begin(); i != (vec).end(); ++i){				\
 								if( i->name == n ) {(vec).erase(i); return true;}} return false; }	\
 								bool ParamSet::get##type##s(const std::string& n, std::vector<type>& d) const{			\
 								for(const auto& i : (vec) ){											\
-									if(i.name == n){ i.lookedUp = true; d = i.data; return true;}	\
+									if(i.name == n){ i.lookedUp = true; d = i.getData(); return true;}	\
+								} return false;}													\
+								bool ParamSet::take##type##s(const std::string& n, std::vector<type>& d){			\
+								for(auto& i : (vec) ){											\
+									if(i.name == n){ i.lookedUp = true; d = std::move(i.getData()); i.data.clear(); i.updateMemory(); return true;}	\
 								} return false;}													\
 								ParamSet::type ParamSet::get##type(const std::string& n, type defau) const{			\
 								for(const auto& i : (vec) ){											\
-									if(i.name == n && i.data.size() == 1) {i.lookedUp = true; return i.data[0];}	\
+									if(i.name == n && i.size() == 1) {i.lookedUp = true; return i.getData()[0];}	\
 								} return defau;}	\
 								const std::vector<ParamSet::Item<ParamSet::type>>& ParamSet::get##type##Vector() const {	\
 									return vec;																	\
@@ -55,13 +67,10 @@ void ParamSet::addBlackbodySpectrum(const std::string& n, std::vector<float> d)
 	eraseSpectrum(n);
 	if (d.size() % 2 != 0) System::warning("invalid number of spectrum pairs supplied: " + n);
 	std::vector<Spectrum> specs;
-	auto v = std::unique_ptr<float[]>(new float[nCIESamples]);
+	specs.reserve(d.size() / 2);
 	for(size_t i = 0; i < d.size() / 2; i++)
-	{
-		Blackbody(CIE_lambda, nCIESamples, d[2 * i], v.get());
-		specs.push_back(d[2 * i + 1] * Spectrum::FromSampled(CIE_lambda, v.get(), nCIESamples));
-	}
-	spectra.push_back(Item<Spectrum>(n, specs));
+		specs.push_back(d[2 * i + 1] * BlackbodySpectrum(d[2 * i]));
+	spectra.push_back(Item<Spectrum>(n, move(specs)));
 }
 
 bool ParamSet::eraseSpectrum(const std::string& n)
@@ -143,7 +152,10 @@ std::string ParamSet::getFilename(const std::string& n, const std::string& def)
 		return def;
 
 	// TODO implement absolute path
-	return System::fixPath(System::getCurrentDirectory() + filename);
+	filename = System::fixPath(System::getCurrentDirectory() + filename);
+	if (auto session = incremental::Session::getCurrent())
+		session->addFile(incremental::Kind::Asset, filename);
+	return filename;
 }
 
 const std::vector<ParamSet::Item<RGBSpectrum>>& ParamSet::getSpectrumVector() const
@@ -1,12 +1,19 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
 #include <ei/vector.hpp>
 #include "spectrum.h"
+#include "../memory.h"
 
+// take<type>s moves the data out of the set for large arrays (the item stays with empty data)
+// addLazy<type> stores unconverted array text, get<type>Count does not convert it
 #define PARAM_SET_ADD(type)		void add##type(const std::string&, std::vector<type>); \
+								void addLazy##type(const std::string&, LazyArray<type>);	\
+								size_t get##type##Count(const std::string&) const;		\
 								bool erase##type(const std::string&);					\
 								bool get##type##s(const std::string&, std::vector<type>&) const; \
+								bool take##type##s(const std::string&, std::vector<type>&);		\
 								type get##type(const std::string&, type defaul) const;			\
 								const std::vector<Item<type>>& get##type##Vector() const
 
@@ -21,18 +28,94 @@ class ParamSet
 	using Point = Vector;
 	using Normal = Vector;
 	using String = std::string;
+public:
+	// array text that is converted on the first access of the data.
+	// The text is shared by all copies and accounted once by makeText
+	template <class T>
+	struct LazyArray
+	{
+		std::shared_ptr<const std::string> text;
+		size_t count; // number of elements (from the token count)
+		std::vector<T>(*decode)(const std::string&);
+	};
+	static std::shared_ptr<const std::string> makeText(std::string text)
+	{
+		const int64_t size = int64_t(sizeof(std::string) + text.capacity());
+		memory::add(memory::Category::ParamSet, size);
+		return std::shared_ptr<const std::string>(new std::string(std::move(text)), [size](const std::string* t)
+		{
+			memory::add(memory::Category::ParamSet, -size);
+			delete t;
+		});
+	}
+private:
 
+	// the array memory is accounted as memory::Category::ParamSet (lazy text by makeText)
 	template <class T>
 	class Item
 	{
 	public:
 		Item() {}
 		Item(const std::string& n, std::vector<T> data)
-		: name(n), data(data){}
+		: name(n), data(std::move(data)) { updateMemory(); }
+		Item(const std::string& n, LazyArray<T> lazy)
+		: name(n), lazy(std::move(lazy)) { updateMemory(); }
+		Item(const Item& o)
+		: name(o.name), data(o.data), lazy(o.lazy), lookedUp(o.lookedUp) { updateMemory(); }
+		Item(Item&& o) noexcept
+		: name(std::move(o.name)), data(std::move(o.data)), lazy(std::move(o.lazy)), lookedUp(o.lookedUp), accounted(o.accounted) { o.accounted = 0; }
+		Item& operator=(const Item& o)
+		{
+			name = o.name;
+			data = o.data;
+			lazy = o.lazy;
+			lookedUp = o.lookedUp;
+			updateMemory();
+			return *this;
+		}
+		Item& operator=(Item&& o) noexcept
+		{
+			std::swap(name, o.name);
+			std::swap(data, o.data);
+			std::swap(lazy, o.lazy);
+			std::swap(accounted, o.accounted);
+			lookedUp = o.lookedUp;
+			return *this;
+		}
+		~Item()
+		{
+			memory::add(memory::Category::ParamSet, -int64_t(accounted));
+		}
+		// call after data was changed
+		void updateMemory() const
+		{
+			const size_t size = data.capacity() * sizeof(T);
+			memory::add(memory::Category::ParamSet, int64_t(size) - int64_t(accounted));
+			accounted = size;
+		}
+		// converts lazy array text
+		std::vector<T>& getData() const
+		{
+			if (lazy.text)
+			{
+				data = lazy.decode(*lazy.text);
+				lazy = LazyArray<T>();
+				updateMemory();
+			}
+			return data;
+		}
+		size_t size() const
+		{
+			return lazy.text ? lazy.count : data.size();
+		}
 
 		std::string name;
-		std::vector<T> data;
+		// use getData() (empty until lazy text is converted)
+		mutable std::vector<T> data;
+		mutable LazyArray<T> lazy = LazyArray<T>();
 		mutable bool lookedUp = false;
+	private:
+		mutable size_t accounted = 0;
 	};
 
 public:
@@ -2,11 +2,20 @@
 #include <iostream>
 #include "../geometry/TriangleMesh.h"
 #include "../geometry/Sphere.h"
+#include "../geometry/Cone.h"
+#include "../geometry/Cylinder.h"
+#include "../geometry/Disk.h"
+#include "../geometry/Heightfield.h"
+#include "../geometry/Hyperboloid.h"
+#include "../geometry/Nurbs.h"
+#include "../geometry/Paraboloid.h"
 #include <functional>
 #include "volume.h"
 #include "copper.h"
 #include "../geometry/Plymesh.h"
 #include "../geometry/LoopSubDiv.h"
+#include "../parallel.h"
+#include "../profiler.h"
 
 #define ASSERT_TRANS_ARGS(number) if(args.size() != number) {System::error(std::string(__FUNCSIG__) + " invalid number of args\n");} else
 #define ASSERT_BLOCK(block) if(m_block != block) {System::error(std::string(__FUNCSIG__) + " called in wrong block. will be ignored"); return;}
@@ -275,8 +284,41 @@ void PbrtScene::apiAttributeEnd()
 	apiTransformEnd();
 }
 
+// --noconvert: shapes with large arrays are checked like their init() without converting the vertex data
+// (only indices and knots are converted). Returns false for the shapes that are built as usual
+static bool checkShapeParams(PbrtScene::ShapeType type, const ParamSet& p)
+{
+	using ShapeType = PbrtScene::ShapeType;
+	switch (type)
+	{
+	case ShapeType::Trianglemesh:
+		TriangleMesh::checkParams(p);
+		return true;
+	case ShapeType::Loopsubdiv:
+		TriangleMesh::checkParams(p, false);
+		return true;
+	case ShapeType::Heightfield:
+	{
+		const int nu = p.getInt("nu", -1), nv = p.getInt("nv", -1);
+		if (nu < 2 || nv < 2)
+			throw PbrtMissingParameter("integer nu and nv");
+		if (!p.getFloatCount("Pz"))
+			throw PbrtMissingParameter("float Pz");
+		if (p.getFloatCount("Pz") != size_t(nu) * size_t(nv))
+			throw std::exception("heightfield Pz does not match nu * nv");
+	}
+		return true;
+	case ShapeType::Nurbs:
+		Nurbs::checkParams(p);
+		return true;
+	default:
+		return false;
+	}
+}
+
 void PbrtScene::apiShape(MODUL_ARGS)
 {
+	profiler::ScopedTimer timer(profiler::Phase::Shape, type);
 	ASSERT_BLOCK(Block::World);
 	auto stype = getShapeTypeFromString(type);
 	std::unique_ptr<Shape> pShape;
@@ -315,20 +357,34 @@ void PbrtScene::apiShape(MODUL_ARGS)
 		pShape.reset(new LoopSubDiv());
 		break;
 	case ShapeType::Cone:
+		pShape.reset(new Cone());
+		break;
 	case ShapeType::Cylinder:
+		pShape.reset(new Cylinder());
+		break;
 	case ShapeType::Disk:
+		pShape.reset(new Disk());
+		break;
 	case ShapeType::Hyperboloid:
+		pShape.reset(new Hyperboloid());
+		break;
+	case ShapeType::Paraboloid:
+		pShape.reset(new Paraboloid());
+		break;
 	case ShapeType::Heightfield:
+		pShape.reset(new Heightfield());
+		break;
 	case ShapeType::Nurbs:
-	case ShapeType::Paraboloid:
-		System::warning("shape " + type + " not yet implemented. Will be ignored");
-		return;
+		pShape.reset(new Nurbs());
+		break;
 	default:
 		System::error("unknow shape type " + type);
 		return;
 	}
 
-	pShape->init(p);
+	const bool noconvert = System::args.has("noconvert");
+	if (!noconvert || !checkShapeParams(stype, p))
+		pShape->init(p);
 	pShape->applyTransform(m_transforms.top());
 	pShape->setMaterial(m_gfxStates.top().createMaterial(p, m_transforms.top()));
 	if (m_gfxStates.top().reverseOrientation)
@@ -348,10 +404,13 @@ void PbrtScene::apiShape(MODUL_ARGS)
 		else System::warning("area light " + m_gfxStates.top().areaLight + " unknown. Will be ignored");
 	}
 
+	if (m_pCurInstance && pArea)
+		System::warning("Area lights not supported with object instancing");
+	// the shapes are not kept, meshes were not converted
+	if (noconvert)
+		return;
 	if(m_pCurInstance)
 	{
-		if (pArea)
-			System::warning("Area lights not supported with object instancing");
 		m_pCurInstance->push_back(move(pShape));
 	}
 	else
@@ -360,6 +419,40 @@ void PbrtScene::apiShape(MODUL_ARGS)
 			pShape->setAreaLight(pArea);
 		m_renderOptions.shapes.push_back(move(pShape));
 	}
+	checkMemoryBudget();
+}
+
+void PbrtScene::checkMemoryBudget(bool allShapes)
+{
+	const size_t budget = memory::getBudget();
+	if (allShapes)
+		m_spillCursor = 0;
+	if (memory::getUsed() <= budget)
+		return;
+
+	// release down to 3/4 of the budget so this does not happen again for the next shape
+	const size_t target = budget / 4 * 3;
+	// small meshes are not worth the file access
+	const size_t minSize = 64 * 1024;
+	const size_t vertexSize = 3 * sizeof(Vector) + sizeof(ei::Vec2);
+	auto& shapes = m_renderOptions.shapes;
+	for (; m_spillCursor < shapes.size() && memory::getUsed() > target; ++m_spillCursor)
+	{
+		if (shapes[m_spillCursor]->estimateSize(vertexSize) < minSize)
+			continue;
+		const size_t released = shapes[m_spillCursor]->spill(memory::getSpillFile());
+		if (released)
+		{
+			profiler::count(profiler::Counter::SpilledMeshes);
+			profiler::count(profiler::Counter::SpilledBytes, released);
+		}
+	}
+
+	if (memory::getUsed() > budget && !m_budgetExceeded)
+	{
+		m_budgetExceeded = true;
+		System::warning("memory budget of " + std::to_string(budget / (1024 * 1024)) + " MB exceeded with no meshes left to spill");
+	}
 }
 
 void PbrtScene::apiObjectBegin(const std::string& n)
@@ -565,6 +658,21 @@ PbrtScene::RenderOptions& PbrtScene::getRenderOptions()
 {
 	return m_renderOptions;
 }
+
+ei::Box PbrtScene::computeSceneBounds() const
+{
+	const auto& shapes = m_renderOptions.shapes;
+	if (shapes.empty())
+		return ei::Box(Vector(0.0f), Vector(0.0f));
+
+	return parallel::reduce(shapes.size(), 64, shapes.front()->getWorldBounds(), [&shapes](size_t begin, size_t end)
+	{
+		ei::Box box = shapes[begin]->getWorldBounds();
+		for (size_t i = begin + 1; i < end; ++i)
+			box = ei::Box(box, shapes[i]->getWorldBounds());
+		return box;
+	}, [](const ei::Box& a, const ei::Box& b) { return ei::Box(a, b); });
+}
 #pragma endregion 
 
 #pragma region "TEXTURES AND MATERIALS"
@@ -718,6 +826,7 @@ void PbrtScene::setTextureMapping(TextureParams& tp, Texture<T>& tex)
 
 std::shared_ptr<Material> PbrtScene::GraphicsState::makeMaterial(const std::string& name, TextureParams& tp, const Matrix& toWorld)
 {
+	profiler::ScopedTimer timer(profiler::Phase::Material, name);
 	auto type = getMaterialTypeFromString(name);
 	auto mtl = std::shared_ptr<Material>(new Material);
 	mtl->type = type;
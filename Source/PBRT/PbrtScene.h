@@ -130,6 +130,12 @@ public:
 #pragma endregion 
 
 	RenderOptions& getRenderOptions();
+	// world space bounding box of all shapes (reduced in parallel)
+	ei::Box computeSceneBounds() const;
+	// spills meshes when the accounted memory exceeds the budget (--membudget). While parsing only the shapes
+	// since the last call are considered, allShapes also spills meshes that were loaded again or replaced after
+	// parsing (must not run concurrently to other passes over the shapes)
+	void checkMemoryBudget(bool allShapes = false);
 private:
 	void useTrans(const Matrix& m, bool concat);
 	void resetTransforms();
@@ -156,6 +162,9 @@ private:
 	// instancing
 	std::map<std::string, std::vector<std::unique_ptr<Shape>>> m_instances;
 	std::vector<std::unique_ptr<Shape>>* m_pCurInstance = nullptr; // pointer to currently described Object Instance
+
+	size_t m_spillCursor = 0; // shapes before were already considered for spilling
+	bool m_budgetExceeded = false;
 	
 #pragma endregion 
 };
@@ -73,6 +73,8 @@ struct Texture
 	float roughness = 0.0f; // fbm
 	float variation = 0.0f; // marble
 
+	memory::Counted<memory::Category::Texture, Texture> counted;
+
 	bool operator==(const Texture& o) const
 	{
 		if (!texCompare(tex1, o.tex1))
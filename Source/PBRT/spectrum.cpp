@@ -2,6 +2,13 @@
 #include <vector>
 #include <iostream>
 #include "../system.h"
+#include <unordered_map>
+#include <mutex>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPECTRUM_USE_SSE
+#include <emmintrin.h>
+#endif
 
 bool SpectrumSamplesSorted(const float* lambda, const float* vals, int n)
 {
@@ -42,18 +49,156 @@ float InterpolateSpectrumSamples(const float* lambda, const float* vals, int n,
 	return 0.f;
 }
 
+static const double BLACKBODY_C2 = 1.4388e7;
+
 void Blackbody(const float* wl, int n, float temp, float* vals)
 {
 	if (temp <= 0) {
 		for (int i = 0; i < n; ++i) vals[i] = 0.f;
 		return;
 	}
-	const double C2 = 1.4388e7;
+	const double C2 = BLACKBODY_C2;
 	double norm = pow(555.0, 5.0) * (exp(C2 / (555.0*temp)) - 1.);
 	for (int i = 0; i < n; ++i)
 		vals[i] = float(norm / (pow(double(wl[i]), 5.0)*(exp(C2 / (wl[i] * temp)) - 1.)));
 }
 
+void BlackbodyCIE(float temp, float* vals)
+{
+	// 1 / wl^5 and C2 / wl do not depend on the temperature
+	struct Tables
+	{
+		double invWl5[nCIESamples];
+		double c2Wl[nCIESamples];
+	};
+	static const Tables tables = []()
+	{
+		Tables t;
+		for (int i = 0; i < nCIESamples; ++i)
+		{
+			t.invWl5[i] = 1.0 / pow(double(CIE_lambda[i]), 5.0);
+			t.c2Wl[i] = BLACKBODY_C2 / double(CIE_lambda[i]);
+		}
+		return t;
+	}();
+
+	if (temp <= 0) {
+		for (int i = 0; i < nCIESamples; ++i) vals[i] = 0.f;
+		return;
+	}
+	const double invT = 1.0 / double(temp);
+	const double norm = pow(555.0, 5.0) * (exp(BLACKBODY_C2 / 555.0 * invT) - 1.);
+	for (int i = 0; i < nCIESamples; ++i)
+		vals[i] = float(norm * tables.invWl5[i] / (exp(tables.c2Wl[i] * invT) - 1.));
+}
+
+// values of the piecewise linear spectrum at the CIE wavelengths.
+// same result as InterpolateSpectrumSamples() for every wavelength, but both sample lists are walked only once
+static void ResampleToCIE(const float* lambda, const float* vals, int n, float* dst)
+{
+	if (n <= 0) {
+		for (int i = 0; i < nCIESamples; ++i) dst[i] = 0.f;
+		return;
+	}
+	int j = 0;
+	for (int i = 0; i < nCIESamples; ++i) {
+		const float l = CIE_lambda[i];
+		if (l <= lambda[0]) dst[i] = vals[0];
+		else if (l >= lambda[n - 1]) dst[i] = vals[n - 1];
+		else {
+			// first segment with lambda[j] < l <= lambda[j + 1]
+			while (lambda[j + 1] < l) ++j;
+			const float t = (l - lambda[j]) / (lambda[j + 1] - lambda[j]);
+			dst[i] = Lerp(t, vals[j], vals[j + 1]);
+		}
+	}
+}
+
+// integral of the samples against the CIE matching functions, normalized by the CIE Y sum
+static void ProjectCIE(const float* v, float xyz[3])
+{
+	static const float yint = []()
+	{
+		float sum = 0.f;
+		for (int i = 0; i < nCIESamples; ++i)
+			sum += CIE_Y[i];
+		return sum;
+	}();
+
+	float x = 0.f, y = 0.f, z = 0.f;
+	int i = 0;
+#ifdef SPECTRUM_USE_SSE
+	__m128 ax = _mm_setzero_ps();
+	__m128 ay = _mm_setzero_ps();
+	__m128 az = _mm_setzero_ps();
+	for (; i + 4 <= nCIESamples; i += 4) {
+		const __m128 val = _mm_loadu_ps(v + i);
+		ax = _mm_add_ps(ax, _mm_mul_ps(val, _mm_loadu_ps(CIE_X + i)));
+		ay = _mm_add_ps(ay, _mm_mul_ps(val, _mm_loadu_ps(CIE_Y + i)));
+		az = _mm_add_ps(az, _mm_mul_ps(val, _mm_loadu_ps(CIE_Z + i)));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, ax);
+	x = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm_storeu_ps(lanes, ay);
+	y = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm_storeu_ps(lanes, az);
+	z = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; i < nCIESamples; ++i) {
+		x += v[i] * CIE_X[i];
+		y += v[i] * CIE_Y[i];
+		z += v[i] * CIE_Z[i];
+	}
+	xyz[0] = x / yint;
+	xyz[1] = y / yint;
+	xyz[2] = z / yint;
+}
+
+RGBSpectrum RGBSpectrum::FromSampled(const float* lambda, const float* v, int n)
+{
+	// Sort samples if unordered, use sorted for returned spectrum
+	if (!SpectrumSamplesSorted(lambda, v, n)) {
+		std::vector<float> slambda(&lambda[0], &lambda[n]);
+		std::vector<float> sv(&v[0], &v[n]);
+		SortSpectrumSamples(&slambda[0], &sv[0], n);
+		return FromSampled(&slambda[0], &sv[0], n);
+	}
+	float vals[nCIESamples];
+	ResampleToCIE(lambda, v, n, vals);
+	return FromCIESampled(vals);
+}
+
+RGBSpectrum RGBSpectrum::FromCIESampled(const float* v)
+{
+	float xyz[3];
+	ProjectCIE(v, xyz);
+	return FromXYZ(xyz);
+}
+
+Spectrum BlackbodySpectrum(float temp)
+{
+	static std::mutex mutex;
+	static std::unordered_map<uint32_t, Spectrum> cache;
+	// bit pattern as key (NaN would never be found otherwise)
+	uint32_t key;
+	memcpy(&key, &temp, sizeof(key));
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = cache.find(key);
+		if (it != cache.end())
+			return it->second;
+	}
+
+	float v[nCIESamples];
+	BlackbodyCIE(temp, v);
+	const Spectrum s = Spectrum::FromCIESampled(v);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	cache.emplace(key, s);
+	return s;
+}
+
 const float CIE_X[nCIESamples] = {
 	// CIE X function values
 	0.0001299000f, 0.0001458470f, 0.0001638021f, 0.0001840037f,
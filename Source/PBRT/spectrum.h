@@ -48,10 +48,12 @@ public:
 			c[i] = v;
 		assert(!HasNaNs());
 	}
+	// the checks below accumulate over all samples without early outs (no branches in the loops)
 	bool HasNaNs() const {
+		bool nan = false;
 		for (int i = 0; i < nSamples; ++i)
-			if (isnan(c[i])) return true;
-		return false;
+			nan |= bool(isnan(c[i]));
+		return nan;
 	}
 #pragma region "MATH HELPER"
 	CoefficientSpectrum &operator+=(const CoefficientSpectrum &s2) {
@@ -127,17 +129,19 @@ public:
 		return *this;
 	}
 	bool operator==(const CoefficientSpectrum &sp) const {
+		bool equal = true;
 		for (int i = 0; i < nSamples; ++i)
-			if (c[i] != sp.c[i]) return false;
-		return true;
+			equal &= c[i] == sp.c[i];
+		return equal;
 	}
 	bool operator!=(const CoefficientSpectrum &sp) const {
 		return !(*this == sp);
 	}
 	bool IsBlack() const {
+		bool black = true;
 		for (int i = 0; i < nSamples; ++i)
-			if (c[i] != 0.) return false;
-		return true;
+			black &= c[i] == 0.f;
+		return black;
 	}
 	friend CoefficientSpectrum Sqrt(const CoefficientSpectrum &s) {
 		CoefficientSpectrum ret;
@@ -217,34 +221,21 @@ public:
 		return YWeight[0] * c[0] + YWeight[1] * c[1] + YWeight[2] * c[2];
 	}
 	
-	static RGBSpectrum FromSampled(const float *lambda, const float *v,
-		int n) {
-		// Sort samples if unordered, use sorted for returned spectrum
-		if (!SpectrumSamplesSorted(lambda, v, n)) {
-			std::vector<float> slambda(&lambda[0], &lambda[n]);
-			std::vector<float> sv(&v[0], &v[n]);
-			SortSpectrumSamples(&slambda[0], &sv[0], n);
-			return FromSampled(&slambda[0], &sv[0], n);
-		}
-		float xyz[3] = { 0, 0, 0 };
-		float yint = 0.f;
-		for (int i = 0; i < nCIESamples; ++i) {
-			yint += CIE_Y[i];
-			float val = InterpolateSpectrumSamples(lambda, v, n,
-				CIE_lambda[i]);
-			xyz[0] += val * CIE_X[i];
-			xyz[1] += val * CIE_Y[i];
-			xyz[2] += val * CIE_Z[i];
-		}
-		xyz[0] /= yint;
-		xyz[1] /= yint;
-		xyz[2] /= yint;
-		return FromXYZ(xyz);
-	}
+	// piecewise linear spectrum given by n (wavelength, value) samples
+	static RGBSpectrum FromSampled(const float *lambda, const float *v, int n);
+	// spectrum sampled at the nCIESamples wavelengths of CIE_lambda
+	static RGBSpectrum FromCIESampled(const float *v);
 };
 
 using Spectrum = RGBSpectrum;
 
+// Blackbody() at the CIE_lambda wavelengths with precomputed wavelength terms (vals needs nCIESamples entries)
+extern void BlackbodyCIE(float temp, float *vals);
+
+// normalized blackbody emission (see Blackbody()) for the given temperature in kelvin.
+// the spectra are computed once per temperature and shared by all threads
+extern Spectrum BlackbodySpectrum(float temp);
+
 // Spectrum Inline Functions
 template <int nSamples> inline CoefficientSpectrum<nSamples>
 Pow(const CoefficientSpectrum<nSamples> &s, float e) {
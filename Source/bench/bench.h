@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// small helpers for the benchmarks
+namespace bench
+{
+	// best wall clock time of func() in milliseconds
+	template<class TFunc>
+	double measure(TFunc func, int repetitions = 3)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			func();
+			const auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	// prints the time and the throughput in items per second
+	inline void report(const char* name, double ms, double items, const char* unit)
+	{
+		printf("%-40s %10.3f ms %14.0f %s/s\n", name, ms, items * 1000.0 / std::max(ms, 1e-6), unit);
+	}
+
+	// keeps results alive so the measured work is not optimized away: the compiler has to assume
+	// that the whole object is read
+	template<class T>
+	void keep(const T& value)
+	{
+#ifdef _MSC_VER
+		static const void* volatile sink;
+		sink = &value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "g"(&value) : "memory");
+#endif
+	}
+
+	// peak resident memory of the process in bytes
+	size_t getPeakMemory();
+}
+
+void runSpectrumBench();
+void runScanBench();
+// preset: small, medium or large (nullptr: small and medium)
+void runParserBench(const char* preset);
+// sceneFile: uncompressed pbrt file (nullptr: generated scene). Writes .gz and .zst copies next to it
+void runIoBench(const char* sceneFile);
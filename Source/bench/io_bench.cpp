@@ -0,0 +1,142 @@
+#include "bench.h"
+#include "scene_generator.h"
+#include "../file.h"
+#include "../compression.h"
+#include "../system.h"
+#include <string>
+#include <vector>
+#ifdef PBRT_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PBRT_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+#if defined(PBRT_HAS_ZLIB) || defined(PBRT_HAS_ZSTD)
+	bool writeFile(const std::string& filename, const char* data, size_t size)
+	{
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (!file)
+			return false;
+		const bool written = fwrite(data, 1, size, file) == size;
+		fclose(file);
+		return written;
+	}
+#endif
+
+#ifdef PBRT_HAS_ZLIB
+	std::vector<char> compressGzip(const char* data, size_t size)
+	{
+		z_stream z = {};
+		// 16: gzip header and trailer
+		deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+		std::vector<char> out(deflateBound(&z, uLong(size)));
+		z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		z.avail_in = uInt(size);
+		z.next_out = reinterpret_cast<Bytef*>(out.data());
+		z.avail_out = uInt(out.size());
+		deflate(&z, Z_FINISH);
+		out.resize(z.total_out);
+		deflateEnd(&z);
+		return out;
+	}
+#endif
+
+#ifdef PBRT_HAS_ZSTD
+	// frameSize > 0: independent frames of frameSize input bytes (like zstd -T0 or pzstd)
+	std::vector<char> compressZstd(const char* data, size_t size, size_t frameSize)
+	{
+		if (frameSize == 0)
+			frameSize = size;
+		std::vector<char> out;
+		for (size_t offset = 0; offset < size; offset += frameSize)
+		{
+			const size_t n = std::min(frameSize, size - offset);
+			const size_t start = out.size();
+			out.resize(start + ZSTD_compressBound(n));
+			const size_t written = ZSTD_compress(out.data() + start, out.size() - start, data + offset, n, 3);
+			out.resize(start + (ZSTD_isError(written) ? 0 : written));
+		}
+		return out;
+	}
+#endif
+
+	// reads filename with openFile (decoded if compressed)
+	void measureRead(const char* name, const std::string& filename, size_t rawSize)
+	{
+		FILE* file = fopen(filename.c_str(), "rb");
+		if (!file)
+		{
+			printf("%-40s missing %s\n", name, filename.c_str());
+			return;
+		}
+		fseek(file, 0, SEEK_END);
+		const double fileSize = double(ftell(file));
+		fclose(file);
+
+		size_t size = 0;
+		const double ms = bench::measure([&]()
+		{
+			auto data = openFile(filename, size);
+			bench::keep(data);
+		});
+		if (size != rawSize)
+			printf("%s: decoded %zu bytes instead of %zu\n", name, size, rawSize);
+		bench::report(name, ms, double(rawSize) / (1024.0 * 1024.0), "MB");
+		printf("%-40s %10.1f %% of the raw size\n", "", fileSize * 100.0 / double(rawSize));
+	}
+}
+
+void runIoBench(const char* sceneFile)
+{
+	System::argSilent = true;
+	std::string raw = sceneFile ? sceneFile : "";
+	if (raw.empty())
+	{
+		// everything in one file
+		SceneConfig config;
+		config.meshes = 256;
+		config.meshResolution = 64;
+		config.includes = 0;
+		generateScene(config, "", "bench_io");
+		raw = "bench_io.pbrt";
+	}
+
+	size_t size = 0;
+	auto data = openFile(raw, size);
+	if (!data)
+	{
+		printf("cannot read %s\n", raw.c_str());
+		return;
+	}
+	if (compression::detect(data.get(), size) != compression::Format::None)
+	{
+		printf("%s is compressed, the raw file is needed\n", raw.c_str());
+		return;
+	}
+
+	// the compressed files are written next to the raw file. The reads are served by the file cache
+	// after the first repetition, so the raw read is the upper bound of the storage (nvme) throughput
+	printf("io %s (%.1f MB)\n", raw.c_str(), double(size) / (1024.0 * 1024.0));
+	measureRead("read raw", raw, size);
+#ifdef PBRT_HAS_ZLIB
+	const auto gzip = compressGzip(data.get(), size);
+	if (writeFile(raw + ".gz", gzip.data(), gzip.size()))
+		measureRead("read gzip", raw + ".gz", size);
+#else
+	printf("gzip: built without zlib\n");
+#endif
+#ifdef PBRT_HAS_ZSTD
+	const auto zstd = compressZstd(data.get(), size, 0);
+	if (writeFile(raw + ".zst", zstd.data(), zstd.size()))
+		measureRead("read zstd", raw + ".zst", size);
+	// frames of 4 MB are decoded in parallel
+	const auto frames = compressZstd(data.get(), size, size_t(4) << 20);
+	if (writeFile(raw + ".frames.zst", frames.data(), frames.size()))
+		measureRead("read zstd (4 MB frames)", raw + ".frames.zst", size);
+#else
+	printf("zstd: built without libzstd\n");
+#endif
+}
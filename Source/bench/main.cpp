@@ -0,0 +1,78 @@
+#include "bench.h"
+#include "../system.h"
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+size_t bench::getPeakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return size_t(usage.ru_maxrss);
+#else
+	return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static void printHelp()
+{
+	printf("PBRTConverterBench [benchmark] [options]\n");
+	printf("benchmarks:\n");
+	printf("\tspectrum: sampled to rgb conversion and blackbody spectra\n");
+	printf("\tscan: simd and scalar text scanning primitives of the parser\n");
+	printf("\tparser [small|medium|large]: parses generated scenes (written to the working directory)\n");
+	printf("\tio [file.pbrt]: raw against gzip and zstd compressed reads of a scene (generated if no file is given)\n");
+	printf("without argument all benchmarks are run\n");
+}
+
+int main(int argc, char** argv)
+{
+	System::init();
+	const char* which = argc > 1 ? argv[1] : "all";
+	const bool all = strcmp(which, "all") == 0;
+	bool found = all;
+
+	if (all || strcmp(which, "spectrum") == 0)
+	{
+		runSpectrumBench();
+		found = true;
+	}
+
+	if (all || strcmp(which, "scan") == 0)
+	{
+		runScanBench();
+		found = true;
+	}
+
+	if (all || strcmp(which, "parser") == 0)
+	{
+		runParserBench(all || argc < 3 ? nullptr : argv[2]);
+		found = true;
+	}
+
+	if (all || strcmp(which, "io") == 0)
+	{
+		runIoBench(all || argc < 3 ? nullptr : argv[2]);
+		found = true;
+	}
+
+	if (!found)
+	{
+		printHelp();
+		return 1;
+	}
+	return 0;
+}
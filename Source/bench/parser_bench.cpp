@@ -0,0 +1,107 @@
+#include "bench.h"
+#include "scene_generator.h"
+#include "../parser.h"
+#include "../system.h"
+#include <cstring>
+
+namespace
+{
+	struct Preset
+	{
+		const char* name;
+		SceneConfig config;
+	};
+
+	std::vector<Preset> getPresets()
+	{
+		std::vector<Preset> presets(3);
+		presets[0].name = "small";
+
+		presets[1].name = "medium";
+		auto& m = presets[1].config;
+		m.meshes = 256;
+		m.meshResolution = 64;
+		m.attributeDepth = 4;
+		m.materials = 64;
+		m.textures = 64;
+		m.objects = 16;
+		m.instances = 1000;
+		m.includes = 8;
+
+		presets[2].name = "large";
+		auto& l = presets[2].config;
+		l.meshes = 1024;
+		l.meshResolution = 64;
+		l.attributeDepth = 8;
+		l.materials = 256;
+		l.textures = 256;
+		l.objects = 64;
+		l.instances = 10000;
+		l.includes = 32;
+		return presets;
+	}
+
+	void runPreset(const Preset& preset)
+	{
+		// files are generated into the working directory
+		const std::string name = std::string("bench_") + preset.name;
+		const size_t bytes = generateScene(preset.config, "", name);
+
+		size_t shapes = 0;
+		const double ms = bench::measure([&]()
+		{
+			PbrtScene scene;
+			parseFile(name + ".pbrt", scene, "");
+			shapes = scene.getRenderOptions().shapes.size();
+		});
+
+		// first phase only (without the ply files of the shapes)
+		std::vector<std::string> files = { name + ".pbrt" };
+		for (int i = 0; i < preset.config.includes; ++i)
+			files.push_back(name + "_" + std::to_string(i) + ".pbrt");
+		std::vector<std::pair<std::unique_ptr<char[]>, size_t>> data;
+		size_t textBytes = 0;
+		for (const auto& f : files)
+		{
+			size_t size = 0;
+			auto file = openFile(f, size);
+			textBytes += size;
+			data.emplace_back(std::move(file), size);
+		}
+		size_t streamBytes = 0;
+		const double tokenizeMs = bench::measure([&]()
+		{
+			streamBytes = 0;
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				CommandStream stream;
+				tokenize(data[i].first, data[i].second, stream, files[i]);
+				streamBytes += stream.getMemorySize();
+			}
+		});
+
+		printf("parser %s (%.1f MB, %zu shapes)\n", preset.name, double(bytes) / (1024.0 * 1024.0), shapes);
+		bench::report("parse", ms, double(bytes) / (1024.0 * 1024.0), "MB");
+		bench::report("parse", ms, double(shapes), "shapes");
+		bench::report("tokenize (pbrt files)", tokenizeMs, double(textBytes) / (1024.0 * 1024.0), "MB");
+		printf("command streams: %.1f MB for %.1f MB of text\n", double(streamBytes) / (1024.0 * 1024.0), double(textBytes) / (1024.0 * 1024.0));
+	}
+}
+
+void runParserBench(const char* preset)
+{
+	System::argSilent = true;
+	bool found = false;
+	for (const auto& p : getPresets())
+	{
+		// large is only run when requested
+		if (preset ? strcmp(preset, p.name) == 0 : strcmp(p.name, "large") != 0)
+		{
+			runPreset(p);
+			found = true;
+		}
+	}
+	if (!found)
+		printf("unknown preset %s (small, medium, large)\n", preset);
+	printf("peak memory: %.1f MB\n", double(bench::getPeakMemory()) / (1024.0 * 1024.0));
+}
@@ -0,0 +1,111 @@
+#include "bench.h"
+#include "../scan.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <functional>
+#include <cstdio>
+
+namespace
+{
+	// parameter list like text: float arrays with line breaks and quoted strings
+	std::string makeText(size_t bytes)
+	{
+		std::mt19937 rng(7);
+		std::uniform_int_distribution<int> arrayLength(1, 2000);
+		std::uniform_int_distribution<int> stringLength(1, 48);
+		std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+		std::string text;
+		char buffer[32];
+		while (text.size() < bytes)
+		{
+			text += "\"string name\" \"";
+			text.append(size_t(stringLength(rng)), 'a');
+			text += "\"\n\"float values\" [ ";
+			const int n = arrayLength(rng);
+			for (int i = 0; i < n; ++i)
+			{
+				snprintf(buffer, sizeof(buffer), "%g%s", value(rng), (i % 12 == 11) ? "\n\t\t" : " ");
+				text += buffer;
+			}
+			text += "]\n";
+		}
+		return text;
+	}
+
+	// alternating whitespace and tokens like getRawStringVector
+	template<class TSkip, class TFind>
+	size_t countTokens(const char* c, const char* end, TSkip skip, TFind find)
+	{
+		size_t count = 0;
+		size_t sum = 0;
+		while (c < end)
+		{
+			c = skip(c, end);
+			if (c >= end)
+				break;
+			const char* tokenEnd = find(c, end);
+			sum += size_t(tokenEnd - c);
+			c = tokenEnd;
+			++count;
+		}
+		return count + sum;
+	}
+
+	// positions of all tokens
+	template<class TFind>
+	size_t findAll(const char* c, const char* end, char token, TFind find)
+	{
+		size_t sum = 0;
+		while (c < end)
+		{
+			c = find(c, end, token);
+			sum += size_t(end - c);
+			++c;
+		}
+		return sum;
+	}
+
+	template<class TFunc>
+	void compare(const char* name, double mb, TFunc simd, TFunc scalar)
+	{
+		size_t a = 0, b = 0;
+		const double simdMs = bench::measure([&]() { a = simd(); });
+		const double scalarMs = bench::measure([&]() { b = scalar(); });
+		const std::string simdName = std::string(name) + " (simd)";
+		const std::string scalarName = std::string(name) + " (scalar)";
+		bench::report(simdName.c_str(), simdMs, mb, "MB");
+		bench::report(scalarName.c_str(), scalarMs, mb, "MB");
+		if (a != b)
+			printf("%s: results differ!\n", name);
+	}
+}
+
+void runScanBench()
+{
+	const std::string text = makeText(32 * 1024 * 1024);
+	const char* begin = text.data();
+	const char* end = begin + text.size();
+	const double mb = double(text.size()) / (1024.0 * 1024.0);
+#if defined(SCAN_USE_AVX2)
+	printf("scan primitives (avx2)\n");
+#elif defined(SCAN_USE_SSE2)
+	printf("scan primitives (sse2)\n");
+#else
+	printf("scan primitives (no simd available)\n");
+#endif
+
+	typedef std::function<size_t()> Func;
+	compare("skipSpace + findSpace", mb,
+		Func([&]() { return countTokens(begin, end, scan::skipSpace, scan::findSpace); }),
+		Func([&]() { return countTokens(begin, end, scan::scalar::skipSpace, scan::scalar::findSpace); }));
+	compare("find ]", mb,
+		Func([&]() { return findAll(begin, end, ']', scan::find); }),
+		Func([&]() { return findAll(begin, end, ']', scan::scalar::find); }));
+	compare("find \"", mb,
+		Func([&]() { return findAll(begin, end, '"', scan::find); }),
+		Func([&]() { return findAll(begin, end, '"', scan::scalar::find); }));
+	compare("findOrNull ]", mb,
+		Func([&]() { return findAll(begin, end, ']', scan::findOrNull); }),
+		Func([&]() { return findAll(begin, end, ']', scan::scalar::findOrNull); }));
+}
@@ -0,0 +1,173 @@
+#include "scene_generator.h"
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	// xorshift32 (same numbers on every platform)
+	class Random
+	{
+	public:
+		explicit Random(uint32_t seed) : m_state(seed ? seed : 0x9E3779B9u) {}
+		uint32_t next()
+		{
+			m_state ^= m_state << 13;
+			m_state ^= m_state >> 17;
+			m_state ^= m_state << 5;
+			return m_state;
+		}
+		// [0, 1)
+		float uniform()
+		{
+			return float(next() >> 8) / float(1 << 24);
+		}
+		float uniform(float a, float b)
+		{
+			return a + (b - a) * uniform();
+		}
+	private:
+		uint32_t m_state;
+	};
+
+	class Writer
+	{
+	public:
+		explicit Writer(const std::string& filename)
+		{
+			m_file = fopen(filename.c_str(), "wb");
+			if (!m_file)
+				throw std::runtime_error("cannot write " + filename);
+		}
+		~Writer()
+		{
+			fclose(m_file);
+		}
+		template<class... T>
+		void print(const char* format, T... args)
+		{
+			const int n = fprintf(m_file, format, args...);
+			if (n > 0) m_bytes += size_t(n);
+		}
+		size_t getBytes() const
+		{
+			return m_bytes;
+		}
+	private:
+		FILE* m_file;
+		size_t m_bytes = 0;
+	};
+
+	// height field like grid in [-1, 1]^2 with normals and uvs
+	void writeMesh(Writer& w, Random& rnd, int res)
+	{
+		const int n = res + 1;
+		std::vector<float> z(size_t(n) * n);
+		for (auto& h : z)
+			h = rnd.uniform(-0.05f, 0.05f);
+
+		w.print("Shape \"trianglemesh\"\n\"integer indices\" [");
+		for (int y = 0; y < res; ++y)
+			for (int x = 0; x < res; ++x)
+			{
+				const int i = y * n + x;
+				w.print(" %d %d %d %d %d %d", i, i + 1, i + n + 1, i, i + n + 1, i + n);
+			}
+		w.print(" ]\n\"point P\" [");
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				w.print(" %.5f %.5f %.5f", 2.0f * float(x) / float(res) - 1.0f, 2.0f * float(y) / float(res) - 1.0f, z[size_t(y) * n + x]);
+		w.print(" ]\n\"normal N\" [");
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+			{
+				// central differences
+				const float dx = z[size_t(y) * n + std::min(x + 1, res)] - z[size_t(y) * n + std::max(x - 1, 0)];
+				const float dy = z[size_t(std::min(y + 1, res)) * n + x] - z[size_t(std::max(y - 1, 0)) * n + x];
+				const float len = std::sqrt(dx * dx + dy * dy + 1.0f);
+				w.print(" %.5f %.5f %.5f", -dx / len, -dy / len, 1.0f / len);
+			}
+		w.print(" ]\n\"float uv\" [");
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				w.print(" %.5f %.5f", float(x) / float(res), float(y) / float(res));
+		w.print(" ]\n");
+	}
+
+	void writeMeshBlock(Writer& w, Random& rnd, const SceneConfig& c)
+	{
+		for (int d = 0; d < c.attributeDepth; ++d)
+			w.print("AttributeBegin\nTranslate %.4f %.4f %.4f\n", rnd.uniform(-5.0f, 5.0f), rnd.uniform(-5.0f, 5.0f), rnd.uniform(-5.0f, 5.0f));
+		if (c.materials > 0)
+			w.print("NamedMaterial \"mat%u\"\n", rnd.next() % uint32_t(c.materials));
+		writeMesh(w, rnd, c.meshResolution);
+		for (int d = 0; d < c.attributeDepth; ++d)
+			w.print("AttributeEnd\n");
+	}
+}
+
+size_t generateScene(const SceneConfig& c, const std::string& directory, const std::string& name)
+{
+	Random rnd(c.seed);
+	size_t bytes = 0;
+	{
+		Writer w(directory + name + ".pbrt");
+		w.print("# synthetic scene (seed %u)\n", c.seed);
+		w.print("LookAt 0 0 20  0 0 0  0 1 0\n");
+		w.print("Camera \"perspective\" \"float fov\" [45]\n");
+		w.print("Film \"image\" \"integer xresolution\" [640] \"integer yresolution\" [480] \"string filename\" \"%s.exr\"\n", name.c_str());
+		w.print("Sampler \"halton\" \"integer pixelsamples\" [16]\n");
+		w.print("WorldBegin\n");
+		w.print("LightSource \"infinite\" \"rgb L\" [1 1 1]\n");
+
+		for (int i = 0; i < c.textures; ++i)
+			w.print("Texture \"tex%d\" \"spectrum\" \"checkerboard\" \"float uscale\" [%d] \"float vscale\" [%d] \"rgb tex1\" [%.3f %.3f %.3f] \"rgb tex2\" [%.3f %.3f %.3f]\n",
+				i, 1 + i % 8, 1 + i % 8, rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform());
+		for (int i = 0; i < c.materials; ++i)
+		{
+			if (c.textures > 0 && i % 2 == 0)
+				w.print("MakeNamedMaterial \"mat%d\" \"string type\" [\"matte\"] \"texture Kd\" \"tex%d\"\n", i, i % c.textures);
+			else
+				w.print("MakeNamedMaterial \"mat%d\" \"string type\" [\"plastic\"] \"rgb Kd\" [%.3f %.3f %.3f] \"float roughness\" [%.3f]\n",
+					i, rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform(0.01f, 0.5f));
+		}
+
+		for (int i = 0; i < c.objects; ++i)
+		{
+			w.print("ObjectBegin \"obj%d\"\n", i);
+			writeMesh(w, rnd, std::max(c.meshResolution / 4, 1));
+			w.print("ObjectEnd\n");
+		}
+
+		if (c.includes > 0)
+		{
+			for (int f = 0; f < c.includes; ++f)
+				w.print("Include \"%s_%d.pbrt\"\n", name.c_str(), f);
+		}
+		else
+		{
+			for (int i = 0; i < c.meshes; ++i)
+				writeMeshBlock(w, rnd, c);
+		}
+
+		if (c.objects > 0)
+			for (int i = 0; i < c.instances; ++i)
+				w.print("AttributeBegin\nTranslate %.4f %.4f %.4f\nObjectInstance \"obj%u\"\nAttributeEnd\n",
+					rnd.uniform(-10.0f, 10.0f), rnd.uniform(-10.0f, 10.0f), rnd.uniform(-10.0f, 10.0f), rnd.next() % uint32_t(c.objects));
+
+		w.print("WorldEnd\n");
+		bytes += w.getBytes();
+	}
+
+	// meshes are distributed evenly over the includes
+	for (int f = 0; f < c.includes; ++f)
+	{
+		Writer w(directory + name + "_" + std::to_string(f) + ".pbrt");
+		for (int i = f; i < c.meshes; i += c.includes)
+			writeMeshBlock(w, rnd, c);
+		bytes += w.getBytes();
+	}
+	return bytes;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// settings of a synthetic pbrt scene
+struct SceneConfig
+{
+	int meshes = 64; // inline triangle meshes (spread over the included files)
+	int meshResolution = 32; // quads per side of every mesh
+	int attributeDepth = 2; // nested AttributeBegin/Translate blocks around every mesh
+	int materials = 16; // named materials
+	int textures = 16; // checkerboard textures used by the materials
+	int objects = 4; // ObjectBegin/ObjectEnd definitions
+	int instances = 64; // ObjectInstance calls
+	int includes = 4; // included files with the meshes (0: everything in the main file)
+	uint32_t seed = 1;
+};
+
+/**
+ * \brief writes a synthetic scene. The output only depends on the config (no std random distributions)
+ * \param directory existing directory like "dir/"
+ * \param name main file is directory + name + ".pbrt", includes are name_0.pbrt, name_1.pbrt ...
+ * \return total bytes of all written files
+ */
+size_t generateScene(const SceneConfig& config, const std::string& directory, const std::string& name);
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "../PBRT/spectrum.h"
+#include <vector>
+#include <random>
+#include <cmath>
+
+// conversion like before the resampling and projection were vectorized (one interpolation search per cie sample)
+static RGBSpectrum referenceFromSampled(const float* lambda, const float* v, int n)
+{
+	float xyz[3] = { 0, 0, 0 };
+	float yint = 0.f;
+	for (int i = 0; i < nCIESamples; ++i) {
+		yint += CIE_Y[i];
+		const float val = InterpolateSpectrumSamples(lambda, v, n, CIE_lambda[i]);
+		xyz[0] += val * CIE_X[i];
+		xyz[1] += val * CIE_Y[i];
+		xyz[2] += val * CIE_Z[i];
+	}
+	xyz[0] /= yint;
+	xyz[1] /= yint;
+	xyz[2] /= yint;
+	return RGBSpectrum::FromXYZ(xyz);
+}
+
+static float maxRelativeError(const std::vector<RGBSpectrum>& a, const std::vector<RGBSpectrum>& b)
+{
+	float err = 0.0f;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		const float ra[3] = { a[i].getR(), a[i].getG(), a[i].getB() };
+		const float rb[3] = { b[i].getR(), b[i].getG(), b[i].getB() };
+		for (int c = 0; c < 3; ++c)
+			err = std::max(err, std::abs(ra[c] - rb[c]) / std::max(std::abs(rb[c]), 1e-3f));
+	}
+	return err;
+}
+
+void runSpectrumBench()
+{
+	const int numSpectra = 20000;
+	const int numTemperatures = 20000;
+	std::mt19937 rng(42);
+
+	// measured spectra with 20 to 100 irregular samples between 300 and 800 nm
+	std::vector<int> offsets(1, 0);
+	std::vector<float> lambda, values;
+	{
+		std::uniform_int_distribution<int> count(20, 100);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int s = 0; s < numSpectra; ++s)
+		{
+			const int n = count(rng);
+			float l = 300.0f;
+			const float step = 500.0f / float(n);
+			for (int i = 0; i < n; ++i)
+			{
+				l += step * (0.5f + unit(rng));
+				lambda.push_back(l);
+				values.push_back(unit(rng));
+			}
+			offsets.push_back(int(lambda.size()));
+		}
+	}
+	std::vector<float> temperatures(numTemperatures);
+	{
+		std::uniform_real_distribution<float> temp(1000.0f, 12000.0f);
+		for (auto& t : temperatures)
+			t = temp(rng);
+	}
+
+	std::vector<RGBSpectrum> ref(numSpectra), res(numSpectra);
+	printf("spectrum (%d measured spectra, %d blackbody temperatures)\n", numSpectra, numTemperatures);
+
+	double ms = bench::measure([&]()
+	{
+		for (int s = 0; s < numSpectra; ++s)
+			ref[s] = referenceFromSampled(&lambda[offsets[s]], &values[offsets[s]], offsets[s + 1] - offsets[s]);
+	});
+	bench::report("FromSampled (reference)", ms, numSpectra, "spectra");
+	ms = bench::measure([&]()
+	{
+		for (int s = 0; s < numSpectra; ++s)
+			res[s] = RGBSpectrum::FromSampled(&lambda[offsets[s]], &values[offsets[s]], offsets[s + 1] - offsets[s]);
+	});
+	bench::report("FromSampled", ms, numSpectra, "spectra");
+	printf("max relative difference: %g\n", maxRelativeError(res, ref));
+
+	ref.resize(numTemperatures);
+	res.resize(numTemperatures);
+	float v[nCIESamples];
+	ms = bench::measure([&]()
+	{
+		for (int i = 0; i < numTemperatures; ++i)
+		{
+			Blackbody(CIE_lambda, nCIESamples, temperatures[i], v);
+			ref[i] = referenceFromSampled(CIE_lambda, v, nCIESamples);
+		}
+	});
+	bench::report("blackbody (reference)", ms, numTemperatures, "spectra");
+	ms = bench::measure([&]()
+	{
+		for (int i = 0; i < numTemperatures; ++i)
+		{
+			BlackbodyCIE(temperatures[i], v);
+			res[i] = RGBSpectrum::FromCIESampled(v);
+		}
+	});
+	bench::report("blackbody", ms, numTemperatures, "spectra");
+	printf("max relative difference: %g\n", maxRelativeError(res, ref));
+
+	// scene files usually repeat a few temperatures
+	ms = bench::measure([&]()
+	{
+		for (int i = 0; i < numTemperatures; ++i)
+			bench::keep(BlackbodySpectrum(float(int(temperatures[i]) / 500 * 500)));
+	});
+	bench::report("BlackbodySpectrum (cached)", ms, numTemperatures, "spectra");
+}
@@ -0,0 +1,642 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PBRT/ParamSet.h"
+#include "parser_helper.h"
+#include "scan.h"
+#include "system.h"
+#include "profiler.h"
+
+// compact binary form of a pbrt file. The tokenizer appends the commands with their arguments
+// to one arena of 32 bit words and replay() executes them on a PbrtScene like consumer.
+// Large numeric arrays are kept as text until they are accessed.
+//
+// command:		op, line, arguments
+// arguments:	floats = count, values | string = id of the interned string | parameters = count, parameter...
+// parameter:	kind, name id, count, values (vectors are 3 floats, bools and strings one word each)
+//				large numeric arrays: kind, name id, element count, text id (converted by the ParamSet on access)
+class CommandStream
+{
+public:
+	enum class Op : uint32_t
+	{
+		Identity,
+		Translate, // floats
+		Scale, // floats
+		Rotate, // floats
+		LookAt, // floats
+		Transform, // floats
+		ConcatTransform, // floats
+		ActiveTransform, // word (1 = start time, 0 = end time)
+		CoordinateSystem, // string
+		CoordSysTransform, // string
+		AttributeBegin,
+		AttributeEnd,
+		TransformBegin,
+		TransformEnd,
+		WorldBegin,
+		WorldEnd,
+		// string, parameters
+		Camera,
+		Sampler,
+		Film,
+		Renderer,
+		SurfaceIntegrator,
+		VolumeIntegrator,
+		Accelerator,
+		PixelFilter,
+		Shape,
+		LightSource,
+		AreaLightSource,
+		Material,
+		MakeNamedMaterial,
+		Volume,
+		//
+		ObjectBegin, // string
+		ObjectEnd,
+		ObjectInstance, // string
+		ReverseOrientation,
+		NamedMaterial, // string
+		Texture, // 3 strings, parameters
+		Include // string
+	};
+
+	enum class ParamKind : uint32_t
+	{
+		Float,
+		Int,
+		Bool,
+		Point,
+		Vector,
+		Normal,
+		String,
+		Texture,
+		RGB,
+		XYZ,
+		Blackbody,
+		// unconverted text
+		FloatText,
+		IntText,
+		PointText,
+		VectorText,
+		NormalText
+	};
+
+	// reads the commands in order
+	class Reader
+	{
+	public:
+		explicit Reader(const CommandStream& stream)
+			:
+		m_stream(stream)
+		{}
+
+		// moves to the next command. returns false at the end of the stream
+		bool next()
+		{
+			if (m_pos >= m_stream.m_words.size())
+				return false;
+			m_op = Op(readWord());
+			m_line = readWord();
+			return true;
+		}
+		Op getOp() const
+		{
+			return m_op;
+		}
+		uint32_t getLine() const
+		{
+			return m_line;
+		}
+
+		uint32_t readWord()
+		{
+			return m_stream.m_words[m_pos++];
+		}
+		std::vector<float> readFloats()
+		{
+			return readFloatArray(readWord());
+		}
+		const std::string& readString()
+		{
+			return m_stream.m_strings[readWord()];
+		}
+		void readParams(ParamSet& set)
+		{
+			const uint32_t count = readWord();
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const auto kind = ParamKind(readWord());
+				const std::string& name = readString();
+				const uint32_t n = readWord();
+				switch (kind)
+				{
+				case ParamKind::Float: set.addFloat(name, readFloatArray(n)); break;
+				case ParamKind::Int:
+				{
+					std::vector<int> v(n);
+					for (auto& x : v) x = int(readWord());
+					set.addInt(name, std::move(v));
+				}	break;
+				case ParamKind::Bool:
+				{
+					std::vector<bool> v(n);
+					for (uint32_t j = 0; j < n; ++j) v[j] = readWord() != 0;
+					set.addBool(name, std::move(v));
+				}	break;
+				case ParamKind::Point: set.addPoint(name, readVectorArray(n)); break;
+				case ParamKind::Vector: set.addVector(name, readVectorArray(n)); break;
+				case ParamKind::Normal: set.addNormal(name, readVectorArray(n)); break;
+				case ParamKind::String:
+				{
+					std::vector<std::string> v(n);
+					for (auto& x : v) x = readString();
+					set.addString(name, std::move(v));
+				}	break;
+				case ParamKind::Texture: set.addTexture(name, readString()); break;
+				case ParamKind::RGB: set.addRGBSpectrum(name, readFloatArray(n)); break;
+				case ParamKind::XYZ: set.addXYZSpectrum(name, readFloatArray(n)); break;
+				case ParamKind::Blackbody: set.addBlackbodySpectrum(name, readFloatArray(n)); break;
+				case ParamKind::FloatText: set.addLazyFloat(name, readText(n, decodeFloats)); break;
+				case ParamKind::IntText: set.addLazyInt(name, readText(n, decodeInts)); break;
+				case ParamKind::PointText: set.addLazyPoint(name, readText(n, decodeVectors)); break;
+				case ParamKind::VectorText: set.addLazyVector(name, readText(n, decodeVectors)); break;
+				case ParamKind::NormalText: set.addLazyNormal(name, readText(n, decodeVectors)); break;
+				}
+			}
+		}
+
+	private:
+		template<class T>
+		ParamSet::LazyArray<T> readText(uint32_t count, std::vector<T>(*decode)(const std::string&))
+		{
+			ParamSet::LazyArray<T> a;
+			a.text = m_stream.m_texts[readWord()];
+			a.count = count;
+			a.decode = decode;
+			return a;
+		}
+		std::vector<float> readFloatArray(uint32_t count)
+		{
+			std::vector<float> v(count);
+			if (count)
+				memcpy(v.data(), &m_stream.m_words[m_pos], count * sizeof(float));
+			m_pos += count;
+			return v;
+		}
+		// the vectors are constructed from the words in one pass
+		std::vector<Vector> readVectorArray(uint32_t count)
+		{
+			std::vector<Vector> v;
+			v.reserve(count / 3);
+			const uint32_t* w = m_stream.m_words.data() + m_pos;
+			for (uint32_t i = 0; i + 2 < count; i += 3)
+			{
+				float f[3];
+				memcpy(f, w + i, sizeof(f));
+				v.emplace_back(f[0], f[1], f[2]);
+			}
+			m_pos += count;
+			return v;
+		}
+
+		const CommandStream& m_stream;
+		size_t m_pos = 0;
+		Op m_op = Op::Identity;
+		uint32_t m_line = 0;
+	};
+
+	// starts a new command
+	void begin(Op op, uint32_t line)
+	{
+		m_commandStart = m_words.size();
+		m_words.push_back(uint32_t(op));
+		m_words.push_back(line);
+	}
+	void writeWord(uint32_t w)
+	{
+		m_words.push_back(w);
+	}
+	void writeFloats(const std::vector<float>& v)
+	{
+		m_words.push_back(uint32_t(v.size()));
+		writeFloatArray(v.data(), v.size());
+	}
+	void writeString(const std::string& s)
+	{
+		m_words.push_back(intern(s));
+	}
+	// starts the parameter list of the current command (filled with the add functions)
+	void beginParams()
+	{
+		m_paramCount = m_words.size();
+		m_words.push_back(0);
+	}
+
+	// same interface as ParamSet for initParamSet()
+	void addFloat(const std::string& n, const std::vector<float>& v)
+	{
+		writeParam(ParamKind::Float, n, v.size());
+		writeFloatArray(v.data(), v.size());
+	}
+	void addInt(const std::string& n, const std::vector<int>& v)
+	{
+		writeParam(ParamKind::Int, n, v.size());
+		for (auto x : v) m_words.push_back(uint32_t(x));
+	}
+	void addBool(const std::string& n, const std::vector<bool>& v)
+	{
+		writeParam(ParamKind::Bool, n, v.size());
+		for (bool x : v) m_words.push_back(x ? 1 : 0);
+	}
+	void addPoint(const std::string& n, const std::vector<Vector>& v)
+	{
+		writeVectors(ParamKind::Point, n, v);
+	}
+	void addVector(const std::string& n, const std::vector<Vector>& v)
+	{
+		writeVectors(ParamKind::Vector, n, v);
+	}
+	void addNormal(const std::string& n, const std::vector<Vector>& v)
+	{
+		writeVectors(ParamKind::Normal, n, v);
+	}
+	void addString(const std::string& n, const std::vector<std::string>& v)
+	{
+		writeParam(ParamKind::String, n, v.size());
+		for (const auto& s : v) m_words.push_back(intern(s));
+	}
+	void addTexture(const std::string& n, const std::string& v)
+	{
+		writeParam(ParamKind::Texture, n, 1);
+		m_words.push_back(intern(v));
+	}
+	void addRGBSpectrum(const std::string& n, const std::vector<float>& v)
+	{
+		writeParam(ParamKind::RGB, n, v.size());
+		writeFloatArray(v.data(), v.size());
+	}
+	void addXYZSpectrum(const std::string& n, const std::vector<float>& v)
+	{
+		writeParam(ParamKind::XYZ, n, v.size());
+		writeFloatArray(v.data(), v.size());
+	}
+	void addBlackbodySpectrum(const std::string& n, const std::vector<float>& v)
+	{
+		writeParam(ParamKind::Blackbody, n, v.size());
+		writeFloatArray(v.data(), v.size());
+	}
+	// numeric array between begin and end ([] excluded) that is converted on the first access
+	void addArrayText(pbrtParamType type, const std::string& n, const char* begin, const char* end)
+	{
+		ParamKind kind = ParamKind::FloatText;
+		size_t count = scan::countTokens(begin, end);
+		switch (type)
+		{
+		case pbrtParamType::Integer: kind = ParamKind::IntText; break;
+		case pbrtParamType::Point: kind = ParamKind::PointText; break;
+		case pbrtParamType::Vector: kind = ParamKind::VectorText; break;
+		case pbrtParamType::Normal: kind = ParamKind::NormalText; break;
+		default: break;
+		}
+		if (kind == ParamKind::PointText || kind == ParamKind::VectorText || kind == ParamKind::NormalText)
+		{
+			// same error as getVectorVector
+			if (count % 3 != 0)
+				throw InvalidArgCount(end, count, (count / 3 + 1) * 3);
+			count /= 3;
+		}
+		writeParam(kind, n, count);
+		m_words.push_back(uint32_t(m_texts.size()));
+		m_texts.push_back(ParamSet::makeText(std::string(begin, end)));
+	}
+
+	// drops the unfinished command. The message is reported after the remaining commands were executed
+	void fail(const std::string& message)
+	{
+		m_words.resize(m_commandStart);
+		m_error = message;
+	}
+	const std::string& getError() const
+	{
+		return m_error;
+	}
+
+	bool empty() const
+	{
+		return m_words.empty();
+	}
+	// arena and string table size in bytes
+	size_t getMemorySize() const
+	{
+		size_t size = m_words.capacity() * sizeof(uint32_t);
+		for (const auto& s : m_strings)
+			size += sizeof(std::string) + s.capacity();
+		for (const auto& t : m_texts)
+			size += sizeof(std::string) + t->capacity();
+		return size;
+	}
+
+	// binary form for the cache of --incremental (only valid for the same build). The key is stored with the stream
+	bool save(FILE* file, uint64_t key) const
+	{
+		const uint32_t header[2] = { MAGIC, VERSION };
+		bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(&key, sizeof(key), 1, file) == 1;
+		ok = ok && writeArray(file, m_words.data(), m_words.size());
+		ok = ok && writeSize(file, m_strings.size());
+		for (const auto& str : m_strings)
+			ok = ok && writeArray(file, str.data(), str.size());
+		ok = ok && writeSize(file, m_texts.size());
+		for (const auto& t : m_texts)
+			ok = ok && writeArray(file, t->data(), t->size());
+		return ok && writeArray(file, m_error.data(), m_error.size());
+	}
+	// returns false if the file is no stream with this key (loaded streams can only be read)
+	bool load(FILE* file, uint64_t key)
+	{
+		uint32_t header[2];
+		uint64_t storedKey = 0;
+		if (fread(header, sizeof(header), 1, file) != 1 || header[0] != MAGIC || header[1] != VERSION)
+			return false;
+		if (fread(&storedKey, sizeof(storedKey), 1, file) != 1 || storedKey != key)
+			return false;
+		uint64_t count = 0;
+		// ids are 32 bit words
+		if (!readArray(file, m_words) || !readSize(file, count) || count > UINT32_MAX)
+			return false;
+		m_strings.resize(size_t(count));
+		for (auto& str : m_strings)
+			if (!readArray(file, str))
+				return false;
+		if (!readSize(file, count) || count > UINT32_MAX)
+			return false;
+		m_texts.resize(size_t(count));
+		for (auto& t : m_texts)
+		{
+			std::string text;
+			if (!readArray(file, text))
+				return false;
+			t = ParamSet::makeText(std::move(text));
+		}
+		return readArray(file, m_error) && isValid();
+	}
+
+private:
+	static const uint32_t MAGIC = 0x53434250; // "PBCS"
+	static const uint32_t VERSION = 1;
+
+	static bool writeSize(FILE* file, uint64_t size)
+	{
+		return fwrite(&size, sizeof(size), 1, file) == 1;
+	}
+	template<class T>
+	static bool writeArray(FILE* file, const T* data, size_t count)
+	{
+		return writeSize(file, count) && (count == 0 || fwrite(data, sizeof(T), count, file) == count);
+	}
+	static bool readSize(FILE* file, uint64_t& size)
+	{
+		return fread(&size, sizeof(size), 1, file) == 1;
+	}
+	template<class TContainer>
+	static bool readArray(FILE* file, TContainer& dst)
+	{
+		uint64_t count = 0;
+		if (!readSize(file, count) || count > (uint64_t(1) << 40))
+			return false;
+		dst.resize(size_t(count));
+		return count == 0 || fread(&dst[0], sizeof(dst[0]), size_t(count), file) == count;
+	}
+
+	// checks that the commands of a loaded stream stay inside the words and reference existing strings and texts
+	bool isValid() const
+	{
+		size_t pos = 0;
+		auto word = [this, &pos](uint32_t& w)
+		{
+			if (pos >= m_words.size())
+				return false;
+			w = m_words[pos++];
+			return true;
+		};
+		auto skip = [this, &pos](uint32_t count)
+		{
+			if (count > m_words.size() - pos)
+				return false;
+			pos += count;
+			return true;
+		};
+		auto string = [this, &word]()
+		{
+			uint32_t id;
+			return word(id) && id < m_strings.size();
+		};
+		auto floats = [&word, &skip]()
+		{
+			uint32_t count;
+			return word(count) && skip(count);
+		};
+		auto params = [this, &word, &skip, &string]()
+		{
+			uint32_t count;
+			if (!word(count))
+				return false;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				uint32_t kind, n, id;
+				if (!word(kind) || !string() || !word(n))
+					return false;
+				switch (ParamKind(kind))
+				{
+				case ParamKind::Float: case ParamKind::Int: case ParamKind::Bool:
+				case ParamKind::Point: case ParamKind::Vector: case ParamKind::Normal:
+				case ParamKind::RGB: case ParamKind::XYZ: case ParamKind::Blackbody:
+					if (!skip(n))
+						return false;
+					break;
+				case ParamKind::String: case ParamKind::Texture:
+					for (uint32_t j = 0; j < n; ++j)
+						if (!string())
+							return false;
+					break;
+				case ParamKind::FloatText: case ParamKind::IntText:
+				case ParamKind::PointText: case ParamKind::VectorText: case ParamKind::NormalText:
+					if (!word(id) || id >= m_texts.size())
+						return false;
+					break;
+				default:
+					return false;
+				}
+			}
+			return true;
+		};
+
+		uint32_t op, line, w;
+		while (pos < m_words.size())
+		{
+			if (!word(op) || !word(line))
+				return false;
+			bool ok = true;
+			switch (Op(op))
+			{
+			case Op::Translate: case Op::Scale: case Op::Rotate: case Op::LookAt:
+			case Op::Transform: case Op::ConcatTransform:
+				ok = floats();
+				break;
+			case Op::ActiveTransform:
+				ok = word(w);
+				break;
+			case Op::CoordinateSystem: case Op::CoordSysTransform: case Op::ObjectBegin:
+			case Op::ObjectInstance: case Op::NamedMaterial: case Op::Include:
+				ok = string();
+				break;
+			case Op::Identity: case Op::AttributeBegin: case Op::AttributeEnd: case Op::TransformBegin:
+			case Op::TransformEnd: case Op::WorldBegin: case Op::WorldEnd: case Op::ObjectEnd:
+			case Op::ReverseOrientation:
+				break;
+			case Op::Texture:
+				ok = string() && string() && string() && params();
+				break;
+			case Op::Camera: case Op::Sampler: case Op::Film: case Op::Renderer:
+			case Op::SurfaceIntegrator: case Op::VolumeIntegrator: case Op::Accelerator: case Op::PixelFilter:
+			case Op::Shape: case Op::LightSource: case Op::AreaLightSource: case Op::Material:
+			case Op::MakeNamedMaterial: case Op::Volume:
+				ok = string() && params();
+				break;
+			default:
+				ok = false;
+			}
+			if (!ok)
+				return false;
+		}
+		return true;
+	}
+
+	uint32_t intern(const std::string& s)
+	{
+		auto it = m_ids.find(s);
+		if (it != m_ids.end())
+			return it->second;
+		const uint32_t id = uint32_t(m_strings.size());
+		m_strings.push_back(s);
+		m_ids.emplace(s, id);
+		return id;
+	}
+	void writeParam(ParamKind kind, const std::string& name, size_t count)
+	{
+		++m_words[m_paramCount];
+		m_words.push_back(uint32_t(kind));
+		m_words.push_back(intern(name));
+		m_words.push_back(uint32_t(count));
+	}
+	void writeFloatArray(const float* v, size_t count)
+	{
+		const size_t pos = m_words.size();
+		m_words.resize(pos + count);
+		if (count)
+			memcpy(&m_words[pos], v, count * sizeof(float));
+	}
+	void writeVectors(ParamKind kind, const std::string& n, const std::vector<Vector>& v)
+	{
+		writeParam(kind, n, v.size() * 3);
+		writeFloatArray(reinterpret_cast<const float*>(v.data()), v.size() * 3);
+	}
+
+	std::vector<uint32_t> m_words;
+	std::vector<std::string> m_strings;
+	std::unordered_map<std::string, uint32_t> m_ids;
+	// shared with the ParamSets
+	std::vector<std::shared_ptr<const std::string>> m_texts;
+	size_t m_commandStart = 0;
+	size_t m_paramCount = 0;
+	std::string m_error;
+};
+
+/**
+ * \brief executes the commands on the scene. Stops at the first error like the parser
+ * \param include called with the filename of Include commands
+ * \param filename file of the commands (for error messages)
+ */
+template<class TScene, class TInclude>
+void replay(const CommandStream& stream, TScene& scene, TInclude include, const std::string& filename)
+{
+	using Op = CommandStream::Op;
+	profiler::ScopedTimer timer(profiler::Phase::Replay, filename);
+	CommandStream::Reader r(stream);
+	try
+	{
+		while (r.next())
+		{
+			switch (r.getOp())
+			{
+			case Op::Identity: scene.apiIdentity(); break;
+			case Op::Translate: scene.apiTranslate(r.readFloats()); break;
+			case Op::Scale: scene.apiScale(r.readFloats()); break;
+			case Op::Rotate: scene.apiRotate(r.readFloats()); break;
+			case Op::LookAt: scene.apiLookAt(r.readFloats()); break;
+			case Op::Transform: scene.apiTransform(r.readFloats()); break;
+			case Op::ConcatTransform: scene.apiConcatTransfrom(r.readFloats()); break;
+			case Op::ActiveTransform: scene.apiSetActiveTransform(r.readWord() != 0); break;
+			case Op::CoordinateSystem: scene.apiCoordinateSystem(r.readString()); break;
+			case Op::CoordSysTransform: scene.apiCoordSysTransform(r.readString()); break;
+			case Op::AttributeBegin: scene.apiAttributeBegin(); break;
+			case Op::AttributeEnd: scene.apiAttributeEnd(); break;
+			case Op::TransformBegin: scene.apiTransformBegin(); break;
+			case Op::TransformEnd: scene.apiTransformEnd(); break;
+			case Op::WorldBegin: scene.apiWorldBegin(); break;
+			case Op::WorldEnd: scene.apiWorldEnd(); break;
+			case Op::ObjectBegin: scene.apiObjectBegin(r.readString()); break;
+			case Op::ObjectEnd: scene.apiObjectEnd(); break;
+			case Op::ObjectInstance: scene.apiObjectInstance(r.readString()); break;
+			case Op::ReverseOrientation: scene.apiReverseOrientation(); break;
+			case Op::NamedMaterial: scene.apiNamedMaterial(r.readString()); break;
+			case Op::Include: include(r.readString()); break;
+			case Op::Texture:
+			{
+				const std::string& name = r.readString();
+				const std::string& type = r.readString();
+				const std::string& clas = r.readString();
+				ParamSet set;
+				r.readParams(set);
+				scene.apiTexture(name, type, clas, set);
+			}	break;
+			default:
+			{
+				const Op op = r.getOp();
+				const std::string& name = r.readString();
+				ParamSet set;
+				r.readParams(set);
+				switch (op)
+				{
+				case Op::Camera: scene.apiCamera(name, set); break;
+				case Op::Sampler: scene.apiSampler(name, set); break;
+				case Op::Film: scene.apiFilm(name, set); break;
+				case Op::Renderer: scene.apiRenderer(name, set); break;
+				case Op::SurfaceIntegrator: scene.apiSurfaceIntegrator(name, set); break;
+				case Op::VolumeIntegrator: scene.apiVolumeIntegrator(name, set); break;
+				case Op::Accelerator: scene.apiAccelerator(name, set); break;
+				case Op::PixelFilter: scene.apiPixelFilter(name, set); break;
+				case Op::Shape: scene.apiShape(name, set); break;
+				case Op::LightSource: scene.apiLightSource(name, set); break;
+				case Op::AreaLightSource: scene.apiAreaLightSource(name, set); break;
+				case Op::Material: scene.apiMaterial(name, set); break;
+				case Op::MakeNamedMaterial: scene.apiMakeNamedMaterial(name, set); break;
+				case Op::Volume: scene.apiVolume(name, set); break;
+				default: throw std::exception("invalid command in stream");
+				}
+			}
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		System::error("line: " + std::to_string(r.getLine()) + " : " + std::string(e.what()) + " in file: " + filename);
+		return;
+	}
+	if (stream.getError().length())
+		System::error(stream.getError());
+}
@@ -0,0 +1,437 @@
+#include "compression.h"
+#include "parallel.h"
+#include "memory.h"
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#ifdef PBRT_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PBRT_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+using compression::Format;
+
+namespace
+{
+	// compressed data of a file or a buffer in chunks
+	class Input
+	{
+	public:
+		explicit Input(FILE* file)
+			:
+		m_file(file),
+		m_buffer(1 << 18)
+		{}
+		Input(const char* data, size_t size)
+			:
+		m_data(data),
+		m_size(size)
+		{}
+
+		// next chunk of at most maxSize bytes. Returns false at the end
+		bool next(const char*& data, size_t& size, size_t maxSize)
+		{
+			if (m_file)
+			{
+				size = fread(m_buffer.data(), 1, std::min(m_buffer.size(), maxSize), m_file);
+				data = m_buffer.data();
+				return size != 0;
+			}
+			size = std::min(m_size - m_offset, maxSize);
+			data = m_data + m_offset;
+			m_offset += size;
+			return size != 0;
+		}
+
+	private:
+		FILE* m_file = nullptr;
+		std::vector<char> m_buffer;
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_offset = 0;
+	};
+
+	// sizes from the headers are not trusted above this ratio to the compressed size or above the memory budget
+	// (the data would be decoded before the allocation is known to be needed)
+	const size_t MAX_RATIO = 256;
+
+	bool isPlausibleSize(size_t decodedSize, size_t size)
+	{
+		return decodedSize / MAX_RATIO <= size && decodedSize <= memory::getBudget();
+	}
+
+	// the uncompressed size stored in the data (hint for the allocation) or 0
+	size_t getSizeHint(Format format, const char* data, size_t size)
+	{
+#ifdef PBRT_HAS_ZSTD
+		if (format == Format::Zstd)
+		{
+			// size of the first frame
+			const unsigned long long n = ZSTD_getFrameContentSize(data, size);
+			return n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR ? 0 : size_t(n);
+		}
+#endif
+		// ISIZE of the last gzip member (size modulo 2^32, so only a hint)
+		if (format == Format::Gzip && size >= 18)
+		{
+			const unsigned char* c = reinterpret_cast<const unsigned char*>(data + size - 4);
+			return size_t(c[0]) | size_t(c[1]) << 8 | size_t(c[2]) << 16 | size_t(c[3]) << 24;
+		}
+		return 0;
+	}
+
+#ifdef PBRT_HAS_ZSTD
+	// frames of a zstd file with their decoded offsets. false if a frame does not store its size
+	struct Frame
+	{
+		const char* data;
+		size_t size;
+		size_t offset;
+		size_t decodedSize;
+	};
+	bool getFrames(const char* data, size_t size, std::vector<Frame>& frames, size_t& decodedSize)
+	{
+		decodedSize = 0;
+		while (size)
+		{
+			const size_t frameSize = ZSTD_findFrameCompressedSize(data, size);
+			if (ZSTD_isError(frameSize))
+				return false;
+			const unsigned long long n = ZSTD_getFrameContentSize(data, frameSize);
+			if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR)
+				return false;
+			frames.push_back(Frame{ data, frameSize, decodedSize, size_t(n) });
+			decodedSize += size_t(n);
+			data += frameSize;
+			size -= frameSize;
+		}
+		return true;
+	}
+#endif
+}
+
+namespace compression
+{
+	class Decoder
+	{
+	public:
+		explicit Decoder(Input input)
+			:
+		m_input(std::move(input))
+		{}
+		virtual ~Decoder() = default;
+		virtual size_t read(char* dst, size_t size) = 0;
+		const std::string& getError() const
+		{
+			return m_error;
+		}
+
+	protected:
+		Input m_input;
+		std::string m_error;
+	};
+}
+
+namespace
+{
+	class UnsupportedDecoder : public compression::Decoder
+	{
+	public:
+		UnsupportedDecoder(Input input, Format format)
+			:
+		Decoder(std::move(input))
+		{
+			m_error = std::string("the converter was built without ") + compression::getName(format) + " support";
+		}
+		size_t read(char*, size_t) override
+		{
+			return 0;
+		}
+	};
+
+#ifdef PBRT_HAS_ZLIB
+	class GzipDecoder : public compression::Decoder
+	{
+	public:
+		explicit GzipDecoder(Input input)
+			:
+		Decoder(std::move(input))
+		{
+			memset(&m_stream, 0, sizeof(m_stream));
+			// 16: gzip header and trailer
+			if (inflateInit2(&m_stream, 15 + 16) != Z_OK)
+				m_error = "cannot initialize zlib";
+		}
+		~GzipDecoder() override
+		{
+			inflateEnd(&m_stream);
+		}
+
+		size_t read(char* dst, size_t size) override
+		{
+			if (m_error.size() || m_end)
+				return 0;
+			// avail_out is 32 bit
+			size = std::min(size, size_t(1) << 30);
+			m_stream.next_out = reinterpret_cast<Bytef*>(dst);
+			m_stream.avail_out = uInt(size);
+			while (m_stream.avail_out)
+			{
+				if (m_stream.avail_in == 0 && !refill())
+				{
+					m_error = "unexpected end of the compressed data";
+					break;
+				}
+				const int res = inflate(&m_stream, Z_NO_FLUSH);
+				if (res == Z_STREAM_END)
+				{
+					// concatenated members (bgzip, cat a.gz b.gz)
+					if (m_stream.avail_in == 0 && !refill())
+					{
+						m_end = true;
+						break;
+					}
+					inflateReset(&m_stream);
+					continue;
+				}
+				if (res != Z_OK && res != Z_BUF_ERROR)
+				{
+					m_error = std::string("zlib: ") + (m_stream.msg ? m_stream.msg : "corrupt data");
+					break;
+				}
+			}
+			return size - m_stream.avail_out;
+		}
+
+	private:
+		bool refill()
+		{
+			const char* data;
+			size_t size;
+			if (!m_input.next(data, size, size_t(1) << 30))
+				return false;
+			m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			m_stream.avail_in = uInt(size);
+			return true;
+		}
+
+		z_stream m_stream;
+		bool m_end = false;
+	};
+#endif
+
+#ifdef PBRT_HAS_ZSTD
+	class ZstdDecoder : public compression::Decoder
+	{
+	public:
+		explicit ZstdDecoder(Input input)
+			:
+		Decoder(std::move(input)),
+		m_context(ZSTD_createDCtx())
+		{
+			if (!m_context)
+				m_error = "cannot initialize zstd";
+		}
+		~ZstdDecoder() override
+		{
+			ZSTD_freeDCtx(m_context);
+		}
+
+		size_t read(char* dst, size_t size) override
+		{
+			if (m_error.size() || m_end)
+				return 0;
+			ZSTD_outBuffer out = { dst, size, 0 };
+			while (out.pos < out.size)
+			{
+				if (m_in.pos == m_in.size && !m_inputEnd)
+				{
+					const char* data;
+					size_t n;
+					if (m_input.next(data, n, ~size_t(0)))
+						m_in = ZSTD_inBuffer{ data, n, 0 };
+					else
+						m_inputEnd = true;
+				}
+				// m_remaining is 0 after a complete frame
+				if (m_inputEnd && m_remaining == 0)
+				{
+					m_end = true;
+					break;
+				}
+				// without input the decoder still flushes its buffered output
+				const size_t previous = out.pos;
+				const size_t res = ZSTD_decompressStream(m_context, &out, &m_in);
+				if (ZSTD_isError(res))
+				{
+					m_error = std::string("zstd: ") + ZSTD_getErrorName(res);
+					break;
+				}
+				m_remaining = res;
+				if (m_inputEnd && out.pos == previous && m_remaining != 0)
+				{
+					m_error = "unexpected end of the compressed data";
+					break;
+				}
+			}
+			return out.pos;
+		}
+
+	private:
+		ZSTD_DCtx* m_context;
+		ZSTD_inBuffer m_in = { nullptr, 0, 0 };
+		size_t m_remaining = 0;
+		bool m_inputEnd = false;
+		bool m_end = false;
+	};
+#endif
+
+	std::unique_ptr<compression::Decoder> createDecoder(Format format, Input input)
+	{
+		switch (format)
+		{
+#ifdef PBRT_HAS_ZLIB
+		case Format::Gzip:
+			return std::unique_ptr<compression::Decoder>(new GzipDecoder(std::move(input)));
+#endif
+#ifdef PBRT_HAS_ZSTD
+		case Format::Zstd:
+			return std::unique_ptr<compression::Decoder>(new ZstdDecoder(std::move(input)));
+#endif
+		default:
+			return std::unique_ptr<compression::Decoder>(new UnsupportedDecoder(std::move(input), format));
+		}
+	}
+}
+
+Format compression::detect(const char* data, size_t size)
+{
+	const unsigned char* c = reinterpret_cast<const unsigned char*>(data);
+	if (size >= 2 && c[0] == 0x1F && c[1] == 0x8B)
+		return Format::Gzip;
+	if (size >= 4 && c[0] == 0x28 && c[1] == 0xB5 && c[2] == 0x2F && c[3] == 0xFD)
+		return Format::Zstd;
+	return Format::None;
+}
+
+const char* compression::getName(Format format)
+{
+	switch (format)
+	{
+	case Format::Gzip: return "gzip";
+	case Format::Zstd: return "zstd";
+	default: return "uncompressed";
+	}
+}
+
+bool compression::isSupported(Format format)
+{
+	switch (format)
+	{
+#ifdef PBRT_HAS_ZLIB
+	case Format::Gzip: return true;
+#endif
+#ifdef PBRT_HAS_ZSTD
+	case Format::Zstd: return true;
+#endif
+	case Format::None: return true;
+	default: return false;
+	}
+}
+
+compression::Stream::Stream(Format format, FILE* file)
+	:
+m_decoder(createDecoder(format, Input(file)))
+{}
+
+compression::Stream::Stream(Format format, const char* data, size_t size)
+	:
+m_decoder(createDecoder(format, Input(data, size)))
+{}
+
+compression::Stream::~Stream() = default;
+
+size_t compression::Stream::read(char* dst, size_t size)
+{
+	return m_decoder->read(dst, size);
+}
+
+const std::string& compression::Stream::getError() const
+{
+	return m_decoder->getError();
+}
+
+std::unique_ptr<char[]> compression::decode(Format format, const char* data, size_t size, size_t padding, size_t& decodedSize, std::string& error)
+{
+	std::unique_ptr<char[]> result;
+#ifdef PBRT_HAS_ZSTD
+	// frames are independent
+	std::vector<Frame> frames;
+	size_t total = 0;
+	// implausible sizes are decoded by the stream, which only grows with the decoded data
+	if (format == Format::Zstd && getFrames(data, size, frames, total) && frames.size() > 1 && isPlausibleSize(total, size))
+	{
+		result.reset(new char[total + padding]);
+		std::vector<std::string> errors(frames.size());
+		parallel::forRange(frames.size(), 1, [&](size_t begin, size_t end)
+		{
+			// one context for the frames of the chunk
+			std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Frame& f = frames[i];
+				const size_t n = ZSTD_decompressDCtx(context.get(), result.get() + f.offset, f.decodedSize, f.data, f.size);
+				if (ZSTD_isError(n))
+					errors[i] = std::string("zstd: ") + ZSTD_getErrorName(n);
+				else if (n != f.decodedSize)
+					errors[i] = "zstd: frame size mismatch";
+			}
+		});
+		for (const auto& e : errors)
+		{
+			if (e.size())
+			{
+				error = e;
+				return nullptr;
+			}
+		}
+		memset(result.get() + total, 0, padding);
+		decodedSize = total;
+		return result;
+	}
+#endif
+
+	// chunks are decoded into the result. The buffer grows if the size hint is wrong,
+	// one spare byte detects the end without growing if it is right
+	Stream stream(format, data, size);
+	size_t hint = getSizeHint(format, data, size);
+	if (!isPlausibleSize(hint, size))
+		hint = 0;
+	size_t capacity = (hint ? hint : size * 4) + 1 + padding;
+	result.reset(new char[capacity]);
+	decodedSize = 0;
+	while (true)
+	{
+		if (capacity - decodedSize <= padding)
+		{
+			const size_t newCapacity = capacity * 2;
+			std::unique_ptr<char[]> grown(new char[newCapacity]);
+			memcpy(grown.get(), result.get(), decodedSize);
+			result = std::move(grown);
+			capacity = newCapacity;
+		}
+		const size_t n = stream.read(result.get() + decodedSize, capacity - padding - decodedSize);
+		if (n == 0)
+			break;
+		decodedSize += n;
+	}
+	if (stream.getError().size())
+	{
+		error = stream.getError();
+		return nullptr;
+	}
+	memset(result.get() + decodedSize, 0, padding);
+	return result;
+}
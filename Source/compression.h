@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// transparent reading of compressed scenes (pbrt-v4 writes .pbrt.gz and .ply.gz). The format is detected by the
+// magic bytes, the file names do not matter. gzip needs zlib (PBRT_HAS_ZLIB) and zstd needs libzstd (PBRT_HAS_ZSTD),
+// both are optional in CMakeLists.txt
+namespace compression
+{
+	enum class Format
+	{
+		None,
+		Gzip,
+		Zstd
+	};
+
+	// format of the data that starts with [data, data + size)
+	Format detect(const char* data, size_t size);
+	const char* getName(Format format);
+	// false if the converter was built without the library of the format
+	bool isSupported(Format format);
+
+	class Decoder;
+
+	// decoder of a compressed file or buffer. The data is decoded in chunks by read()
+	class Stream
+	{
+	public:
+		// reads the compressed data from the current position of file (the file is not closed)
+		Stream(Format format, FILE* file);
+		// data has to outlive the stream
+		Stream(Format format, const char* data, size_t size);
+		~Stream();
+		Stream(const Stream&) = delete;
+		Stream& operator=(const Stream&) = delete;
+
+		// decodes up to size bytes into dst. Returns the number of bytes, 0 at the end or after an error
+		size_t read(char* dst, size_t size);
+		// message of a decoding error or an empty string
+		const std::string& getError() const;
+
+	private:
+		std::unique_ptr<Decoder> m_decoder;
+	};
+
+	// decodes a whole buffer. padding zero bytes follow the decoded data. zstd files with several frames
+	// (zstd -T, pzstd) are decoded in parallel. Returns nullptr after an error
+	std::unique_ptr<char[]> decode(Format format, const char* data, size_t size, size_t padding, size_t& decodedSize, std::string& error);
+}
@@ -2,9 +2,42 @@
 #include <memory>
 #include <string>
 #include <iostream>
+#include "system.h"
+#include "prefetch.h"
+#include "compression.h"
+#include "profiler.h"
 
-inline std::unique_ptr<char[]> openFile(const std::string& filename, size_t& filesize)
+// decodes gzip and zstd compressed data (detected by the magic bytes). Returns nullptr after reporting an error
+inline std::unique_ptr<char[]> decodeFile(const std::string& filename, std::unique_ptr<char[]> data, size_t& filesize)
+{
+	const auto format = compression::detect(data.get(), filesize);
+	if (format == compression::Format::None)
+		return data;
+
+	profiler::ScopedTimer timer(profiler::Phase::Decompress, filename);
+	size_t size = 0;
+	std::string error;
+	auto decoded = compression::decode(format, data.get(), filesize, prefetch::PADDING, size, error);
+	if (!decoded)
+	{
+		System::error("cannot decode " + std::string(compression::getName(format)) + " file " + filename + ": " + error);
+		return nullptr;
+	}
+	filesize = size;
+	return decoded;
+}
+
+// bytes of the file as stored on the disk (compressed files are not decoded)
+inline std::unique_ptr<char[]> readFile(const std::string& filename, size_t& filesize)
 {
+	// the file could have been read ahead
+	if (auto reader = prefetch::Reader::getCurrent())
+	{
+		auto data = reader->take(filename, filesize);
+		if (data)
+			return data;
+	}
+
 	std::unique_ptr<char[]> file;
 
 	FILE* pFile = fopen(filename.c_str(), "rb");
@@ -15,7 +48,7 @@ inline std::unique_ptr<char[]> openFile(const std::string& filename, size_t& fil
 	filesize = ftell(pFile);
 	rewind(pFile);
 
-	static const size_t puffer = 100;
+	static const size_t puffer = prefetch::PADDING;
 	file = std::unique_ptr<char[]>(new char[filesize + puffer]);
 
 	auto count = fread(file.get(), 1, filesize, pFile);
@@ -30,6 +63,14 @@ inline std::unique_ptr<char[]> openFile(const std::string& filename, size_t& fil
 	return file;
 }
 
+inline std::unique_ptr<char[]> openFile(const std::string& filename, size_t& filesize)
+{
+	auto file = readFile(filename, filesize);
+	if (!file)
+		return file;
+	return decodeFile(filename, std::move(file), filesize);
+}
+
 inline void saveFile(const std::string& filename, const std::string& txt)
 {
 	FILE* pFile = fopen(filename.c_str(), "w");
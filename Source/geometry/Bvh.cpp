@@ -0,0 +1,342 @@
+#include "Bvh.h"
+#include "TriangleMesh.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+static const int NUM_BINS = 16;
+// cost of visiting an inner node relative to a primitive intersection
+static const float TRAVERSAL_COST = 1.0f;
+// nodes with more primitives compute their bins in parallel
+static const size_t PARALLEL_BINNING = 1 << 16;
+
+struct BinSet
+{
+	ei::Vec3 bmin[3][NUM_BINS];
+	ei::Vec3 bmax[3][NUM_BINS];
+	uint32_t count[3][NUM_BINS];
+
+	BinSet()
+	{
+		for (int a = 0; a < 3; ++a)
+			for (int b = 0; b < NUM_BINS; ++b)
+			{
+				bmin[a][b] = ei::Vec3(INFINITY);
+				bmax[a][b] = ei::Vec3(-INFINITY);
+				count[a][b] = 0;
+			}
+	}
+
+	void merge(const BinSet& o)
+	{
+		for (int a = 0; a < 3; ++a)
+			for (int b = 0; b < NUM_BINS; ++b)
+			{
+				bmin[a][b] = ei::min(bmin[a][b], o.bmin[a][b]);
+				bmax[a][b] = ei::max(bmax[a][b], o.bmax[a][b]);
+				count[a][b] += o.count[a][b];
+			}
+	}
+};
+
+// node bounds and centroid bounds of a primitive range
+struct RangeBounds
+{
+	ei::Vec3 bmin = ei::Vec3(INFINITY);
+	ei::Vec3 bmax = ei::Vec3(-INFINITY);
+	ei::Vec3 cmin = ei::Vec3(INFINITY);
+	ei::Vec3 cmax = ei::Vec3(-INFINITY);
+};
+
+static float halfArea(const ei::Vec3& bmin, const ei::Vec3& bmax)
+{
+	const ei::Vec3 e = bmax - bmin;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static int getBin(float c, float cmin, float scale)
+{
+	return std::min(NUM_BINS - 1, int((c - cmin) * scale));
+}
+
+void Bvh::build(const std::vector<ei::Box>& primBounds, size_t maxLeafSize)
+{
+	m_nodes.clear();
+	m_prims.resize(primBounds.size());
+	m_maxLeafSize = std::max(maxLeafSize, size_t(1));
+	if (primBounds.empty())
+		return;
+
+	std::vector<ei::Vec3> centroids(primBounds.size());
+	parallel::forRange(primBounds.size(), 1 << 16, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			centroids[i] = (primBounds[i].min + primBounds[i].max) * 0.5f;
+			m_prims[i] = uint32_t(i);
+		}
+	});
+
+	m_nodes.reserve(primBounds.size() * 2 / m_maxLeafSize + 1);
+	m_nodes.push_back(Node());
+	buildNode(0, 0, uint32_t(primBounds.size()), primBounds, centroids);
+}
+
+void Bvh::buildNode(uint32_t node, uint32_t begin, uint32_t end, const std::vector<ei::Box>& primBounds, const std::vector<ei::Vec3>& centroids)
+{
+	const uint32_t count = end - begin;
+
+	const RangeBounds bounds = parallel::reduce(count, PARALLEL_BINNING, RangeBounds(), [&](size_t first, size_t last)
+	{
+		RangeBounds r;
+		for (size_t i = begin + first; i < begin + last; ++i)
+		{
+			const uint32_t p = m_prims[i];
+			r.bmin = ei::min(r.bmin, primBounds[p].min);
+			r.bmax = ei::max(r.bmax, primBounds[p].max);
+			r.cmin = ei::min(r.cmin, centroids[p]);
+			r.cmax = ei::max(r.cmax, centroids[p]);
+		}
+		return r;
+	}, [](const RangeBounds& a, const RangeBounds& b)
+	{
+		RangeBounds r;
+		r.bmin = ei::min(a.bmin, b.bmin);
+		r.bmax = ei::max(a.bmax, b.bmax);
+		r.cmin = ei::min(a.cmin, b.cmin);
+		r.cmax = ei::max(a.cmax, b.cmax);
+		return r;
+	});
+
+	m_nodes[node].bmin = bounds.bmin;
+	m_nodes[node].bmax = bounds.bmax;
+	m_nodes[node].offset = begin;
+	m_nodes[node].count = count;
+	if (count <= m_maxLeafSize)
+		return;
+
+	// bin the centroids along all axes
+	float scale[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		const float extent = bounds.cmax[a] - bounds.cmin[a];
+		scale[a] = extent > 0.0f ? float(NUM_BINS) / extent : 0.0f;
+	}
+	const BinSet bins = parallel::reduce(count, PARALLEL_BINNING, BinSet(), [&](size_t first, size_t last)
+	{
+		BinSet b;
+		for (size_t i = begin + first; i < begin + last; ++i)
+		{
+			const uint32_t p = m_prims[i];
+			for (int a = 0; a < 3; ++a)
+			{
+				const int bin = getBin(centroids[p][a], bounds.cmin[a], scale[a]);
+				b.bmin[a][bin] = ei::min(b.bmin[a][bin], primBounds[p].min);
+				b.bmax[a][bin] = ei::max(b.bmax[a][bin], primBounds[p].max);
+				b.count[a][bin]++;
+			}
+		}
+		return b;
+	}, [](BinSet a, const BinSet& b) { a.merge(b); return a; });
+
+	// evaluate the SAH for all planes between the bins
+	float bestCost = INFINITY;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int a = 0; a < 3; ++a)
+	{
+		if (scale[a] == 0.0f)
+			continue;
+
+		// sweep from the right to get the cost of the right sides
+		float rightCost[NUM_BINS];
+		ei::Vec3 rmin = ei::Vec3(INFINITY), rmax = ei::Vec3(-INFINITY);
+		uint32_t rcount = 0;
+		for (int b = NUM_BINS - 1; b > 0; --b)
+		{
+			rmin = ei::min(rmin, bins.bmin[a][b]);
+			rmax = ei::max(rmax, bins.bmax[a][b]);
+			rcount += bins.count[a][b];
+			rightCost[b] = rcount ? halfArea(rmin, rmax) * float(rcount) : 0.0f;
+		}
+		ei::Vec3 lmin = ei::Vec3(INFINITY), lmax = ei::Vec3(-INFINITY);
+		uint32_t lcount = 0;
+		for (int b = 0; b < NUM_BINS - 1; ++b)
+		{
+			lmin = ei::min(lmin, bins.bmin[a][b]);
+			lmax = ei::max(lmax, bins.bmax[a][b]);
+			lcount += bins.count[a][b];
+			if (lcount == 0 || lcount == count)
+				continue;
+			const float cost = halfArea(lmin, lmax) * float(lcount) + rightCost[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = a;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t mid = begin + count / 2;
+	if (bestAxis >= 0)
+	{
+		// a leaf is cheaper than the best split (costs scaled by the node area)
+		const float area = halfArea(bounds.bmin, bounds.bmax);
+		bestCost += TRAVERSAL_COST * area;
+		if (bestCost >= area * float(count) && count <= 4 * m_maxLeafSize)
+			return;
+
+		const int axis = bestAxis;
+		const float cmin = bounds.cmin[axis];
+		const float s = scale[axis];
+		mid = uint32_t(std::partition(m_prims.begin() + begin, m_prims.begin() + end, [&](uint32_t p)
+		{
+			return getBin(centroids[p][axis], cmin, s) <= bestSplit;
+		}) - m_prims.begin());
+	}
+	// all centroids in one spot: split in the middle
+	if (mid == begin || mid == end)
+		mid = begin + count / 2;
+
+	m_nodes[node].count = 0;
+	const uint32_t left = uint32_t(m_nodes.size());
+	m_nodes.push_back(Node());
+	buildNode(left, begin, mid, primBounds, centroids);
+
+	const uint32_t right = uint32_t(m_nodes.size());
+	m_nodes.push_back(Node());
+	m_nodes[node].offset = right;
+	buildNode(right, mid, end, primBounds, centroids);
+}
+
+void SceneBvh::build(const std::vector<std::unique_ptr<Shape>>& shapes, size_t maxLeafSize)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	m_blas.clear();
+	m_instances.clear();
+
+	// one bottom level hierarchy per distinct geometry
+	std::unordered_map<const void*, int32_t> geometries;
+	std::vector<const TriangleMesh*> blasMeshes;
+	m_instances.reserve(shapes.size());
+	for (size_t i = 0; i < shapes.size(); ++i)
+	{
+		Instance inst;
+		inst.shape = uint32_t(i);
+		inst.blas = -1;
+		const auto mesh = dynamic_cast<const TriangleMesh*>(shapes[i].get());
+		if (mesh)
+		{
+			auto it = geometries.find(mesh->getGeometryId());
+			if (it == geometries.end())
+			{
+				it = geometries.emplace(mesh->getGeometryId(), int32_t(blasMeshes.size())).first;
+				blasMeshes.push_back(mesh);
+			}
+			inst.blas = it->second;
+		}
+		m_instances.push_back(inst);
+	}
+
+	m_blas.resize(blasMeshes.size());
+	parallel::forRange(blasMeshes.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t b = begin; b < end; ++b)
+		{
+			// spilled meshes are only loaded while their hierarchy is built
+			Shape::DataScope scope(*blasMeshes[b]);
+			const auto& idx = blasMeshes[b]->getIndices();
+			const auto& p = blasMeshes[b]->getPositions();
+			std::vector<ei::Box> triBounds(idx.size() / 3);
+			for (size_t t = 0; t < triBounds.size(); ++t)
+			{
+				const Vector& p0 = p[idx[t * 3]];
+				const Vector& p1 = p[idx[t * 3 + 1]];
+				const Vector& p2 = p[idx[t * 3 + 2]];
+				triBounds[t] = ei::Box(ei::min(p0, ei::min(p1, p2)), ei::max(p0, ei::max(p1, p2)));
+			}
+			m_blas[b].build(triBounds, maxLeafSize);
+		}
+	});
+
+	std::vector<ei::Box> instBounds(shapes.size());
+	parallel::forRange(shapes.size(), 256, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+			instBounds[i] = shapes[i]->getWorldBounds();
+	});
+	m_tlas.build(instBounds, 1);
+
+	m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+size_t SceneBvh::getNodeCount() const
+{
+	size_t count = m_tlas.getNodes().size();
+	for (const auto& b : m_blas)
+		count += b.getNodes().size();
+	return count;
+}
+
+size_t SceneBvh::getLeafCount() const
+{
+	auto leafs = [](const Bvh& bvh)
+	{
+		return size_t(std::count_if(bvh.getNodes().begin(), bvh.getNodes().end(), [](const Bvh::Node& n)
+		{
+			return n.count != 0;
+		}));
+	};
+	size_t count = leafs(m_tlas);
+	for (const auto& b : m_blas)
+		count += leafs(b);
+	return count;
+}
+
+static void writeBvh(FILE* file, const Bvh& bvh)
+{
+	const uint32_t nodeCount = uint32_t(bvh.getNodes().size());
+	const uint32_t primCount = uint32_t(bvh.getPrimitives().size());
+	fwrite(&nodeCount, sizeof(nodeCount), 1, file);
+	fwrite(&primCount, sizeof(primCount), 1, file);
+	fwrite(bvh.getNodes().data(), sizeof(Bvh::Node), nodeCount, file);
+	fwrite(bvh.getPrimitives().data(), sizeof(uint32_t), primCount, file);
+}
+
+void SceneBvh::save(const std::string& filename) const
+{
+	// layout:
+	// "PBVH" uint32 version
+	// float64 build time in milliseconds, uint32 node count, uint32 leaf count (of all hierarchies)
+	// uint32 blas count, per blas: uint32 node count, uint32 primitive count, nodes, primitives (triangle indices)
+	// uint32 instance count, instances
+	// top level: uint32 node count, uint32 primitive count, nodes, primitives (instance indices)
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (!file)
+	{
+		System::error("cannot save " + filename);
+		return;
+	}
+
+	const char magic[4] = { 'P', 'B', 'V', 'H' };
+	const uint32_t version = 2;
+	fwrite(magic, 1, 4, file);
+	fwrite(&version, sizeof(version), 1, file);
+	const uint32_t stats[2] = { uint32_t(getNodeCount()), uint32_t(getLeafCount()) };
+	fwrite(&m_buildTime, sizeof(m_buildTime), 1, file);
+	fwrite(stats, sizeof(uint32_t), 2, file);
+
+	const uint32_t blasCount = uint32_t(m_blas.size());
+	fwrite(&blasCount, sizeof(blasCount), 1, file);
+	for (const auto& b : m_blas)
+		writeBvh(file, b);
+
+	const uint32_t instanceCount = uint32_t(m_instances.size());
+	fwrite(&instanceCount, sizeof(instanceCount), 1, file);
+	fwrite(m_instances.data(), sizeof(Instance), instanceCount, file);
+
+	writeBvh(file, m_tlas);
+	fclose(file);
+}
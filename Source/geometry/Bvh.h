@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <ei/3dtypes.hpp>
+#include "Shape.h"
+
+// bounding volume hierarchy built with the binned surface area heuristic
+class Bvh
+{
+public:
+	// nodes are stored depth first: the first child of an inner node follows directly
+	struct Node
+	{
+		ei::Vec3 bmin;
+		uint32_t offset; // leaf: first entry in the primitive list | inner node: index of the second child
+		ei::Vec3 bmax;
+		uint32_t count; // leaf: number of primitives | inner node: 0
+	};
+
+	/**
+	 * \brief builds the hierarchy
+	 * \param primBounds bounding box of every primitive
+	 * \param maxLeafSize nodes with up to maxLeafSize primitives become leafs. Nodes with up to 4 * maxLeafSize
+	 *        primitives become leafs if the SAH rates them cheaper than the best split
+	 */
+	void build(const std::vector<ei::Box>& primBounds, size_t maxLeafSize);
+
+	const std::vector<Node>& getNodes() const
+	{
+		return m_nodes;
+	}
+	// primitive indices referenced by the leaf nodes
+	const std::vector<uint32_t>& getPrimitives() const
+	{
+		return m_prims;
+	}
+private:
+	void buildNode(uint32_t node, uint32_t begin, uint32_t end, const std::vector<ei::Box>& primBounds, const std::vector<ei::Vec3>& centroids);
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_prims;
+	size_t m_maxLeafSize = 4;
+};
+
+// two level hierarchy over the scene shapes. Triangle meshes get a bottom level hierarchy
+// in object space which is shared by all instances of the same geometry.
+// the top level is built over the world space bounds of all shapes.
+class SceneBvh
+{
+public:
+	struct Instance
+	{
+		uint32_t shape; // index into RenderOptions::shapes
+		int32_t blas; // index of the bottom level hierarchy or -1 for analytic shapes
+	};
+
+	void build(const std::vector<std::unique_ptr<Shape>>& shapes, size_t maxLeafSize);
+	// binary dump that can be loaded by exporters (see save() for the layout)
+	void save(const std::string& filename) const;
+
+	// build time in milliseconds
+	double getBuildTime() const
+	{
+		return m_buildTime;
+	}
+	// number of nodes of all hierarchies
+	size_t getNodeCount() const;
+	size_t getLeafCount() const;
+
+	const Bvh& getTopLevel() const
+	{
+		return m_tlas;
+	}
+	const std::vector<Bvh>& getBottomLevels() const
+	{
+		return m_blas;
+	}
+	const std::vector<Instance>& getInstances() const
+	{
+		return m_instances;
+	}
+private:
+	std::vector<Bvh> m_blas;
+	std::vector<Instance> m_instances;
+	Bvh m_tlas;
+	double m_buildTime = 0.0;
+};
@@ -0,0 +1,189 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <ei/vector.hpp>
+
+// export-side compact copy of the triangle mesh data:
+// - 16 bit indices if the vertex count allows it
+// - normals and tangents as octahedral snorm16 (2 values per vector)
+// - optionally positions as unorm16 relative to the bounding box of the mesh
+struct CompactGeometry
+{
+	// only one of the index buffers is filled (see hasShortIndices())
+	std::vector<uint16_t> m_indices16;
+	std::vector<uint32_t> m_indices32;
+	// full precision positions (empty if the positions are quantized)
+	std::vector<ei::Vec3> m_p;
+	// quantized positions (3 values per vertex): p = m_posOffset + m_posScale * q
+	std::vector<uint16_t> m_qp;
+	ei::Vec3 m_posOffset = ei::Vec3(0.0f);
+	ei::Vec3 m_posScale = ei::Vec3(0.0f);
+	std::vector<int16_t> m_n; // octahedral normals (2 values per vertex)
+	std::vector<int16_t> m_s; // octahedral tangents (2 values per vertex)
+	std::vector<ei::Vec2> m_uv;
+
+	CompactGeometry() = default;
+	CompactGeometry(const std::vector<int>& indices, const std::vector<ei::Vec3>& p, const std::vector<ei::Vec3>& n,
+		const std::vector<ei::Vec3>& s, const std::vector<ei::Vec2>& uv, bool quantizePositions)
+		:
+		m_uv(uv)
+	{
+		if (canUseShortIndices(p.size()))
+			m_indices16.assign(indices.begin(), indices.end());
+		else
+			m_indices32.assign(indices.begin(), indices.end());
+
+		if (quantizePositions)
+			quantize(p);
+		else
+			m_p = p;
+
+		m_n.resize(n.size() * 2);
+		for (size_t i = 0; i < n.size(); ++i)
+			encodeOctahedral(n[i], &m_n[i * 2]);
+
+		m_s.resize(s.size() * 2);
+		for (size_t i = 0; i < s.size(); ++i)
+			encodeOctahedral(s[i], &m_s[i * 2]);
+	}
+
+	bool hasShortIndices() const
+	{
+		return m_indices32.empty();
+	}
+	bool hasQuantizedPositions() const
+	{
+		return !m_qp.empty();
+	}
+	size_t getIndexCount() const
+	{
+		return hasShortIndices() ? m_indices16.size() : m_indices32.size();
+	}
+	size_t getVertexCount() const
+	{
+		return hasQuantizedPositions() ? m_qp.size() / 3 : m_p.size();
+	}
+	ei::Vec3 getPosition(size_t i) const
+	{
+		if (!hasQuantizedPositions())
+			return m_p[i];
+		return ei::Vec3(
+			m_posOffset.x + m_posScale.x * float(m_qp[i * 3]),
+			m_posOffset.y + m_posScale.y * float(m_qp[i * 3 + 1]),
+			m_posOffset.z + m_posScale.z * float(m_qp[i * 3 + 2]));
+	}
+	ei::Vec3 getNormal(size_t i) const
+	{
+		return decodeOctahedral(&m_n[i * 2]);
+	}
+	ei::Vec3 getTangent(size_t i) const
+	{
+		return decodeOctahedral(&m_s[i * 2]);
+	}
+
+	// size of the buffers in bytes
+	size_t byteSize() const
+	{
+		return m_indices16.size() * sizeof(uint16_t) + m_indices32.size() * sizeof(uint32_t)
+			+ m_p.size() * sizeof(ei::Vec3) + m_qp.size() * sizeof(uint16_t)
+			+ m_n.size() * sizeof(int16_t) + m_s.size() * sizeof(int16_t)
+			+ m_uv.size() * sizeof(ei::Vec2);
+	}
+
+	// size in bytes a compacted mesh would have without building it
+	static size_t estimateSize(size_t indexCount, size_t vertexCount, bool normals, bool tangents, bool uvs, bool quantizePositions)
+	{
+		size_t vertexSize = quantizePositions ? 3 * sizeof(uint16_t) : sizeof(ei::Vec3);
+		if (normals) vertexSize += 2 * sizeof(int16_t);
+		if (tangents) vertexSize += 2 * sizeof(int16_t);
+		if (uvs) vertexSize += sizeof(ei::Vec2);
+		const size_t indexSize = canUseShortIndices(vertexCount) ? sizeof(uint16_t) : sizeof(uint32_t);
+		return indexCount * indexSize + vertexCount * vertexSize;
+	}
+
+	static bool canUseShortIndices(size_t vertexCount)
+	{
+		return vertexCount <= size_t(UINT16_MAX) + 1;
+	}
+
+	static void encodeOctahedral(const ei::Vec3& v, int16_t* dst)
+	{
+		const float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+		if (l1 == 0.0f)
+		{
+			dst[0] = dst[1] = 0;
+			return;
+		}
+		float x = v.x / l1;
+		float y = v.y / l1;
+		if (v.z < 0.0f)
+		{
+			// fold the lower hemisphere over the diagonals
+			const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = fx;
+			y = fy;
+		}
+		dst[0] = toSnorm16(x);
+		dst[1] = toSnorm16(y);
+	}
+
+	static ei::Vec3 decodeOctahedral(const int16_t* src)
+	{
+		float x = std::max(float(src[0]) / 32767.0f, -1.0f);
+		float y = std::max(float(src[1]) / 32767.0f, -1.0f);
+		const float z = 1.0f - std::abs(x) - std::abs(y);
+		if (z < 0.0f)
+		{
+			const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = fx;
+			y = fy;
+		}
+		const float len = std::sqrt(x * x + y * y + z * z);
+		return ei::Vec3(x / len, y / len, z / len);
+	}
+private:
+	static int16_t toSnorm16(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f);
+		return int16_t(std::lround(v * 32767.0f));
+	}
+
+	void quantize(const std::vector<ei::Vec3>& p)
+	{
+		if (p.empty())
+			return;
+
+		ei::Vec3 pmin = p[0];
+		ei::Vec3 pmax = p[0];
+		for (const auto& v : p)
+		{
+			pmin = ei::Vec3(std::min(pmin.x, v.x), std::min(pmin.y, v.y), std::min(pmin.z, v.z));
+			pmax = ei::Vec3(std::max(pmax.x, v.x), std::max(pmax.y, v.y), std::max(pmax.z, v.z));
+		}
+		m_posOffset = pmin;
+		m_posScale = (pmax - pmin) / float(UINT16_MAX);
+
+		// flat dimensions get a scale of 0 and will always be decoded to the offset
+		const float inv[3] = {
+			m_posScale.x > 0.0f ? 1.0f / m_posScale.x : 0.0f,
+			m_posScale.y > 0.0f ? 1.0f / m_posScale.y : 0.0f,
+			m_posScale.z > 0.0f ? 1.0f / m_posScale.z : 0.0f
+		};
+		m_qp.resize(p.size() * 3);
+		for (size_t i = 0; i < p.size(); ++i)
+		{
+			m_qp[i * 3] = toUnorm16((p[i].x - pmin.x) * inv[0]);
+			m_qp[i * 3 + 1] = toUnorm16((p[i].y - pmin.y) * inv[1]);
+			m_qp[i * 3 + 2] = toUnorm16((p[i].z - pmin.z) * inv[2]);
+		}
+	}
+
+	static uint16_t toUnorm16(float v)
+	{
+		return uint16_t(std::lround(std::min(std::max(v, 0.0f), float(UINT16_MAX))));
+	}
+};
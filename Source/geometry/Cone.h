@@ -0,0 +1,62 @@
+#pragma once
+#include "Quadric.h"
+
+class Cone : public Quadric
+{
+public:
+	virtual ~Cone() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Cone(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_radius = set.getFloat("radius", 1.0f);
+		m_height = set.getFloat("height", 1.0f);
+		m_phimax = set.getFloat("phimax", 360.0f);
+		m_transform = ei::identity4x4();
+	}
+
+protected:
+	ei::Box computeLocalBounds() const override
+	{
+		return ei::Box(Vector(-m_radius, -m_radius, 0.0f), Vector(m_radius, m_radius, m_height));
+	}
+
+	float computeSurfaceArea() const override
+	{
+		return m_radius * std::sqrt(m_height * m_height + m_radius * m_radius) * getPhiMax() * 0.5f * getAreaScale();
+	}
+
+	void getResolution(float tolerance, int& nu, int& nv) const override
+	{
+		nu = tessellation::getArcSegments(m_radius * getWorldScale(), getPhiMax(), tolerance, 3);
+		// straight from the base to the apex
+		nv = 1;
+	}
+
+	// v goes from the base (z = 0) to the apex (z = height)
+	void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2&) const override
+	{
+		const float phi = u * getPhiMax();
+		const float cosP = std::cos(phi);
+		const float sinP = std::sin(phi);
+		const float r = m_radius * (1.0f - v);
+		p = Vector(r * cosP, r * sinP, v * m_height);
+		n = ei::normalize(Vector(cosP * m_height, sinP * m_height, m_radius));
+		s = Vector(-sinP, cosP, 0.0f);
+	}
+
+	std::string getKey(int nu, int nv) const override
+	{
+		return tessellation::makeKey("cone", { m_radius, m_height, getPhiMax(), float(nu), float(nv) });
+	}
+
+private:
+	float m_radius = 1.0f;
+	float m_height = 1.0f;
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "Quadric.h"
+
+class Cylinder : public Quadric
+{
+public:
+	virtual ~Cylinder() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Cylinder(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_radius = set.getFloat("radius", 1.0f);
+		const float zmin = set.getFloat("zmin", -1.0f);
+		const float zmax = set.getFloat("zmax", 1.0f);
+		m_zmin = std::min(zmin, zmax);
+		m_zmax = std::max(zmin, zmax);
+		m_phimax = set.getFloat("phimax", 360.0f);
+		m_transform = ei::identity4x4();
+	}
+
+protected:
+	ei::Box computeLocalBounds() const override
+	{
+		return ei::Box(Vector(-m_radius, -m_radius, m_zmin), Vector(m_radius, m_radius, m_zmax));
+	}
+
+	float computeSurfaceArea() const override
+	{
+		return (m_zmax - m_zmin) * m_radius * getPhiMax() * getAreaScale();
+	}
+
+	void getResolution(float tolerance, int& nu, int& nv) const override
+	{
+		nu = tessellation::getArcSegments(m_radius * getWorldScale(), getPhiMax(), tolerance, 3);
+		// straight along z
+		nv = 1;
+	}
+
+	void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2&) const override
+	{
+		const float phi = u * getPhiMax();
+		n = Vector(std::cos(phi), std::sin(phi), 0.0f);
+		p = Vector(n.x * m_radius, n.y * m_radius, m_zmin + v * (m_zmax - m_zmin));
+		s = Vector(-n.y, n.x, 0.0f);
+	}
+
+	std::string getKey(int nu, int nv) const override
+	{
+		return tessellation::makeKey("cylinder", { m_radius, m_zmin, m_zmax, getPhiMax(), float(nu), float(nv) });
+	}
+
+private:
+	float m_radius = 1.0f;
+	float m_zmin = -1.0f;
+	float m_zmax = 1.0f;
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "Quadric.h"
+
+class Disk : public Quadric
+{
+public:
+	virtual ~Disk() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Disk(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_height = set.getFloat("height", 0.0f);
+		m_radius = set.getFloat("radius", 1.0f);
+		m_innerRadius = std::min(set.getFloat("innerradius", 0.0f), m_radius);
+		m_phimax = set.getFloat("phimax", 360.0f);
+		m_transform = ei::identity4x4();
+	}
+
+protected:
+	ei::Box computeLocalBounds() const override
+	{
+		return ei::Box(Vector(-m_radius, -m_radius, m_height), Vector(m_radius, m_radius, m_height));
+	}
+
+	float computeSurfaceArea() const override
+	{
+		return getPhiMax() * 0.5f * (m_radius * m_radius - m_innerRadius * m_innerRadius) * getAreaScale();
+	}
+
+	void getResolution(float tolerance, int& nu, int& nv) const override
+	{
+		nu = tessellation::getArcSegments(m_radius * getWorldScale(), getPhiMax(), tolerance, 3);
+		// flat
+		nv = 1;
+	}
+
+	// v goes from the outer to the inner radius (normal points to +z like in pbrt)
+	void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2&) const override
+	{
+		const float phi = u * getPhiMax();
+		const float r = m_radius - v * (m_radius - m_innerRadius);
+		p = Vector(r * std::cos(phi), r * std::sin(phi), m_height);
+		n = Vector(0.0f, 0.0f, 1.0f);
+		s = Vector(-std::sin(phi), std::cos(phi), 0.0f);
+	}
+
+	std::string getKey(int nu, int nv) const override
+	{
+		return tessellation::makeKey("disk", { m_height, m_radius, m_innerRadius, getPhiMax(), float(nu), float(nv) });
+	}
+
+private:
+	float m_height = 0.0f;
+	float m_radius = 1.0f;
+	float m_innerRadius = 0.0f;
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include "TriangleMesh.h"
+
+// regular grid of nu x nv heights over [0, 1]^2 (pbrt heightfield).
+// planar blocks can be merged with --decimate [tolerance]: the block boundary vertices are kept
+// and the interior is replaced by a fan around the block center, so the mesh stays watertight.
+class Heightfield : public TriangleMesh
+{
+	// quads per block side for the decimation
+	static const int BLOCK_SIZE = 16;
+public:
+	virtual ~Heightfield() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Heightfield(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_nu = set.getInt("nu", -1);
+		m_nv = set.getInt("nv", -1);
+		std::vector<float> z;
+		if (m_nu < 2 || m_nv < 2)
+			throw PbrtMissingParameter("integer nu and nv");
+		if (!set.takeFloats("Pz", z))
+			throw PbrtMissingParameter("float Pz");
+		if (z.size() != size_t(m_nu) * size_t(m_nv))
+			throw std::exception("heightfield Pz does not match nu * nv");
+
+		const bool decimate = System::args.has("decimate");
+		makeGrid(z, decimate ? std::max(System::args.get("decimate", 0.0f), 0.0f) : -1.0f);
+
+		verifyData(false, true);
+	}
+
+	// vertices per row and column of the original grid
+	int getNu() const
+	{
+		return m_nu;
+	}
+	int getNv() const
+	{
+		return m_nv;
+	}
+
+private:
+	struct Block
+	{
+		int x0, y0, w, h; // quads covered by the block
+		int cx() const { return x0 + w / 2; }
+		int cy() const { return y0 + h / 2; }
+	};
+
+	Block getBlock(int bx, int by) const
+	{
+		Block b;
+		b.x0 = bx * BLOCK_SIZE;
+		b.y0 = by * BLOCK_SIZE;
+		b.w = std::min(BLOCK_SIZE, m_nu - 1 - b.x0);
+		b.h = std::min(BLOCK_SIZE, m_nv - 1 - b.y0);
+		return b;
+	}
+
+	// all heights of the block lie on the plane through three corners
+	bool isPlanar(const std::vector<float>& z, const Block& b, float tolerance) const
+	{
+		// needs an interior vertex for the fan
+		if (b.w < 2 || b.h < 2)
+			return false;
+		const float z00 = z[size_t(b.y0) * m_nu + b.x0];
+		const float dx = (z[size_t(b.y0) * m_nu + b.x0 + b.w] - z00) / float(b.w);
+		const float dy = (z[size_t(b.y0 + b.h) * m_nu + b.x0] - z00) / float(b.h);
+		for (int y = 0; y <= b.h; ++y)
+		{
+			const float* row = z.data() + size_t(b.y0 + y) * m_nu + b.x0;
+			for (int x = 0; x <= b.w; ++x)
+				if (std::abs(row[x] - (z00 + dx * float(x) + dy * float(y))) > tolerance)
+					return false;
+		}
+		return true;
+	}
+
+	/**
+	 * \brief generates positions, uvs and indices
+	 * \param tolerance maximal height deviation for planar blocks (< 0: no decimation)
+	 */
+	void makeGrid(const std::vector<float>& z, float tolerance)
+	{
+		const int numBx = (m_nu - 1 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		const int numBy = (m_nv - 1 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		const size_t numVertices = size_t(m_nu) * size_t(m_nv);
+
+		// classify blocks
+		std::vector<char> planar(size_t(numBx) * numBy, 0);
+		if (tolerance >= 0.0f)
+		{
+			parallel::forRange(size_t(numBy), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t by = begin; by < end; ++by)
+					for (int bx = 0; bx < numBx; ++bx)
+						planar[by * numBx + bx] = isPlanar(z, getBlock(bx, int(by)), tolerance);
+			});
+		}
+
+		// vertices in the interior of planar blocks (except the center) are dropped => new vertex index for every grid vertex
+		std::vector<int> remap(numVertices, 0);
+		parallel::forRange(size_t(numBy), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t by = begin; by < end; ++by)
+				for (int bx = 0; bx < numBx; ++bx)
+				{
+					if (!planar[by * numBx + bx])
+						continue;
+					const Block b = getBlock(bx, int(by));
+					for (int y = b.y0 + 1; y < b.y0 + b.h; ++y)
+						for (int x = b.x0 + 1; x < b.x0 + b.w; ++x)
+							if (x != b.cx() || y != b.cy())
+								remap[size_t(y) * m_nu + x] = -1;
+				}
+		});
+		int count = 0;
+		for (auto& r : remap)
+			r = (r < 0) ? -1 : count++;
+
+		// vertices
+		auto& g = *m_geom;
+		g.m_p.resize(count);
+		g.m_uv.resize(count);
+		const float invU = 1.0f / float(m_nu - 1);
+		const float invV = 1.0f / float(m_nv - 1);
+		parallel::forRange(size_t(m_nv), 64, [&](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; ++y)
+				for (size_t x = 0; x < size_t(m_nu); ++x)
+				{
+					const int dst = remap[y * m_nu + x];
+					if (dst < 0)
+						continue;
+					g.m_uv[dst] = ei::Vec2(float(x) * invU, float(y) * invV);
+					g.m_p[dst] = Vector(g.m_uv[dst].x, g.m_uv[dst].y, z[y * m_nu + x]);
+				}
+		});
+
+		// triangle offset of every block row
+		std::vector<size_t> offsets(numBy + 1, 0);
+		for (int by = 0; by < numBy; ++by)
+		{
+			size_t tris = 0;
+			for (int bx = 0; bx < numBx; ++bx)
+			{
+				const Block b = getBlock(bx, by);
+				tris += planar[size_t(by) * numBx + bx] ? size_t(b.w + b.h) * 2 : size_t(b.w) * b.h * 2;
+			}
+			offsets[by + 1] = offsets[by] + tris;
+		}
+
+		// indices (counter clockwise seen from +z like in pbrt)
+		g.m_indices.resize(offsets[numBy] * 3);
+		parallel::forRange(size_t(numBy), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t by = begin; by < end; ++by)
+			{
+				int* dst = g.m_indices.data() + offsets[by] * 3;
+				auto vertex = [&](int x, int y) { return remap[size_t(y) * m_nu + x]; };
+				for (int bx = 0; bx < numBx; ++bx)
+				{
+					const Block b = getBlock(bx, int(by));
+					const int x1 = b.x0 + b.w;
+					const int y1 = b.y0 + b.h;
+					if (planar[by * numBx + bx])
+					{
+						// fan from the center over all boundary edges
+						const int c = vertex(b.cx(), b.cy());
+						auto fan = [&](int xa, int ya, int xb, int yb)
+						{
+							*dst++ = c;
+							*dst++ = vertex(xa, ya);
+							*dst++ = vertex(xb, yb);
+						};
+						for (int x = b.x0; x < x1; ++x)
+							fan(x, b.y0, x + 1, b.y0);
+						for (int y = b.y0; y < y1; ++y)
+							fan(x1, y, x1, y + 1);
+						for (int x = x1; x > b.x0; --x)
+							fan(x, y1, x - 1, y1);
+						for (int y = y1; y > b.y0; --y)
+							fan(b.x0, y, b.x0, y - 1);
+						continue;
+					}
+					for (int y = b.y0; y < y1; ++y)
+						for (int x = b.x0; x < x1; ++x)
+						{
+							*dst++ = vertex(x, y);
+							*dst++ = vertex(x + 1, y);
+							*dst++ = vertex(x + 1, y + 1);
+							*dst++ = vertex(x, y);
+							*dst++ = vertex(x + 1, y + 1);
+							*dst++ = vertex(x, y + 1);
+						}
+				}
+			}
+		});
+	}
+
+	int m_nu = 0;
+	int m_nv = 0;
+};
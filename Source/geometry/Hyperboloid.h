@@ -0,0 +1,94 @@
+#pragma once
+#include "Quadric.h"
+
+// surface of revolution of the line p1 p2 around the z axis
+class Hyperboloid : public Quadric
+{
+public:
+	virtual ~Hyperboloid() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Hyperboloid(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_p1 = set.getPoint("p1", Vector(0.0f, 0.0f, 0.0f));
+		m_p2 = set.getPoint("p2", Vector(1.0f, 1.0f, 1.0f));
+		m_phimax = set.getFloat("phimax", 360.0f);
+		m_transform = ei::identity4x4();
+	}
+
+protected:
+	ei::Box computeLocalBounds() const override
+	{
+		// the squared distance to the axis is convex along the line => maximum at an end point
+		const float rmax = getMaxRadius();
+		return ei::Box(Vector(-rmax, -rmax, std::min(m_p1.z, m_p2.z)), Vector(rmax, rmax, std::max(m_p1.z, m_p2.z)));
+	}
+
+	float computeSurfaceArea() const override
+	{
+		// area of a surface of revolution: phimax * integral r(v) * |(r'(v), z'(v))| dv (simpson rule)
+		const int steps = 64;
+		const Vector d = m_p2 - m_p1;
+		auto integrand = [&](float v)
+		{
+			const Vector pr = m_p1 + d * v;
+			const float r = std::sqrt(pr.x * pr.x + pr.y * pr.y);
+			const float dr = r > 0.0f ? (pr.x * d.x + pr.y * d.y) / r : std::sqrt(d.x * d.x + d.y * d.y);
+			return r * std::sqrt(dr * dr + d.z * d.z);
+		};
+		float sum = integrand(0.0f) + integrand(1.0f);
+		for (int i = 1; i < steps; ++i)
+			sum += integrand(float(i) / float(steps)) * ((i & 1) ? 4.0f : 2.0f);
+		return getPhiMax() * sum / (3.0f * float(steps)) * getAreaScale();
+	}
+
+	void getResolution(float tolerance, int& nu, int& nv) const override
+	{
+		const float rmax = getMaxRadius();
+		nu = tessellation::getArcSegments(rmax * getWorldScale(), getPhiMax(), tolerance, 3);
+		// the lines are straight but the quads between them are twisted: keep them roughly square
+		const float segment = rmax * getPhiMax() / float(nu);
+		const float length = ei::len(m_p2 - m_p1);
+		nv = segment > 0.0f ? int(std::ceil(length / segment)) : 1;
+		nv = std::min(std::max(nv, 1), tessellation::MAX_SEGMENTS);
+	}
+
+	void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2&) const override
+	{
+		const float phi = u * getPhiMax();
+		const float cosP = std::cos(phi);
+		const float sinP = std::sin(phi);
+		auto rotate = [&](const Vector& a) { return Vector(a.x * cosP - a.y * sinP, a.x * sinP + a.y * cosP, a.z); };
+
+		p = rotate(m_p1 + (m_p2 - m_p1) * v);
+		Vector t = Vector(-p.y, p.x, 0.0f);
+		if (ei::lensq(t) <= 1e-12f * ei::lensq(p))
+		{
+			// on the axis: use the direction of rotation of the other end point
+			const Vector& q = ei::lensq(Vector(m_p1.x, m_p1.y, 0.0f)) > ei::lensq(Vector(m_p2.x, m_p2.y, 0.0f)) ? m_p1 : m_p2;
+			t = rotate(Vector(-q.y, q.x, 0.0f));
+		}
+		s = ei::normalize(t);
+		n = ei::normalize(ei::cross(s, rotate(m_p2 - m_p1)));
+	}
+
+	std::string getKey(int nu, int nv) const override
+	{
+		return tessellation::makeKey("hyperboloid", { m_p1.x, m_p1.y, m_p1.z, m_p2.x, m_p2.y, m_p2.z, getPhiMax(), float(nu), float(nv) });
+	}
+
+private:
+	float getMaxRadius() const
+	{
+		return std::sqrt(std::max(m_p1.x * m_p1.x + m_p1.y * m_p1.y, m_p2.x * m_p2.x + m_p2.y * m_p2.y));
+	}
+
+	Vector m_p1 = Vector(0.0f, 0.0f, 0.0f);
+	Vector m_p2 = Vector(1.0f, 1.0f, 1.0f);
+};
@@ -0,0 +1,339 @@
+#pragma once
+#include "Shape.h"
+#include "Tessellation.h"
+
+// (rational) b-spline patch like in pbrt. The control net is kept and the patch
+// is turned into a triangle mesh by tessellate()
+class Nurbs : public Shape
+{
+	// minimal samples per direction (same as pbrt)
+	static const int DICE = 30;
+public:
+	virtual ~Nurbs() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Nurbs(*this);
+	}
+
+	// checks the sizes and knots without converting the control points (also used by --noconvert)
+	static void checkParams(const ParamSet& set)
+	{
+		const int nu = set.getInt("nu", -1), nv = set.getInt("nv", -1);
+		const int uorder = set.getInt("uorder", -1), vorder = set.getInt("vorder", -1);
+		if (nu < 1 || nv < 1 || uorder < 1 || vorder < 1)
+			throw PbrtMissingParameter("integer nu, nv, uorder and vorder");
+		if (uorder > nu || vorder > nv)
+			throw std::exception("nurbs order is bigger than the number of control points");
+
+		std::vector<float> uknots, vknots;
+		if (!set.getFloats("uknots", uknots))
+			throw PbrtMissingParameter("float uknots");
+		if (!set.getFloats("vknots", vknots))
+			throw PbrtMissingParameter("float vknots");
+		if (uknots.size() != size_t(nu + uorder) || vknots.size() != size_t(nv + vorder))
+			throw std::exception("nurbs knot vector size has to be number of control points + order");
+		if (!std::is_sorted(uknots.begin(), uknots.end()) || !std::is_sorted(vknots.begin(), vknots.end()))
+			throw std::exception("nurbs knots have to be non-decreasing");
+
+		const size_t count = size_t(nu) * size_t(nv);
+		if (set.getFloatCount("Pw"))
+		{
+			if (set.getFloatCount("Pw") != count * 4)
+				throw std::exception("nurbs Pw does not match nu * nv");
+		}
+		else if (set.getPointCount("P"))
+		{
+			if (set.getPointCount("P") != count)
+				throw std::exception("nurbs P does not match nu * nv");
+		}
+		else throw PbrtMissingParameter("point P or float Pw");
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		checkParams(set);
+		m_nu = set.getInt("nu", -1);
+		m_nv = set.getInt("nv", -1);
+		m_uorder = set.getInt("uorder", -1);
+		m_vorder = set.getInt("vorder", -1);
+		set.takeFloats("uknots", m_uknots);
+		set.takeFloats("vknots", m_vknots);
+
+		m_u0 = set.getFloat("u0", m_uknots[m_uorder - 1]);
+		m_u1 = set.getFloat("u1", m_uknots[m_nu]);
+		m_v0 = set.getFloat("v0", m_vknots[m_vorder - 1]);
+		m_v1 = set.getFloat("v1", m_vknots[m_nv]);
+
+		// homogeneous control points
+		const size_t count = size_t(m_nu) * size_t(m_nv);
+		std::vector<float> pw;
+		std::vector<Vector> p;
+		if (set.takeFloats("Pw", pw))
+		{
+			m_cp.resize(count);
+			for (size_t i = 0; i < count; ++i)
+				m_cp[i] = Vec4(pw[i * 4], pw[i * 4 + 1], pw[i * 4 + 2], pw[i * 4 + 3]);
+		}
+		else if (set.takePoints("P", p))
+		{
+			m_cp.resize(count);
+			for (size_t i = 0; i < count; ++i)
+				m_cp[i] = Vec4(p[i].x, p[i].y, p[i].z, 1.0f);
+		}
+
+		m_transform = ei::identity4x4();
+	}
+
+	virtual void applyTransform(const Matrix& mat) override
+	{
+		m_transform *= mat;
+		invalidateStatistics();
+	}
+
+	void applyTransformFront(const Matrix& mat) override
+	{
+		m_transform = mat * m_transform;
+		invalidateStatistics();
+	}
+
+	void flipNormals() override
+	{
+		m_flipNormal = true;
+	}
+
+	size_t getPrimitiveCount() const override
+	{
+		return 1;
+	}
+
+	// size of the tessellated patch
+	virtual size_t estimateSize(size_t vertexSize) const override
+	{
+		int du, dv;
+		getDice(tessellation::getTolerance(), du, dv);
+		return size_t(du) * size_t(dv) * vertexSize + size_t(du - 1) * size_t(dv - 1) * 6 * sizeof(uint32);
+	}
+
+	// control points (x * w, y * w, z * w, w) with u running fastest
+	const std::vector<Vec4>& getControlPoints() const
+	{
+		return m_cp;
+	}
+	const std::vector<float>& getUKnots() const
+	{
+		return m_uknots;
+	}
+	const std::vector<float>& getVKnots() const
+	{
+		return m_vknots;
+	}
+
+protected:
+	// convex hull of the control points (weights are assumed to be positive)
+	ei::Box computeLocalBounds() const override
+	{
+		Vector bmin = Vector(INFINITY);
+		Vector bmax = Vector(-INFINITY);
+		for (const auto& c : m_cp)
+		{
+			const Vector p = Vector(c.x, c.y, c.z) / c.w;
+			bmin = ei::min(bmin, p);
+			bmax = ei::max(bmax, p);
+		}
+		return ei::Box(bmin, bmax);
+	}
+
+	ei::Box computeWorldBounds() const override
+	{
+		return transformBox(getLocalBounds(), m_transform);
+	}
+
+	// area of the tessellated patch
+	float computeSurfaceArea() const override
+	{
+		std::unique_ptr<Shape> mesh(makeMesh(tessellation::DEFAULT_TOLERANCE));
+		return mesh->getSurfaceArea();
+	}
+
+	// the patch is diced into at least DICE x DICE samples like in pbrt (see getDice)
+	Shape* makeMesh(float tolerance) const override
+	{
+		int du, dv;
+		getDice(tolerance, du, dv);
+		// basis functions and their derivatives for every sample column and row
+		Basis bu, bv;
+		computeBasis(bu, m_uknots, m_uorder, m_nu, m_u0, m_u1, du);
+		computeBasis(bv, m_vknots, m_vorder, m_nv, m_v0, m_v1, dv);
+
+		auto geom = std::make_shared<tessellation::CoreGeometry>();
+		const float flip = m_flipNormal ? -1.0f : 1.0f;
+		tessellation::makeGrid(*geom, du - 1, dv - 1, [&](float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2& uv)
+		{
+			// makeGrid samples u = i / (du - 1)
+			const int i = int(std::lround(u * float(du - 1)));
+			const int j = int(std::lround(v * float(dv - 1)));
+			const float* nu = &bu.n[i * m_uorder];
+			const float* dnu = &bu.dn[i * m_uorder];
+			const float* nv = &bv.n[j * m_vorder];
+			const float* dnv = &bv.dn[j * m_vorder];
+			const int firstU = bu.span[i] - m_uorder + 1;
+			const int firstV = bv.span[j] - m_vorder + 1;
+
+			Vec4 sp = Vec4(0.0f), su = Vec4(0.0f), sv = Vec4(0.0f);
+			for (int a = 0; a < m_vorder; ++a)
+			{
+				const Vec4* row = &m_cp[size_t(firstV + a) * m_nu + firstU];
+				Vec4 t = Vec4(0.0f), tu = Vec4(0.0f);
+				for (int b = 0; b < m_uorder; ++b)
+				{
+					t += row[b] * nu[b];
+					tu += row[b] * dnu[b];
+				}
+				sp += t * nv[a];
+				su += tu * nv[a];
+				sv += t * dnv[a];
+			}
+
+			// quotient rule for the rational surface
+			const float invW = 1.0f / sp.w;
+			p = Vector(sp.x, sp.y, sp.z) * invW;
+			const Vector dpdu = (Vector(su.x, su.y, su.z) - p * su.w) * invW;
+			const Vector dpdv = (Vector(sv.x, sv.y, sv.z) - p * sv.w) * invW;
+			const Vector c = ei::cross(dpdu, dpdv);
+			n = ei::lensq(c) > 0.0f ? ei::normalize(c) * flip : Vector(0.0f);
+			s = ei::lensq(dpdu) > 0.0f ? ei::normalize(dpdu) : Vector(0.0f);
+			uv = ei::Vec2(bu.t[i], bv.t[j]);
+		});
+		return new TriangleMesh(geom, m_transform);
+	}
+
+private:
+	struct Basis
+	{
+		std::vector<float> t; // parameter of the sample
+		std::vector<int> span; // knot span of the sample
+		std::vector<float> n; // order values per sample
+		std::vector<float> dn; // order derivatives per sample
+	};
+
+	static int findSpan(const std::vector<float>& knots, int order, int numCp, float t)
+	{
+		// last span for the end of the parameter range
+		if (t >= knots[numCp])
+			return numCp - 1;
+		const auto it = std::upper_bound(knots.begin() + order - 1, knots.begin() + numCp, t);
+		return std::max(int(it - knots.begin()) - 1, order - 1);
+	}
+
+	/**
+	 * \brief samples per direction for the world space tolerance. A degree d bezier curve deviates at most
+	 *        d (d - 1) / 8 * max |second difference of the control points| / n^2 from its chords for n segments.
+	 *        The bound is applied to every knot span with the second differences of the whole control net
+	 */
+	void getDice(float tolerance, int& du, int& dv) const
+	{
+		std::vector<Vector> p(m_cp.size());
+		for (size_t i = 0; i < m_cp.size(); ++i)
+			p[i] = m_cp[i].w != 0.0f ? Vector(m_cp[i].x, m_cp[i].y, m_cp[i].z) / m_cp[i].w : Vector(0.0f);
+
+		// largest second difference along u and v
+		float mu = 0.0f, mv = 0.0f;
+		for (int j = 0; j < m_nv; ++j)
+			for (int i = 0; i < m_nu; ++i)
+			{
+				const Vector& c = p[size_t(j) * m_nu + i];
+				if (i > 0 && i + 1 < m_nu)
+					mu = std::max(mu, ei::len(p[size_t(j) * m_nu + i - 1] - 2.0f * c + p[size_t(j) * m_nu + i + 1]));
+				if (j > 0 && j + 1 < m_nv)
+					mv = std::max(mv, ei::len(p[size_t(j - 1) * m_nu + i] - 2.0f * c + p[size_t(j + 1) * m_nu + i]));
+			}
+		const float scale = tessellation::getMaxScale(m_transform);
+		du = getSamples(m_uknots, m_uorder, m_nu, m_u0, m_u1, mu * scale, tolerance);
+		dv = getSamples(m_vknots, m_vorder, m_nv, m_v0, m_v1, mv * scale, tolerance);
+	}
+
+	static int getSamples(const std::vector<float>& knots, int order, int numCp, float t0, float t1, float secondDiff, float tolerance)
+	{
+		const int degree = order - 1;
+		const float range = knots[numCp] - knots[order - 1];
+		if (degree < 2 || secondDiff <= 0.0f || range <= 0.0f || tolerance <= 0.0f)
+			return DICE;
+		// segments per span, scaled to the part of the parameter range that is used
+		const float perSpan = std::sqrt(float(degree * (degree - 1)) * secondDiff / (8.0f * tolerance));
+		const float spans = float(numCp - order + 1) * std::abs(t1 - t0) / range;
+		const float segments = std::ceil(perSpan * spans);
+		return int(std::min(std::max(segments, float(DICE - 1)), float(tessellation::MAX_SEGMENTS))) + 1;
+	}
+
+	static void computeBasis(Basis& b, const std::vector<float>& knots, int order, int numCp, float t0, float t1, int samples)
+	{
+		const int p = order - 1;
+		b.t.resize(samples);
+		b.span.resize(samples);
+		b.n.resize(size_t(samples) * order);
+		b.dn.resize(size_t(samples) * order);
+		std::vector<float> left(order), right(order), low(order + 1);
+		for (int s = 0; s < samples; ++s)
+		{
+			const float t = t0 + (t1 - t0) * float(s) / float(samples - 1);
+			const int span = findSpan(knots, order, numCp, t);
+			b.t[s] = t;
+			b.span[s] = span;
+
+			// cox de boor (non zero functions N[span - p .. span])
+			float* n = &b.n[s * order];
+			n[0] = 1.0f;
+			low[0] = 1.0f;
+			for (int j = 1; j <= p; ++j)
+			{
+				left[j] = t - knots[span + 1 - j];
+				right[j] = knots[span + j] - t;
+				float saved = 0.0f;
+				for (int r = 0; r < j; ++r)
+				{
+					const float denom = right[r + 1] + left[j - r];
+					const float tmp = denom != 0.0f ? n[r] / denom : 0.0f;
+					n[r] = saved + right[r + 1] * tmp;
+					saved = left[j - r] * tmp;
+				}
+				n[j] = saved;
+				// keep the functions of degree p - 1 for the derivatives
+				if (j == p - 1)
+					std::copy(n, n + j + 1, low.begin());
+			}
+
+			// N'(i, p) = p / (k[i + p] - k[i]) * N(i, p - 1) - p / (k[i + p + 1] - k[i + 1]) * N(i + 1, p - 1)
+			float* dn = &b.dn[s * order];
+			for (int r = 0; r <= p; ++r)
+			{
+				dn[r] = 0.0f;
+				if (p == 0)
+					continue;
+				const int i = span - p + r;
+				const float lowL = r > 0 ? low[r - 1] : 0.0f;
+				const float lowR = r < p ? low[r] : 0.0f;
+				const float dl = knots[i + p] - knots[i];
+				const float dr = knots[i + p + 1] - knots[i + 1];
+				if (dl > 0.0f) dn[r] += float(p) * lowL / dl;
+				if (dr > 0.0f) dn[r] -= float(p) * lowR / dr;
+			}
+		}
+	}
+
+	int m_nu = 0;
+	int m_nv = 0;
+	int m_uorder = 0;
+	int m_vorder = 0;
+	std::vector<float> m_uknots;
+	std::vector<float> m_vknots;
+	float m_u0 = 0.0f;
+	float m_u1 = 1.0f;
+	float m_v0 = 0.0f;
+	float m_v1 = 1.0f;
+	std::vector<Vec4> m_cp;
+	Matrix m_transform;
+	bool m_flipNormal = false;
+};
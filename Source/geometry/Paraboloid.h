@@ -0,0 +1,94 @@
+#pragma once
+#include "Quadric.h"
+
+class Paraboloid : public Quadric
+{
+public:
+	virtual ~Paraboloid() override
+	{
+	}
+
+	virtual Shape* clone() const override
+	{
+		return new Paraboloid(*this);
+	}
+
+	virtual void init(ParamSet& set) override
+	{
+		m_radius = set.getFloat("radius", 1.0f);
+		const float zmin = set.getFloat("zmin", 0.0f);
+		const float zmax = set.getFloat("zmax", 1.0f);
+		m_zmin = std::max(std::min(zmin, zmax), 0.0f);
+		m_zmax = std::max(std::max(zmin, zmax), 0.0f);
+		m_phimax = set.getFloat("phimax", 360.0f);
+		m_transform = ei::identity4x4();
+		if (m_zmax <= 0.0f)
+			System::warning("paraboloid with zmax <= 0");
+	}
+
+protected:
+	ei::Box computeLocalBounds() const override
+	{
+		return ei::Box(Vector(-m_radius, -m_radius, m_zmin), Vector(m_radius, m_radius, m_zmax));
+	}
+
+	float computeSurfaceArea() const override
+	{
+		if (m_zmax <= 0.0f)
+			return 0.0f;
+		const float radius2 = m_radius * m_radius;
+		const float k = 4.0f * m_zmax / radius2;
+		return (radius2 * radius2 * getPhiMax() / (12.0f * m_zmax * m_zmax)) *
+			(std::pow(k * m_zmax + 1.0f, 1.5f) - std::pow(k * m_zmin + 1.0f, 1.5f)) * getAreaScale();
+	}
+
+	void getResolution(float tolerance, int& nu, int& nv) const override
+	{
+		const float scale = getWorldScale();
+		nu = tessellation::getArcSegments(m_radius * scale, getPhiMax(), tolerance, 3);
+		if (m_zmax <= 0.0f)
+		{
+			nv = 1;
+			return;
+		}
+		// profile z = a * r^2: the radius of curvature is smallest at the lowest point
+		const float a = m_zmax / (m_radius * m_radius);
+		const float rmin = getRadius(m_zmin);
+		const float slope = 2.0f * a * rmin;
+		const float curvatureRadius = std::pow(1.0f + slope * slope, 1.5f) / (2.0f * a);
+		const float turn = std::atan(2.0f * a * m_radius) - std::atan(slope);
+		nv = tessellation::getArcSegments(curvatureRadius * scale, turn, tolerance, 1);
+	}
+
+	// sampled uniformly in the radius, the pbrt v (linear in z) goes to the uvs
+	void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2& uv) const override
+	{
+		const float phi = u * getPhiMax();
+		const float cosP = std::cos(phi);
+		const float sinP = std::sin(phi);
+		const float rmin = getRadius(m_zmin);
+		const float r = rmin + v * (m_radius - rmin);
+		const float z = m_zmax > 0.0f ? std::min(std::max(m_zmax * (r * r) / (m_radius * m_radius), m_zmin), m_zmax) : 0.0f;
+		p = Vector(r * cosP, r * sinP, z);
+		uv.y = m_zmax > m_zmin ? (z - m_zmin) / (m_zmax - m_zmin) : v;
+		// (cos, sin, -dr/dz) scaled to stay finite at the apex
+		const float w = m_zmax > 0.0f ? 2.0f * std::sqrt(z * m_zmax) / m_radius : 0.0f;
+		n = ei::normalize(Vector(cosP * w, sinP * w, -1.0f));
+		s = Vector(-sinP, cosP, 0.0f);
+	}
+
+	std::string getKey(int nu, int nv) const override
+	{
+		return tessellation::makeKey("paraboloid", { m_radius, m_zmin, m_zmax, getPhiMax(), float(nu), float(nv) });
+	}
+
+private:
+	float getRadius(float z) const
+	{
+		return m_zmax > 0.0f ? m_radius * std::sqrt(z / m_zmax) : 0.0f;
+	}
+
+	float m_radius = 1.0f;
+	float m_zmin = 0.0f;
+	float m_zmax = 1.0f;
+};
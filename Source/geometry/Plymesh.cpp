@@ -1,5 +1,14 @@
 #include "Plymesh.h"
 #include "../rply/rply.h"
+#include "../profiler.h"
+#include "../memory.h"
+#include "../incremental.h"
+#include "../prefetch.h"
+#include "../compression.h"
+#include "../stream_cache.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 struct CallbackContext {
 	ei::Vec3 *p;
@@ -8,7 +17,6 @@ struct CallbackContext {
 	int *indices;
 	int indexCtr;
 	int face[4];
-	bool error;
 	int vertexCount;
 
 	CallbackContext()
@@ -17,7 +25,6 @@ struct CallbackContext {
 		uv(nullptr),
 		indices(nullptr),
 		indexCtr(0),
-		error(false),
 		vertexCount(0) {}
 
 	~CallbackContext() {
@@ -68,15 +75,8 @@ int rply_face_callback(p_ply_argument argument) {
 	CallbackContext *context;
 	ply_get_argument_user_data(argument, (void **)&context, nullptr);
 
-	if (value_index >= 0) {
-		int value = (int)ply_get_argument_value(argument);
-		if (value < 0 || value >= context->vertexCount) {
-			System::error("ply: Vertex reference" + std::to_string(value) +
-				"is out of bounds! Valid range is [0.." + std::to_string(context->vertexCount) + "]");
-			context->error = true;
-		}
-		context->face[value_index] = value;
-	}
+	// the references are checked after reading (see Plymesh::init)
+	context->face[value_index] = (int)ply_get_argument_value(argument);
 
 	if (value_index == length - 1) {
 		for (int i = 0; i < 3; ++i)
@@ -92,6 +92,105 @@ int rply_face_callback(p_ply_argument argument) {
 	return 1;
 }
 
+namespace
+{
+	struct PlyData
+	{
+		std::vector<ei::Vec3> p;
+		std::vector<ei::Vec3> n;
+		std::vector<ei::Vec2> uv;
+		std::vector<int> indices;
+
+		size_t getMemorySize() const
+		{
+			return p.size() * sizeof(p[0]) + n.size() * sizeof(n[0]) + uv.size() * sizeof(uv[0]) + indices.size() * sizeof(indices[0]);
+		}
+	};
+
+	// decoded ply files of the batch and daemon mode (the scenes often share their assets).
+	// entries are keyed by the resolved path and check the file stamp (see StreamCache).
+	// the least recently used files are dropped above a quarter of the memory budget
+	class PlyCache
+	{
+	public:
+		static PlyCache& instance()
+		{
+			static PlyCache cache;
+			return cache;
+		}
+
+		std::shared_ptr<const PlyData> get(const std::string& filename)
+		{
+			std::shared_ptr<const PlyData> data;
+			StreamCache::FileStamp stamp;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto it = m_entries.find(filename);
+				if (it == m_entries.end())
+					return nullptr;
+				data = it->second.data;
+				stamp = it->second.stamp;
+				m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+			}
+			// the file is checked without the lock
+			if (StreamCache::isUnchanged(stamp))
+				return data;
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_entries.find(filename);
+			if (it != m_entries.end() && it->second.data == data)
+				remove(it);
+			return nullptr;
+		}
+
+		// returns false if the data is too big for the cache
+		bool put(const std::string& filename, const StreamCache::FileStamp& stamp, std::shared_ptr<const PlyData> data)
+		{
+			const size_t bytes = data->getMemorySize();
+			const size_t budget = memory::getBudget() / 4;
+			if (bytes > budget)
+				return false;
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_entries.find(filename);
+			if (it != m_entries.end())
+				remove(it);
+			while (m_bytes + bytes > budget && m_lru.size())
+				remove(m_entries.find(m_lru.back()));
+
+			m_lru.push_front(filename);
+			m_entries[filename] = Entry{ stamp, std::move(data), bytes, m_lru.begin() };
+			m_bytes += bytes;
+			return true;
+		}
+
+	private:
+		struct Entry
+		{
+			StreamCache::FileStamp stamp;
+			std::shared_ptr<const PlyData> data;
+			size_t bytes;
+			std::list<std::string>::iterator lru;
+		};
+
+		void remove(std::unordered_map<std::string, Entry>::iterator it)
+		{
+			m_bytes -= it->second.bytes;
+			m_lru.erase(it->second.lru);
+			m_entries.erase(it);
+		}
+
+		std::mutex m_mutex;
+		std::unordered_map<std::string, Entry> m_entries;
+		// most recently used first
+		std::list<std::string> m_lru;
+		size_t m_bytes = 0;
+	};
+}
+
+// returns nullptr after reporting an error
+static std::shared_ptr<PlyData> loadPly(const std::string& filename);
+
 void Plymesh::init(ParamSet& set)
 {
 	auto filename = set.getString("filename", "");
@@ -99,17 +198,149 @@ void Plymesh::init(ParamSet& set)
 		throw PbrtMissingParameter("filename");
 
 	filename = System::fixPath(System::getCurrentDirectory() + filename);
-	auto ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
+	profiler::ScopedTimer timer(profiler::Phase::Plymesh, filename);
+	if (auto session = incremental::Session::getCurrent())
+		session->addFile(incremental::Kind::Ply, filename);
+
+	const auto& options = System::args.getMain();
+	const bool useCache = options.has("batch") || options.has("daemon");
+	// taken before the file is read
+	const auto stamp = useCache ? StreamCache::getFileStamp(filename) : StreamCache::FileStamp{ filename, -1, 0, false, 0 };
+	const bool hasInfo = stamp.size >= 0;
+	std::shared_ptr<const PlyData> data;
+	// data that is not shared with the cache, the arrays are moved into the mesh
+	std::shared_ptr<PlyData> owned;
+	if (hasInfo)
+		data = PlyCache::instance().get(filename);
+	if (!data)
+	{
+		owned = loadPly(filename);
+		if (!owned)
+			return;
+		// the faces are tested in parallel ranges instead of in the sequential rply callbacks
+		if (size_t(getMaxIndex(owned->indices)) >= owned->p.size())
+		{
+			System::error("ply: vertex references of " + filename + " are out of bounds! Valid range is [0.." + std::to_string(owned->p.size()) + "]");
+			return;
+		}
+		data = owned;
+		if (hasInfo && PlyCache::instance().put(filename, stamp, owned))
+			owned.reset();
+	}
+
+	if (owned)
+	{
+		m_geom->m_indices = std::move(owned->indices);
+		m_geom->m_p = std::move(owned->p);
+		m_geom->m_n = std::move(owned->n);
+	}
+	else
+	{
+		m_geom->m_indices = data->indices;
+		m_geom->m_p = data->p;
+		m_geom->m_n = data->n;
+	}
+
+	bool discardDegenerateUVs = set.getBool("discarddegenerateUVs", false);
+	if (discardDegenerateUVs && m_geom->m_uv.size())
+	{
+		std::vector<float> rawUvs;
+		rawUvs.reserve(data->uv.size() * 2);
+		rawUvs.assign(reinterpret_cast<const float*>(data->uv.data()), reinterpret_cast<const float*>(data->uv.data()) + 2 * data->uv.size());
+		discardDegenerateUvs(rawUvs);
+		copyToVec2(m_geom->m_uv, rawUvs);
+	}
+	else if (owned)
+		m_geom->m_uv = std::move(owned->uv);
+	else m_geom->m_uv = data->uv;
+
+	// indices were already checked against the vertex count in rply_face_callback
+	verifyData(true, true);
+	System::runtimeInfoSpam("parsed plymesh " + filename);
+}
+
+// data of a ply file that was read ahead
+struct PlyMemory
+{
+	const char* data;
+	size_t size;
+	size_t offset;
+};
+
+static size_t readPlyMemory(void* data, char* buffer, size_t size)
+{
+	auto& memory = *static_cast<PlyMemory*>(data);
+	size = std::min(size, memory.size - memory.offset);
+	memcpy(buffer, memory.data + memory.offset, size);
+	memory.offset += size;
+	return size;
+}
+
+static size_t readPlyStream(void* data, char* buffer, size_t size)
+{
+	return static_cast<compression::Stream*>(data)->read(buffer, size);
+}
+
+static std::shared_ptr<PlyData> loadPly(const std::string& filename)
+{
+	// the file could have been read ahead. The sources have to outlive the ply handle
+	size_t size = 0;
+	std::unique_ptr<char[]> bytes;
+	if (auto reader = prefetch::Reader::getCurrent())
+		bytes = reader->take(filename, size);
+	std::unique_ptr<FILE, int(*)(FILE*)> file(nullptr, fclose);
+	compression::Format format;
+	if (bytes)
+		format = compression::detect(bytes.get(), size);
+	else
+	{
+		file.reset(fopen(filename.c_str(), "rb"));
+		if (!file)
+		{
+			System::error("could not open ply file " + filename);
+			return nullptr;
+		}
+		char magic[4];
+		format = compression::detect(magic, fread(magic, 1, sizeof(magic), file.get()));
+		rewind(file.get());
+	}
+
+	// compressed files (.ply.gz) are decoded in chunks while rply reads them
+	std::unique_ptr<compression::Stream> stream;
+	PlyMemory memory = { bytes.get(), size, 0 };
+	p_ply ply = nullptr;
+	if (format != compression::Format::None)
+	{
+		if (bytes)
+			stream.reset(new compression::Stream(format, bytes.get(), size));
+		else
+			stream.reset(new compression::Stream(format, file.get()));
+		ply = ply_open_from_callback(readPlyStream, stream.get(), rply_message_callback, 0, nullptr);
+	}
+	else if (bytes)
+		ply = ply_open_from_callback(readPlyMemory, &memory, rply_message_callback, 0, nullptr);
+	else
+	{
+		ply = ply_open_from_file(file.get(), rply_message_callback, 0, nullptr);
+		// closed by ply_close
+		if (ply)
+			file.release();
+	}
 	if(!ply)
 	{
 		System::error("could not open ply file " + filename);
-		return;
+		return nullptr;
 	}
+	// decoding errors explain the errors of rply
+	auto getStreamError = [&stream]()
+	{
+		return stream && stream->getError().size() ? " (" + stream->getError() + ")" : std::string();
+	};
 
 	if(!ply_read_header(ply))
 	{
-		System::error("unable to read the header of PLY file " + filename);
-		return;
+		System::error("unable to read the header of PLY file " + filename + getStreamError());
+		return nullptr;
 	}
 
 	p_ply_element element = nullptr;
@@ -129,8 +360,10 @@ void Plymesh::init(ParamSet& set)
 
 	if (vertexCount == 0 || faceCount == 0) {
 		System::error("PLY file " + filename +  " is invalid! No face/vertex elements found!");
-		return;
+		return nullptr;
 	}
+	profiler::count(profiler::Counter::PlyVertices, uint64_t(vertexCount));
+	profiler::count(profiler::Counter::PlyFaces, uint64_t(faceCount));
 
 	CallbackContext context;
 
@@ -144,7 +377,7 @@ void Plymesh::init(ParamSet& set)
 	}
 	else {
 		System::error("PLY file " + filename + ": Vertex coordinate property not found!");
-		return;
+		return nullptr;
 	}
 
 	if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, &context,
@@ -183,45 +416,19 @@ void Plymesh::init(ParamSet& set)
 		0);
 
 	if (!ply_read(ply)) {
-		System::error("unable to read the contents of PLY file " + filename);
+		System::error("unable to read the contents of PLY file " + filename + getStreamError());
 		ply_close(ply);
-		return;
+		return nullptr;
 	}
 
 	ply_close(ply);
-	if (context.error)
-	{
-		System::error("error during read of PLY file " + filename);
-		return;
-	}
-
-	m_geom->m_indices.reserve(context.indexCtr);
-	m_geom->m_indices.assign(context.indices, context.indices + context.indexCtr);
-	
-	m_geom->m_p.reserve(context.vertexCount);
-	m_geom->m_p.assign(context.p, context.p + context.vertexCount);
-
-	if(context.n)
-	{
-		m_geom->m_n.reserve(context.vertexCount);
-		m_geom->m_n.assign(context.n, context.n + context.vertexCount);
-	}
-	
-	bool discardDegenerateUVs = set.getBool("discarddegenerateUVs", false);
-	if (discardDegenerateUVs && m_geom->m_uv.size())
-	{
-		std::vector<float> rawUvs;
-		rawUvs.reserve(context.vertexCount * 2);
-		rawUvs.assign(reinterpret_cast<float*>(context.uv), reinterpret_cast<float*>(context.uv) + 2 * context.vertexCount);
-		discardDegenerateUvs(rawUvs);
-		copyToVec2(m_geom->m_uv, rawUvs);
-	}
-	else if(context.uv)
-	{
-		m_geom->m_uv.reserve(context.vertexCount);
-		m_geom->m_uv.assign(context.uv, context.uv + context.vertexCount);
-	}
 
-	verifyData(true);
-	System::runtimeInfoSpam("parsed plymesh " + filename);
+	auto data = std::make_shared<PlyData>();
+	data->indices.assign(context.indices, context.indices + context.indexCtr);
+	data->p.assign(context.p, context.p + context.vertexCount);
+	if (context.n)
+		data->n.assign(context.n, context.n + context.vertexCount);
+	if (context.uv)
+		data->uv.assign(context.uv, context.uv + context.vertexCount);
+	return data;
 }
@@ -0,0 +1,96 @@
+#pragma once
+#include "Shape.h"
+#include "Tessellation.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// common parts of the analytic shapes (sphere, cylinder, cone ...):
+// object to world transform, orientation and tessellation into a parametric (phi, v) grid
+class Quadric : public Shape
+{
+public:
+	virtual void applyTransform(const Matrix& mat) override
+	{
+		m_transform *= mat;
+		invalidateStatistics();
+	}
+
+	void applyTransformFront(const Matrix& mat) override
+	{
+		m_transform = mat * m_transform;
+		invalidateStatistics();
+	}
+
+	void flipNormals() override
+	{
+		m_flipNormal = true;
+	}
+
+	size_t getPrimitiveCount() const override
+	{
+		return 1;
+	}
+
+	// size of the tessellated shape
+	virtual size_t estimateSize(size_t vertexSize) const override
+	{
+		int nu, nv;
+		getResolution(tessellation::getTolerance(), nu, nv);
+		return (nu + 1) * (nv + 1) * vertexSize + nu * nv * 6 * sizeof(uint32);
+	}
+
+protected:
+	ei::Box computeWorldBounds() const override
+	{
+		return transformBox(getLocalBounds(), m_transform);
+	}
+
+	Shape* makeMesh(float tolerance) const override
+	{
+		int nu, nv;
+		getResolution(tolerance, nu, nv);
+		const float flip = m_flipNormal ? -1.0f : 1.0f;
+		auto geom = tessellation::GeometryCache::instance().get(getKey(nu, nv) + (m_flipNormal ? "-" : "+"),
+			[&](tessellation::CoreGeometry& g)
+		{
+			tessellation::makeGrid(g, nu, nv, [&](float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2& uv)
+			{
+				evaluate(u, v, p, n, s, uv);
+				n *= flip;
+			});
+		});
+		return new TriangleMesh(geom, m_transform);
+	}
+
+	// segments along u (phi) and v for the given world space tolerance
+	virtual void getResolution(float tolerance, int& nu, int& nv) const = 0;
+	// object space point, normal (direction of cross(dp/du, dp/dv)) and tangent (dp/du) for u, v in [0, 1].
+	// uv is preset to (u, v) and only has to be written if the grid is not sampled uniformly in the pbrt parametrization
+	virtual void evaluate(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2& uv) const = 0;
+	// identifies the object space geometry for the given resolution
+	virtual std::string getKey(int nu, int nv) const = 0;
+
+	// object space areas have to be multiplied with this (exact for uniform scaling, an approximation for non-uniform scaling)
+	float getAreaScale() const
+	{
+		const Vector c0 = Vector(m_transform(0, 0), m_transform(1, 0), m_transform(2, 0));
+		const Vector c1 = Vector(m_transform(0, 1), m_transform(1, 1), m_transform(2, 1));
+		const Vector c2 = Vector(m_transform(0, 2), m_transform(1, 2), m_transform(2, 2));
+		const float det = std::abs(ei::dot(c0, ei::cross(c1, c2)));
+		return std::pow(det, 2.0f / 3.0f);
+	}
+	// object space lengths have to be multiplied with this to get an upper bound for world space lengths
+	float getWorldScale() const
+	{
+		return tessellation::getMaxScale(m_transform);
+	}
+	float getPhiMax() const
+	{
+		return float(std::min(std::max(m_phimax, 0.0f), 360.0f) / 360.0f * 2.0f * M_PI);
+	}
+
+protected:
+	float m_phimax = 360.0f;
+	Matrix m_transform = ei::identity4x4();
+	bool m_flipNormal = false;
+};
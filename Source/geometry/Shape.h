@@ -1,9 +1,11 @@
 #pragma once
 #include <ei/vector.hpp>
+#include <ei/3dtypes.hpp>
 #include "../PBRT/ParamSet.h"
 #include "../parser_exception.h"
 #include "../PBRT/Material.h"
 #include "../PBRT/Light.h"
+#include "../memory.h"
 
 using Vector = ei::Vec3;
 using Matrix = ei::Matrix<float, 4, 4>;
@@ -50,8 +52,132 @@ public:
 		assert(m_material);
 		return *m_material;
 	}
+	// bounding box of all 8 corners of the transformed box
+	static ei::Box transformBox(const ei::Box& box, const Matrix& mat)
+	{
+		Vector bmin = transformPoint(box.min, mat);
+		Vector bmax = bmin;
+		for (int i = 1; i < 8; ++i)
+		{
+			const Vector corner = transformPoint(Vector(
+				(i & 1) ? box.max.x : box.min.x,
+				(i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z), mat);
+			bmin = ei::min(bmin, corner);
+			bmax = ei::max(bmax, corner);
+		}
+		return ei::Box(bmin, bmax);
+	}
+
 	virtual void flipNormals() = 0;
 	virtual size_t estimateSize(size_t vertexSize) const = 0;
+
+	// moves large data into the spill file until it is needed again, returns the released bytes
+	virtual size_t spill(memory::SpillFile&) const
+	{
+		return 0;
+	}
+
+	// keeps the data of a spilled shape loaded until the end of the scope and spills it again afterwards,
+	// so passes over all shapes only hold the shapes in use. Data that was not spilled stays loaded.
+	// Threads that use the data of the same shape concurrently need a scope each
+	class DataScope
+	{
+	public:
+		explicit DataScope(const Shape& shape)
+			: m_shape(shape)
+		{
+			m_shape.beginAccess();
+		}
+		~DataScope()
+		{
+			m_shape.endAccess();
+		}
+		DataScope(const DataScope&) = delete;
+		DataScope& operator=(const DataScope&) = delete;
+	private:
+		const Shape& m_shape;
+	};
+
+	// statistics are computed on first use and cached until the transform changes.
+	// different shapes may be queried concurrently, the same shape may not.
+	// bounding box in object space
+	const ei::Box& getLocalBounds() const
+	{
+		if (!m_hasLocalBounds)
+		{
+			DataScope scope(*this);
+			m_localBounds = computeLocalBounds();
+			m_hasLocalBounds = true;
+		}
+		return m_localBounds;
+	}
+	// bounding box in world space
+	const ei::Box& getWorldBounds() const
+	{
+		if (!m_hasWorldBounds)
+		{
+			DataScope scope(*this);
+			m_worldBounds = computeWorldBounds();
+			m_hasWorldBounds = true;
+		}
+		return m_worldBounds;
+	}
+	// surface area in world space
+	float getSurfaceArea() const
+	{
+		if (!m_hasSurfaceArea)
+		{
+			DataScope scope(*this);
+			m_surfaceArea = computeSurfaceArea();
+			m_hasSurfaceArea = true;
+		}
+		return m_surfaceArea;
+	}
+	// number of primitives (triangles for meshes, 1 for analytic shapes)
+	virtual size_t getPrimitiveCount() const = 0;
+
+	/**
+	 * \brief triangle mesh approximation of an analytic shape with the same material
+	 * \param tolerance maximal distance between surface and mesh in world space
+	 * \return nullptr if the shape is already a mesh
+	 */
+	Shape* tessellate(float tolerance) const
+	{
+		Shape* mesh = makeMesh(tolerance);
+		if (mesh)
+			mesh->m_material = m_material;
+		return mesh;
+	}
+protected:
+	virtual Shape* makeMesh(float) const
+	{
+		return nullptr;
+	}
+	// see DataScope
+	virtual void beginAccess() const
+	{}
+	virtual void endAccess() const
+	{}
+
+	virtual ei::Box computeLocalBounds() const = 0;
+	virtual ei::Box computeWorldBounds() const = 0;
+	virtual float computeSurfaceArea() const = 0;
+
+	// has to be called when the geometry or the transform changes
+	void invalidateStatistics()
+	{
+		m_hasLocalBounds = false;
+		m_hasWorldBounds = false;
+		m_hasSurfaceArea = false;
+	}
 private:
 	std::shared_ptr<Material> m_material;
+
+	mutable ei::Box m_localBounds;
+	mutable ei::Box m_worldBounds;
+	mutable float m_surfaceArea = 0.0f;
+	mutable bool m_hasLocalBounds = false;
+	mutable bool m_hasWorldBounds = false;
+	mutable bool m_hasSurfaceArea = false;
 };
@@ -0,0 +1,251 @@
+#pragma once
+#include "TriangleMesh.h"
+#include <string>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <future>
+#include <cstring>
+#include <initializer_list>
+
+// helpers to turn analytic shapes into triangle meshes
+namespace tessellation
+{
+	using CoreGeometry = TriangleMesh::CoreGeometry;
+
+	static const float DEFAULT_TOLERANCE = 0.01f;
+	static const int MAX_SEGMENTS = 1024;
+
+	// maximal distance between surface and mesh in world space (--tessellate [tolerance])
+	inline float getTolerance()
+	{
+		const float tol = System::args.get<float>("tessellate", DEFAULT_TOLERANCE);
+		return tol > 0.0f ? tol : DEFAULT_TOLERANCE;
+	}
+
+	// largest scale factor of the linear part of the transform
+	inline float getMaxScale(const Matrix& m)
+	{
+		const float s0 = ei::lensq(Vector(m(0, 0), m(1, 0), m(2, 0)));
+		const float s1 = ei::lensq(Vector(m(0, 1), m(1, 1), m(2, 1)));
+		const float s2 = ei::lensq(Vector(m(0, 2), m(1, 2), m(2, 2)));
+		return std::sqrt(std::max(s0, std::max(s1, s2)));
+	}
+
+	/**
+	 * \brief number of segments for an arc so that the chords deviate at most tolerance from the arc
+	 * \param radius world space radius
+	 * \param angle arc angle in radians
+	 */
+	inline int getArcSegments(float radius, float angle, float tolerance, int minSegments = 1)
+	{
+		if (angle <= 0.0f || radius <= 0.0f)
+			return minSegments;
+		// sagitta of a segment: radius * (1 - cos(step / 2))
+		const float step = 2.0f * std::acos(std::max(1.0f - tolerance / radius, -1.0f));
+		const int segments = step > 0.0f ? int(std::ceil(angle / step)) : MAX_SEGMENTS;
+		return std::min(std::max(segments, minSegments), MAX_SEGMENTS);
+	}
+
+	/**
+	 * \brief fills the geometry with a (nu + 1) x (nv + 1) vertex grid
+	 * \param eval void(float u, float v, Vector& p, Vector& n, Vector& s, ei::Vec2& uv) for u, v in [0, 1]
+	 *        uv is preset to (u, v) and may be overwritten (e.g. for non-uniform sampling).
+	 *        triangles are counter clockwise with respect to cross(dp/du, dp/dv).
+	 *        rows that collapse to a single point (poles, apex) only get one triangle per quad.
+	 */
+	template <class F>
+	void makeGrid(CoreGeometry& g, int nu, int nv, F eval)
+	{
+		const size_t rowSize = size_t(nu) + 1;
+		const size_t numRows = size_t(nv) + 1;
+		g.m_p.resize(rowSize * numRows);
+		g.m_n.resize(rowSize * numRows);
+		g.m_s.resize(rowSize * numRows);
+		g.m_uv.resize(rowSize * numRows);
+		std::vector<char> collapsed(numRows);
+
+		const size_t minRows = std::max(size_t(1), size_t(4096) / rowSize);
+		parallel::forRange(numRows, minRows, [&](size_t begin, size_t end)
+		{
+			for (size_t j = begin; j < end; ++j)
+			{
+				const float v = float(j) / float(nv);
+				const size_t row = j * rowSize;
+				for (size_t i = 0; i < rowSize; ++i)
+				{
+					const float u = float(i) / float(nu);
+					g.m_uv[row + i] = ei::Vec2(u, v);
+					eval(u, v, g.m_p[row + i], g.m_n[row + i], g.m_s[row + i], g.m_uv[row + i]);
+				}
+				const Vector& p0 = g.m_p[row];
+				const float eps = 1e-12f * ei::lensq(p0);
+				bool single = true;
+				for (size_t i = 1; i < rowSize && single; ++i)
+					single = ei::lensq(g.m_p[row + i] - p0) <= eps;
+				collapsed[j] = single;
+			}
+		});
+
+		// triangle offset of every quad row
+		std::vector<size_t> offsets(numRows);
+		size_t numTriangles = 0;
+		for (size_t j = 0; j + 1 < numRows; ++j)
+		{
+			offsets[j] = numTriangles;
+			numTriangles += size_t(nu) * (size_t(!collapsed[j]) + size_t(!collapsed[j + 1]));
+		}
+		g.m_indices.resize(numTriangles * 3);
+
+		parallel::forRange(numRows - 1, minRows, [&](size_t begin, size_t end)
+		{
+			for (size_t j = begin; j < end; ++j)
+			{
+				int* dst = g.m_indices.data() + offsets[j] * 3;
+				const int row = int(j * rowSize);
+				const int next = int((j + 1) * rowSize);
+				for (int i = 0; i < nu; ++i)
+				{
+					// next+i --- next+i+1
+					//   |      /     |
+					//  row+i --- row+i+1
+					if (!collapsed[j])
+					{
+						*dst++ = row + i;
+						*dst++ = row + i + 1;
+						*dst++ = next + i + 1;
+					}
+					if (!collapsed[j + 1])
+					{
+						*dst++ = row + i;
+						*dst++ = next + i + 1;
+						*dst++ = next + i;
+					}
+				}
+			}
+		});
+	}
+
+	// key from the shape name and the exact bit patterns of its parameters
+	inline std::string makeKey(const char* shape, std::initializer_list<float> params)
+	{
+		std::string key = shape;
+		for (float f : params)
+		{
+			char bits[sizeof(float)];
+			memcpy(bits, &f, sizeof(float));
+			key.append(bits, sizeof(float));
+		}
+		return key;
+	}
+
+	// shares generated geometry between shapes with identical parameters.
+	// concurrent requests for the same key wait until the first one finished building.
+	// the least recently used geometry is dropped above an eighth of the memory budget
+	// (the meshes that were created from it keep it alive)
+	class GeometryCache
+	{
+	public:
+		static GeometryCache& instance()
+		{
+			static GeometryCache cache;
+			return cache;
+		}
+
+		/**
+		 * \brief returns the geometry for the key and calls build(CoreGeometry&) if it does not exist yet
+		 */
+		template <class F>
+		std::shared_ptr<CoreGeometry> get(const std::string& key, F build)
+		{
+			std::promise<std::shared_ptr<CoreGeometry>> promise;
+			std::shared_future<std::shared_ptr<CoreGeometry>> future;
+			bool isBuilder = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto it = m_entries.find(key);
+				if (it == m_entries.end())
+				{
+					future = promise.get_future().share();
+					m_entries.emplace(key, Entry{ future, 0, m_lru.end() });
+					isBuilder = true;
+				}
+				else
+				{
+					future = it->second.future;
+					// entries that are still building are not in the list
+					if (it->second.lru != m_lru.end())
+						m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+				}
+			}
+
+			if (isBuilder)
+			{
+				try
+				{
+					auto geom = std::make_shared<CoreGeometry>();
+					build(*geom);
+					promise.set_value(geom);
+					insert(key, geom->getMemorySize());
+				}
+				catch (...)
+				{
+					promise.set_exception(std::current_exception());
+					// the next request builds again
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_entries.erase(key);
+				}
+			}
+			return future.get();
+		}
+
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_entries.clear();
+			m_lru.clear();
+			m_bytes = 0;
+		}
+	private:
+		GeometryCache() = default;
+
+		struct Entry
+		{
+			std::shared_future<std::shared_ptr<CoreGeometry>> future;
+			size_t bytes;
+			std::list<std::string>::iterator lru;
+		};
+
+		// makes a built entry evictable
+		void insert(const std::string& key, size_t bytes)
+		{
+			const size_t budget = memory::getBudget() / 8;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			while (m_bytes + bytes > budget && m_lru.size())
+			{
+				auto it = m_entries.find(m_lru.back());
+				m_bytes -= it->second.bytes;
+				m_entries.erase(it);
+				m_lru.pop_back();
+			}
+			auto it = m_entries.find(key);
+			if (it == m_entries.end())
+				return;
+			if (bytes > budget)
+			{
+				m_entries.erase(it);
+				return;
+			}
+			m_lru.push_front(key);
+			it->second.bytes = bytes;
+			it->second.lru = m_lru.begin();
+			m_bytes += bytes;
+		}
+
+		std::mutex m_mutex;
+		std::unordered_map<std::string, Entry> m_entries;
+		// most recently used first
+		std::list<std::string> m_lru;
+		size_t m_bytes = 0;
+	};
+}
@@ -4,9 +4,24 @@
 #include <cassert>
 #include "../system.h"
 #include <numeric>
+#include "CompactGeometry.h"
+#include "../parallel.h"
+#include "../profiler.h"
+#include "../memory.h"
+#include <atomic>
+#include <mutex>
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRIANGLEMESH_USE_SSE
+#include <emmintrin.h>
+#endif
 
 class TriangleMesh : public Shape
 {
+public:
+	// geometry data (shared between instances of the same object)
 	struct CoreGeometry
 	{
 		std::vector<int> m_indices;
@@ -15,13 +30,173 @@ class TriangleMesh : public Shape
 		std::vector<Vector> m_s; // per vector tangent
 		std::vector<ei::Vec2> m_uv; // per vector texture coordinates
 		std::shared_ptr<Texture<float>> m_alpha;
+
+		CoreGeometry() = default;
+		CoreGeometry(const CoreGeometry&) = delete;
+		CoreGeometry& operator=(const CoreGeometry&) = delete;
+		~CoreGeometry()
+		{
+			memory::add(memory::Category::Geometry, -int64_t(m_accounted));
+			if (isSpilled())
+				m_file->release(m_spilled.offset, m_spilled.size);
+		}
+
+		// bytes held by the arrays
+		size_t getMemorySize() const
+		{
+			return m_indices.capacity() * sizeof(int) + (m_p.capacity() + m_n.capacity() + m_s.capacity()) * sizeof(Vector)
+				+ m_uv.capacity() * sizeof(ei::Vec2);
+		}
+		// updates the memory accounting after the arrays were changed
+		void updateMemory()
+		{
+			const size_t size = getMemorySize();
+			memory::add(memory::Category::Geometry, int64_t(size) - int64_t(m_accounted));
+			m_accounted = size;
+		}
+
+		// element counts (also available while spilled)
+		size_t getIndexCount() const
+		{
+			return isSpilled() ? m_spilled.indices : m_indices.size();
+		}
+		size_t getVertexCount() const
+		{
+			return isSpilled() ? m_spilled.p : m_p.size();
+		}
+		bool hasNormals() const
+		{
+			return (isSpilled() ? m_spilled.n : m_n.size()) != 0;
+		}
+		bool hasTangents() const
+		{
+			return (isSpilled() ? m_spilled.s : m_s.size()) != 0;
+		}
+		bool hasUvs() const
+		{
+			return (isSpilled() ? m_spilled.uv : m_uv.size()) != 0;
+		}
+
+		bool isSpilled() const
+		{
+			return m_isSpilled.load(std::memory_order_acquire);
+		}
+		// moves the arrays into the spill file, returns the released bytes (0 while the arrays are in use, see beginAccess)
+		size_t spill(memory::SpillFile& file)
+		{
+			std::lock_guard<std::mutex> lock(m_spillMutex);
+			if (isSpilled() || m_users)
+				return 0;
+			return spillLocked(file);
+		}
+		// loads the arrays if they were spilled
+		void restore()
+		{
+			if (!isSpilled())
+				return;
+			std::lock_guard<std::mutex> lock(m_spillMutex);
+			if (!isSpilled())
+				return;
+			m_indices.resize(m_spilled.indices);
+			m_p.resize(m_spilled.p);
+			m_n.resize(m_spilled.n);
+			m_s.resize(m_spilled.s);
+			m_uv.resize(m_spilled.uv);
+			uint64_t offset = m_spilled.offset;
+			auto read = [&](void* dst, size_t size)
+			{
+				m_file->read(offset, dst, size);
+				offset += size;
+			};
+			read(m_indices.data(), m_indices.size() * sizeof(int));
+			read(m_p.data(), m_p.size() * sizeof(Vector));
+			read(m_n.data(), m_n.size() * sizeof(Vector));
+			read(m_s.data(), m_s.size() * sizeof(Vector));
+			read(m_uv.data(), m_uv.size() * sizeof(ei::Vec2));
+			// the arrays may change, so they are written again by the next spill
+			m_file->release(m_spilled.offset, m_spilled.size);
+			updateMemory();
+			m_isSpilled.store(false, std::memory_order_release);
+		}
+		// the arrays can be used by several threads between beginAccess and endAccess. Arrays that were spilled
+		// at the first beginAccess are spilled again by the last endAccess (see Shape::DataScope)
+		void beginAccess()
+		{
+			std::lock_guard<std::mutex> lock(m_spillMutex);
+			if (m_users++ == 0)
+				m_respill = isSpilled();
+		}
+		void endAccess()
+		{
+			std::lock_guard<std::mutex> lock(m_spillMutex);
+			if (--m_users == 0 && m_respill && !isSpilled())
+				spillLocked(*m_file);
+		}
+	private:
+		struct SpillInfo
+		{
+			uint64_t offset = 0;
+			uint64_t size = 0; // bytes in the file
+			size_t indices = 0, p = 0, n = 0, s = 0, uv = 0;
+		};
+
+		size_t spillLocked(memory::SpillFile& file)
+		{
+			m_spilled.indices = m_indices.size();
+			m_spilled.p = m_p.size();
+			m_spilled.n = m_n.size();
+			m_spilled.s = m_s.size();
+			m_spilled.uv = m_uv.size();
+			m_spilled.size = m_indices.size() * sizeof(int) + (m_p.size() + m_n.size() + m_s.size()) * sizeof(Vector)
+				+ m_uv.size() * sizeof(ei::Vec2);
+			m_spilled.offset = file.allocate(m_spilled.size);
+			uint64_t offset = m_spilled.offset;
+			auto write = [&](const void* data, size_t size)
+			{
+				file.write(offset, data, size);
+				offset += size;
+			};
+			write(m_indices.data(), m_indices.size() * sizeof(int));
+			write(m_p.data(), m_p.size() * sizeof(Vector));
+			write(m_n.data(), m_n.size() * sizeof(Vector));
+			write(m_s.data(), m_s.size() * sizeof(Vector));
+			write(m_uv.data(), m_uv.size() * sizeof(ei::Vec2));
+			m_file = &file;
+
+			const size_t released = m_accounted;
+			std::vector<int>().swap(m_indices);
+			std::vector<Vector>().swap(m_p);
+			std::vector<Vector>().swap(m_n);
+			std::vector<Vector>().swap(m_s);
+			std::vector<ei::Vec2>().swap(m_uv);
+			updateMemory();
+			m_isSpilled.store(true, std::memory_order_release);
+			return released;
+		}
+
+		size_t m_accounted = 0;
+		std::atomic<bool> m_isSpilled{ false };
+		std::mutex m_spillMutex;
+		SpillInfo m_spilled;
+		memory::SpillFile* m_file = nullptr;
+		// number of beginAccess without endAccess
+		int m_users = 0;
+		bool m_respill = false;
 	};
-public:
+
 	TriangleMesh()
 		:
 		m_geom(new CoreGeometry()),
 		m_trans(ei::identity4x4())
 	{}
+	// mesh for already generated geometry (e.g. tessellated analytic shapes)
+	TriangleMesh(std::shared_ptr<CoreGeometry> geom, const Matrix& trans)
+		:
+		m_geom(std::move(geom)),
+		m_trans(trans)
+	{
+		m_geom->updateMemory();
+	}
 	TriangleMesh(const TriangleMesh&) = default;
 	virtual ~TriangleMesh() override
 	{
@@ -32,6 +207,32 @@ public:
 		return new TriangleMesh(*this);
 	}
 
+	// checks the array sizes and the index range like init() and verifyData() without converting
+	// the vertex arrays (--noconvert). vertexAttributes: check N, S and uv
+	static void checkParams(const ParamSet& set, bool vertexAttributes = true)
+	{
+		std::vector<int> indices;
+		if (!set.getInts("indices", indices))
+			throw PbrtMissingParameter("integer indices");
+		const size_t points = set.getPointCount("P");
+		if (!points)
+			throw PbrtMissingParameter("point P");
+		if (vertexAttributes)
+		{
+			if (set.getNormalCount("N") != 0 && set.getNormalCount("N") != points)
+				throw PbrtArgMismatch("normals");
+			if (set.getVectorCount("S") != 0 && set.getVectorCount("S") != points)
+				throw PbrtArgMismatch("tangents");
+			const size_t uvs = set.getFloatCount("uv") ? set.getFloatCount("uv") : set.getFloatCount("st");
+			if (uvs != 0 && uvs / 2 != points)
+				throw PbrtArgMismatch("texture coordinates");
+		}
+		if (indices.size() % 3 != 0)
+			throw PbrtArgMismatch("indices count");
+		if (size_t(getMaxIndex(indices)) >= points)
+			throw std::exception("trianglemesh has out of-bounds indices");
+	}
+
 	virtual void init(ParamSet& set) override
 	{
 		assert(m_geom->m_indices.size() == 0);
@@ -59,11 +260,13 @@ public:
 	virtual void applyTransform(const Matrix& mat) override
 	{
 		m_trans *= mat;
+		invalidateStatistics();
 	}
 
 	void applyTransformFront(const Matrix& mat) override
 	{
 		m_trans = mat * m_trans;
+		invalidateStatistics();
 	}
 
 	void setAlphaTexture(std::shared_ptr<Texture<float>> ta)
@@ -73,22 +276,158 @@ public:
 
 	void flipNormals() override
 	{
-		for (auto& n : m_geom->m_n)
+		for (auto& n : getGeometry().m_n)
 			n *= -1.0f;
 	}
 
 	virtual size_t estimateSize(size_t vertexSize) const override
 	{
+		if (System::args.has("compact"))
+			return CompactGeometry::estimateSize(m_geom->getIndexCount(), m_geom->getVertexCount(),
+				m_geom->hasNormals(), m_geom->hasTangents(), m_geom->hasUvs(), System::args.has("quantize"));
+
 		// vertex count + index count
-		return (m_geom->m_indices.size() * sizeof(int) * 4) / 3 + m_geom->m_p.size() * vertexSize;
+		return (m_geom->getIndexCount() * sizeof(int) * 4) / 3 + m_geom->getVertexCount() * vertexSize;
+	}
+
+	size_t spill(memory::SpillFile& file) const override
+	{
+		return m_geom->spill(file);
+	}
+
+	// compact copy of the geometry for exporting (16 bit indices, octahedral normals and tangents)
+	CompactGeometry compact(bool quantizePositions) const
+	{
+		const auto& g = getGeometry();
+		return CompactGeometry(g.m_indices, g.m_p, g.m_n, g.m_s, g.m_uv, quantizePositions);
+	}
+
+	size_t getPrimitiveCount() const override
+	{
+		return m_geom->getIndexCount() / 3;
+	}
+	const std::vector<int>& getIndices() const
+	{
+		return getGeometry().m_indices;
+	}
+	const std::vector<Vector>& getPositions() const
+	{
+		return getGeometry().m_p;
+	}
+	const Matrix& getTransform() const
+	{
+		return m_trans;
+	}
+	// identifies the geometry data (shared between instances of the same object)
+	const void* getGeometryId() const
+	{
+		return m_geom.get();
 	}
 protected:
+	void beginAccess() const override
+	{
+		m_geom->beginAccess();
+	}
+	void endAccess() const override
+	{
+		m_geom->endAccess();
+	}
+
+	ei::Box computeLocalBounds() const override
+	{
+		return computeBounds(ei::identity4x4());
+	}
+
+	ei::Box computeWorldBounds() const override
+	{
+		return computeBounds(m_trans);
+	}
+
+	float computeSurfaceArea() const override
+	{
+		// the area of a transformed triangle is 0.5 * |cof(M) * cross(e1, e2)|
+		// with the cofactor matrix cof(M) of the linear part of the transform
+		const Vector c0 = Vector(m_trans(0, 0), m_trans(1, 0), m_trans(2, 0));
+		const Vector c1 = Vector(m_trans(0, 1), m_trans(1, 1), m_trans(2, 1));
+		const Vector c2 = Vector(m_trans(0, 2), m_trans(1, 2), m_trans(2, 2));
+		const Vector cof0 = ei::cross(c1, c2);
+		const Vector cof1 = ei::cross(c2, c0);
+		const Vector cof2 = ei::cross(c0, c1);
+
+		const auto& idx = getGeometry().m_indices;
+		const auto& p = getGeometry().m_p;
+		const size_t numTriangles = idx.size() / 3;
+		const double area = parallel::reduce(numTriangles, 1 << 16, 0.0, [&](size_t begin, size_t end)
+		{
+			double sum = 0.0;
+			for (size_t t = begin; t < end; ++t)
+			{
+				const Vector& p0 = p[idx[t * 3]];
+				const Vector n = ei::cross(p[idx[t * 3 + 1]] - p0, p[idx[t * 3 + 2]] - p0);
+				sum += double(ei::len(cof0 * n.x + cof1 * n.y + cof2 * n.z));
+			}
+			return sum;
+		}, [](double a, double b) { return a + b; });
+		return float(0.5 * area);
+	}
+
+	// bounding box of all vertices transformed by mat
+	ei::Box computeBounds(const Matrix& mat) const
+	{
+		const auto& p = getGeometry().m_p;
+		if (p.empty())
+			return ei::Box(Vector(0.0f), Vector(0.0f));
+
+		const ei::Box first = transformedBounds(p.data(), 1, mat);
+		return parallel::reduce(p.size(), 1 << 18, first, [&](size_t begin, size_t end)
+		{
+			return transformedBounds(p.data() + begin, end - begin, mat);
+		}, [](const ei::Box& a, const ei::Box& b) { return ei::Box(a, b); });
+	}
+
+	static ei::Box transformedBounds(const Vector* p, size_t count, const Matrix& mat)
+	{
+		assert(count > 0);
+#ifdef TRIANGLEMESH_USE_SSE
+		// columns of the affine transform: p' = c0 * x + c1 * y + c2 * z + c3
+		const __m128 c0 = _mm_setr_ps(mat(0, 0), mat(1, 0), mat(2, 0), 0.0f);
+		const __m128 c1 = _mm_setr_ps(mat(0, 1), mat(1, 1), mat(2, 1), 0.0f);
+		const __m128 c2 = _mm_setr_ps(mat(0, 2), mat(1, 2), mat(2, 2), 0.0f);
+		const __m128 c3 = _mm_setr_ps(mat(0, 3), mat(1, 3), mat(2, 3), 0.0f);
+		__m128 bmin = _mm_set1_ps(INFINITY);
+		__m128 bmax = _mm_set1_ps(-INFINITY);
+		for (size_t i = 0; i < count; ++i)
+		{
+			__m128 v = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(p[i].x)));
+			v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(p[i].y)));
+			v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(p[i].z)));
+			bmin = _mm_min_ps(bmin, v);
+			bmax = _mm_max_ps(bmax, v);
+		}
+		float lo[4], hi[4];
+		_mm_storeu_ps(lo, bmin);
+		_mm_storeu_ps(hi, bmax);
+		return ei::Box(Vector(lo[0], lo[1], lo[2]), Vector(hi[0], hi[1], hi[2]));
+#else
+		Vector bmin = transformPoint(p[0], mat);
+		Vector bmax = bmin;
+		for (size_t i = 1; i < count; ++i)
+		{
+			const Vector v = transformPoint(p[i], mat);
+			bmin = ei::min(bmin, v);
+			bmax = ei::max(bmax, v);
+		}
+		return ei::Box(bmin, bmax);
+#endif
+	}
+
 	static void copyToVec2(std::vector<ei::Vec2>& dst, std::vector<float>& src)
 	{
 		dst.assign(src.size() / 2, ei::Vec2(0.0f));
 		memcpy(dst.data(), src.data(), dst.size() * sizeof(dst[0]));
 	}
-	void verifyData(bool nothrow)
+	// indicesVerified: the loader already checked the index range (e.g. Plymesh)
+	void verifyData(bool nothrow, bool indicesVerified = false)
 	{
 		if (!m_geom->m_p.size())
 			throw PbrtMissingParameter("vertex");
@@ -117,9 +456,8 @@ protected:
 		}
 
 		// test indices
-		for (const auto& i : m_geom->m_indices)
-			if (i < 0 || i >= m_geom->m_indices.size())
-				throw std::exception("trianglemesh has out of-bounds indices");
+		if (!indicesVerified && size_t(getMaxIndex(m_geom->m_indices)) >= m_geom->m_p.size())
+			throw std::exception("trianglemesh has out of-bounds indices");
 
 		if (m_geom->m_n.size())
 		{
@@ -130,29 +468,82 @@ protected:
 		else if(System::args.has("autoflat"))
 		{
 			makeFlatNormals();
-			verifyData(nothrow);
+			verifyData(nothrow, true);
 		}
+		m_geom->updateMemory();
+	}
+
+	static unsigned getMaxIndex(const std::vector<int>& idx)
+	{
+		return parallel::reduce(idx.size(), 1 << 20, 0u,
+			[&idx](size_t begin, size_t end) { return maxIndex(idx.data() + begin, end - begin); },
+			[](unsigned a, unsigned b) { return std::max(a, b); });
+	}
+	// largest index as unsigned value. Negative indices are mapped to huge values
+	// so a single max reduction checks both bounds
+	static unsigned maxIndex(const int* idx, size_t count)
+	{
+		size_t i = 0;
+		unsigned res = 0;
+#if defined(__SSE4_1__) || defined(__AVX__)
+		__m128i m = _mm_setzero_si128();
+		for (; i + 4 <= count; i += 4)
+			m = _mm_max_epu32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(idx + i)));
+		m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+		res = unsigned(_mm_cvtsi128_si32(m));
+#else
+		// independent accumulators without branches can be vectorized by the compiler
+		unsigned acc[4] = { 0, 0, 0, 0 };
+		for (; i + 4 <= count; i += 4)
+			for (size_t j = 0; j < 4; ++j)
+				acc[j] = std::max(acc[j], unsigned(idx[i + j]));
+		res = std::max(std::max(acc[0], acc[1]), std::max(acc[2], acc[3]));
+#endif
+		for (; i < count; ++i)
+			res = std::max(res, unsigned(idx[i]));
+		return res;
+	}
+
+	// normalized surface normals of all faces (zero for degenerate faces).
+	// the normals of the vertices are not touched, so face ranges can run in parallel
+	std::vector<ei::Vec3> getFaceNormals() const
+	{
+		const auto& idx = m_geom->m_indices;
+		const auto& p = m_geom->m_p;
+		std::vector<ei::Vec3> normals(idx.size() / 3);
+		parallel::forRange(normals.size(), 1 << 14, [&](size_t begin, size_t end)
+		{
+			for (size_t f = begin; f < end; ++f)
+			{
+				// 1 - 0, 2 - 0
+				const int* v = idx.data() + 3 * f;
+				auto n = ei::cross(p[v[1]] - p[v[0]], p[v[2]] - p[v[0]]);
+				normals[f] = lensq(n) == 0.0f ? ei::Vec3(0.0f) : ei::normalize(n);
+			}
+		});
+		return normals;
 	}
 
 	void makeFlatNormals()
 	{
+		profiler::ScopedTimer timer(profiler::Phase::Normals);
 		System::warning("missing normals, making flat ones");
 		auto& idx = m_geom->m_indices;
 		m_geom->m_n.resize(m_geom->m_p.size());
 		// keep track of used edges
 		std::vector<bool> used;
 		used.assign(m_geom->m_p.size(),false);
+		const auto faceNormals = getFaceNormals();
 
 		for (int i = 0; i < m_geom->m_indices.size(); i += 3)
 		{
-
-			auto flatNormal = ei::cross(m_geom->m_p[idx[i + 1]] - m_geom->m_p[idx[i]], m_geom->m_p[idx[i + 2]] - m_geom->m_p[idx[i]]);
+			const auto flatNormal = faceNormals[i / 3];
 			if (lensq(flatNormal) == 0.0f)
 			{
 				// not visible..
 				continue;
 			}
-			flatNormal = ei::normalize(flatNormal);
 
 			for(int j = 0; j < 3; ++j)
 			{
@@ -192,21 +583,20 @@ protected:
 
 	void flatNormalEdge(float angle)
 	{
+		profiler::ScopedTimer timer(profiler::Phase::Normals);
 		System::warning("flatting edge normals");
 		// keep track of used vertices
 		std::vector<bool> used;
 		used.assign(m_geom->m_p.size(),false);
 
 		auto& idx = m_geom->m_indices;
+		const auto faceNormals = getFaceNormals();
 		for(int i = 0; i < m_geom->m_indices.size(); i += 3)
 		{
-			// calculate surface normal
-			// 1 - 0, 2 - 0
-			auto flatNormal = (ei::cross(m_geom->m_p[idx[i + 1]] - m_geom->m_p[idx[i]], m_geom->m_p[idx[i + 2]] - m_geom->m_p[idx[i]]));
+			auto flatNormal = faceNormals[i / 3];
 			if(lensq(flatNormal) == 0)
 				continue;
 
-			flatNormal = normalize(flatNormal);
 			// is surface normal pointing in the right direction?
 			float d[3];
 			d[0] = ei::dot(m_geom->m_n[idx[i]], flatNormal);
@@ -281,6 +671,13 @@ protected:
 		}
 	}
 protected:
+	// geometry with the arrays loaded from the spill file if necessary
+	CoreGeometry& getGeometry() const
+	{
+		m_geom->restore();
+		return *m_geom;
+	}
+
 	std::shared_ptr<CoreGeometry> m_geom;
 	Matrix m_trans;
 };
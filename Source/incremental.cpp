@@ -0,0 +1,333 @@
+#include "incremental.h"
+#include "command_stream.h"
+#include "system.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using incremental::Kind;
+using incremental::Session;
+
+namespace
+{
+	thread_local Session* s_session = nullptr;
+
+	const char* const KIND_NAMES[] = { "scene", "ply", "spectrum", "asset" };
+
+	bool getKind(const std::string& name, Kind& kind)
+	{
+		for (size_t i = 0; i < sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]); ++i)
+		{
+			if (name == KIND_NAMES[i])
+			{
+				kind = Kind(i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool getFileInfo(const std::string& filename, long long& size, long long& mtime)
+	{
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0)
+			return false;
+		size = (long long)info.st_size;
+		mtime = (long long)info.st_mtime;
+		return true;
+	}
+
+	std::string toHex(uint64_t value)
+	{
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+		return buffer;
+	}
+
+	void makeDirectory(const std::string& dir)
+	{
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+
+	// options that change the tokenization: spectrum files are resolved against the scene directory or,
+	// with --dirhierarchy, against the directory of the pbrt file
+	int getTokenizeOptions()
+	{
+		return System::args.get("dirhierarchy", false) ? 1 : 0;
+	}
+
+	// spectra are recorded once per pbrt file because they invalidate its stream
+	std::string getRecordKey(Kind kind, const std::string& filename, const std::string& parent)
+	{
+		return kind == Kind::Spectrum ? filename + '\n' + parent : filename;
+	}
+}
+
+bool incremental::hashFile(const std::string& filename, uint64_t& hash)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file)
+		return false;
+	Hasher h;
+	std::vector<char> buffer(1 << 20);
+	size_t count;
+	while ((count = fread(buffer.data(), 1, buffer.size(), file)) != 0)
+		h.add(buffer.data(), count);
+	fclose(file);
+	hash = h.get();
+	return true;
+}
+
+Session::Session(const std::string& output)
+	:
+m_output(output)
+{
+	std::ifstream file(output + ".deps");
+	std::string line;
+	if (!file.is_open() || !std::getline(file, line))
+		return;
+
+	// pbrtdeps [version] [time of the conversion] [tokenize options]. Streams of other options are not reused
+	std::istringstream header(line);
+	std::string magic;
+	int version = 0, options = -1;
+	if (!(header >> magic >> version >> m_previousTime >> options) || magic != "pbrtdeps" || version != 2
+		|| options != getTokenizeOptions())
+	{
+		m_previousTime = 0;
+		return;
+	}
+
+	// kind, hash, size, mtime, path, parent (separated by tabs)
+	while (std::getline(file, line))
+	{
+		std::vector<std::string> fields;
+		std::istringstream columns(line);
+		std::string field;
+		while (std::getline(columns, field, '\t'))
+			fields.push_back(field);
+		if (fields.size() < 5)
+			continue;
+
+		Record r;
+		if (!getKind(fields[0], r.kind))
+			continue;
+		r.hash = std::stoull(fields[1], nullptr, 16);
+		r.size = std::stoll(fields[2]);
+		r.mtime = std::stoll(fields[3]);
+		r.parent = fields.size() > 5 ? fields[5] : "";
+		if (r.kind == Kind::Spectrum)
+			m_spectra[r.parent].push_back(fields[4]);
+		m_previous[fields[4]] = r;
+	}
+}
+
+Session::~Session()
+{
+	if (s_session == this)
+		s_session = nullptr;
+}
+
+Session* Session::getCurrent()
+{
+	return s_session;
+}
+
+Session::Scope::Scope(Session* session)
+	:
+m_previous(s_session)
+{
+	s_session = session;
+}
+
+Session::Scope::~Scope()
+{
+	s_session = m_previous;
+}
+
+void Session::addFile(Kind kind, const std::string& filename)
+{
+	const std::string parent = m_stack.size() ? m_stack.back() : "";
+	if (m_index.count(getRecordKey(kind, filename, parent)))
+		return;
+
+	// missing files are reported by the reader
+	Record r = { kind, 0, 0, 0, parent };
+	if (!getFileInfo(filename, r.size, r.mtime) || !getHash(filename, r.size, r.mtime, r.hash))
+		return;
+	add(filename, r);
+}
+
+std::shared_ptr<const CommandStream> Session::findStream(const std::string& filename, const std::string& directory)
+{
+	auto memo = m_streams.find(filename);
+	if (memo != m_streams.end())
+		return memo->second;
+
+	auto it = m_previous.find(filename);
+	if (it == m_previous.end() || it->second.kind != Kind::Scene)
+		return nullptr;
+	Record r = { Kind::Scene, 0, 0, 0, m_stack.size() ? m_stack.back() : "" };
+	if (!getFileInfo(filename, r.size, r.mtime) || !getHash(filename, r.size, r.mtime, r.hash) || r.hash != it->second.hash)
+		return nullptr;
+
+	// the values of the spectra are part of the stream
+	std::vector<std::pair<std::string, Record>> spectra;
+	auto sit = m_spectra.find(filename);
+	if (sit != m_spectra.end())
+	{
+		for (const auto& spectrum : sit->second)
+		{
+			Record s = { Kind::Spectrum, 0, 0, 0, filename };
+			if (!getFileInfo(spectrum, s.size, s.mtime) || !getHash(spectrum, s.size, s.mtime, s.hash) || s.hash != m_previous[spectrum].hash)
+				return nullptr;
+			spectra.push_back(std::make_pair(spectrum, s));
+		}
+	}
+
+	auto stream = std::make_shared<CommandStream>();
+	FILE* file = fopen(getStreamFile(filename, directory).c_str(), "rb");
+	if (!file)
+		return nullptr;
+	const bool loaded = stream->load(file, r.hash);
+	fclose(file);
+	if (!loaded)
+		return nullptr;
+
+	add(filename, r);
+	for (const auto& s : spectra)
+		add(s.first, s.second);
+	++m_reused;
+	m_streams[filename] = stream;
+	return stream;
+}
+
+void Session::addStream(const std::string& filename, const std::string& directory, uint64_t hash, size_t size,
+	std::shared_ptr<const CommandStream> stream)
+{
+	// called between enter(filename) and leave()
+	if (!m_streams.insert(std::make_pair(filename, stream)).second)
+		return;
+	const std::string parent = m_stack.size() > 1 ? m_stack[m_stack.size() - 2] : "";
+	long long fileSize = 0;
+	Record r = { Kind::Scene, hash, (long long)size, 0, parent };
+	getFileInfo(filename, fileSize, r.mtime);
+	auto it = m_previous.find(filename);
+	if (it == m_previous.end() || it->second.hash != hash)
+		markChanged(filename);
+	add(filename, r);
+
+	if (!m_hasCacheDirectory)
+	{
+		makeDirectory(m_output + ".cache");
+		m_hasCacheDirectory = true;
+	}
+	// an interrupted conversion must not leave a truncated stream
+	const std::string streamFile = getStreamFile(filename, directory);
+	const std::string tempFile = streamFile + ".tmp";
+	FILE* file = fopen(tempFile.c_str(), "wb");
+	if (!file)
+	{
+		System::warning("incremental: cannot write " + streamFile);
+		return;
+	}
+	bool saved = stream->save(file, hash);
+	saved = fclose(file) == 0 && saved;
+#ifdef _WIN32
+	// rename does not replace files on windows
+	if (saved)
+		remove(streamFile.c_str());
+#endif
+	if (!saved || rename(tempFile.c_str(), streamFile.c_str()) != 0)
+	{
+		System::warning("incremental: cannot write " + streamFile);
+		remove(tempFile.c_str());
+	}
+}
+
+void Session::enter(const std::string& filename)
+{
+	m_stack.push_back(filename);
+}
+
+void Session::leave()
+{
+	m_stack.pop_back();
+}
+
+void Session::finish()
+{
+	std::ofstream file(m_output + ".deps");
+	if (!file.is_open())
+	{
+		System::error("incremental: cannot write " + m_output + ".deps");
+		return;
+	}
+	file << "pbrtdeps 2 " << (long long)time(nullptr) << ' ' << getTokenizeOptions() << "\n";
+	for (const auto& e : m_records)
+	{
+		const Record& r = e.second;
+		file << KIND_NAMES[size_t(r.kind)] << '\t' << toHex(r.hash) << '\t' << r.size << '\t' << r.mtime << '\t'
+			<< e.first << '\t' << r.parent << '\n';
+	}
+
+	size_t scenes = 0;
+	for (const auto& e : m_records)
+		if (e.second.kind == Kind::Scene)
+			++scenes;
+	if (m_previous.empty())
+	{
+		System::info("incremental: recorded " + std::to_string(m_records.size()) + " files");
+		return;
+	}
+	System::info("incremental: " + std::to_string(m_reused) + " of " + std::to_string(scenes) + " pbrt files were not parsed again, "
+		+ std::to_string(m_changed.size()) + " files changed");
+	for (const auto& c : m_changed)
+		System::info("incremental: changed " + c);
+}
+
+bool Session::getHash(const std::string& filename, long long size, long long mtime, uint64_t& hash)
+{
+	auto it = m_previous.find(filename);
+	// files that were modified in the second of the last conversion could have changed after they were hashed
+	if (it != m_previous.end() && it->second.size == size && it->second.mtime == mtime && mtime < m_previousTime)
+	{
+		hash = it->second.hash;
+		return true;
+	}
+	if (!hashFile(filename, hash))
+		return false;
+	if (it == m_previous.end() || it->second.hash != hash)
+		markChanged(filename);
+	return true;
+}
+
+void Session::markChanged(const std::string& filename)
+{
+	// everything is new in the first conversion
+	if (m_previous.size() && m_changedSet.insert(filename).second)
+		m_changed.push_back(filename);
+}
+
+void Session::add(const std::string& filename, const Record& record)
+{
+	const std::string key = getRecordKey(record.kind, filename, record.parent);
+	if (m_index.count(key))
+		return;
+	m_index[key] = m_records.size();
+	m_records.push_back(std::make_pair(filename, record));
+}
+
+std::string Session::getStreamFile(const std::string& filename, const std::string& directory) const
+{
+	const std::string key = filename + '\n' + directory;
+	return m_output + ".cache/" + toHex(incremental::hashData(key.data(), key.size())) + ".cmds";
+}
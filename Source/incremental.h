@@ -0,0 +1,173 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <ctime>
+
+class CommandStream;
+
+// incremental re-conversion (--incremental). Every file that is read during a conversion is recorded with
+// its content hash and the file that referenced it in [output].deps. The command streams of the pbrt files are
+// kept in [output].cache/ and are used instead of tokenizing a file again while neither the file nor the
+// spectra that were read during its tokenization changed.
+// The streams of all files are still replayed: the graphics state at an Include depends on everything before it,
+// so the result is always the one of a full parse.
+namespace incremental
+{
+	// 64 bit hash of the file contents (multiply and rotate over 8 byte words)
+	class Hasher
+	{
+	public:
+		void add(const void* data, size_t size)
+		{
+			const char* c = static_cast<const char*>(data);
+			m_size += size;
+			// fill the pending word first
+			while (size && m_pendingSize)
+			{
+				addByte(*c++);
+				--size;
+			}
+			for (; size >= 8; size -= 8, c += 8)
+			{
+				uint64_t w;
+				memcpy(&w, c, 8);
+				addWord(w);
+			}
+			while (size--)
+				addByte(*c++);
+		}
+		uint64_t get() const
+		{
+			uint64_t h = m_hash;
+			if (m_pendingSize)
+				h = mix(h, m_pending);
+			h ^= m_size * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDull;
+			h ^= h >> 33;
+			return h;
+		}
+	private:
+		static uint64_t mix(uint64_t h, uint64_t w)
+		{
+			h ^= w * 0x9E3779B97F4A7C15ull;
+			return ((h << 31) | (h >> 33)) * 0xBF58476D1CE4E5B9ull;
+		}
+		void addWord(uint64_t w)
+		{
+			m_hash = mix(m_hash, w);
+		}
+		void addByte(char c)
+		{
+			m_pending |= uint64_t(uint8_t(c)) << (8 * m_pendingSize);
+			if (++m_pendingSize == 8)
+			{
+				addWord(m_pending);
+				m_pending = 0;
+				m_pendingSize = 0;
+			}
+		}
+
+		uint64_t m_hash = 0xCBF29CE484222325ull;
+		uint64_t m_pending = 0;
+		size_t m_pendingSize = 0;
+		uint64_t m_size = 0;
+	};
+
+	inline uint64_t hashData(const void* data, size_t size)
+	{
+		Hasher h;
+		h.add(data, size);
+		return h.get();
+	}
+	// returns false if the file cannot be read
+	bool hashFile(const std::string& filename, uint64_t& hash);
+
+	enum class Kind
+	{
+		Scene, // pbrt file (main file and includes)
+		Ply,
+		Spectrum, // read during the tokenization, the values are part of the command stream
+		Asset // other files referenced by filename parameters (textures, bsdf files)
+	};
+
+	// dependencies and stream cache of one conversion. The session has to be bound to the
+	// thread that parses the scene (see Scope)
+	class Session
+	{
+	public:
+		// loads [output].deps of the last conversion
+		explicit Session(const std::string& output);
+		~Session();
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+
+		// session of the calling thread or nullptr
+		static Session* getCurrent();
+
+		class Scope
+		{
+		public:
+			explicit Scope(Session* session);
+			~Scope();
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			Session* m_previous;
+		};
+
+		// records a file that was read. The content is only hashed if the file changed since the last conversion
+		void addFile(Kind kind, const std::string& filename);
+		// cached stream of an unchanged pbrt file (records the file and its spectra) or nullptr.
+		// directory is the one the spectra are resolved against (like the key of the StreamCache)
+		std::shared_ptr<const CommandStream> findStream(const std::string& filename, const std::string& directory);
+		// records a tokenized pbrt file (hash of the data before the tokenization) and stores the stream in the cache
+		void addStream(const std::string& filename, const std::string& directory, uint64_t hash, size_t size,
+			std::shared_ptr<const CommandStream> stream);
+
+		// files that are recorded between enter and leave were referenced by filename
+		void enter(const std::string& filename);
+		void leave();
+
+		// writes [output].deps and reports the changed files
+		void finish();
+
+	private:
+		struct Record
+		{
+			Kind kind;
+			uint64_t hash;
+			long long size;
+			long long mtime;
+			std::string parent;
+		};
+
+		// hash of the recorded content if size and modification time did not change
+		bool getHash(const std::string& filename, long long size, long long mtime, uint64_t& hash);
+		void markChanged(const std::string& filename);
+		void add(const std::string& filename, const Record& record);
+		std::string getStreamFile(const std::string& filename, const std::string& directory) const;
+
+		std::string m_output;
+		bool m_hasCacheDirectory = false;
+		// records of the last conversion
+		std::unordered_map<std::string, Record> m_previous;
+		// spectra that were read during the tokenization of a pbrt file
+		std::unordered_map<std::string, std::vector<std::string>> m_spectra;
+		long long m_previousTime = 0;
+		// records of this conversion in the order of the first occurrence
+		std::vector<std::pair<std::string, Record>> m_records;
+		std::unordered_map<std::string, size_t> m_index;
+		// streams of this conversion (files that are included more than once)
+		std::unordered_map<std::string, std::shared_ptr<const CommandStream>> m_streams;
+		std::vector<std::string> m_stack;
+		size_t m_reused = 0;
+		std::vector<std::string> m_changed;
+		std::unordered_set<std::string> m_changedSet;
+	};
+}
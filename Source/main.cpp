@@ -7,71 +7,140 @@
 #include "DialogOpenFile.h"
 #include <chrono>
 #include "ArgumentSet.h"
+#include "geometry/Bvh.h"
+#include "geometry/Tessellation.h"
+#include "profiler.h"
+#include "parallel.h"
+#include "server.h"
+#include "incremental.h"
+#include "prefetch.h"
+#include "memory.h"
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <sys/stat.h>
 
 const auto g_helpstring = 
 "arguments: input_pbrt output [optional args]\n" \
+"       or: --batch listfile [optional args]\n" \
+"       or: --daemon socket [optional args]\n" \
+"       or: --connect socket input_pbrt output [optional args] (or --connect socket --stop)\n" \
 "e.g.: scenes/book.pbrt converted/book --pause\n"\
 "optional arguments:\n"\
+"		--batch [listfile] (converts the scenes of the list file, one \"input_pbrt output\" pair per line, # starts a comment.\n"\
+"			the scenes share one thread pool and the asset caches, the largest files are started first)\n"\
+"		--daemon [socket] (stays resident and converts the jobs sent with --connect over the unix domain socket. The asset caches stay warm between the jobs.\n"\
+"			the optional args of a job are the ones given to --connect, --membudget, --stats and --trace belong to the daemon)\n"\
+"		--connect [socket] (sends the conversion to a daemon and prints its messages. --stop shuts the daemon down)\n"\
 "		--pause (programm will pause after execution)\n"\
-"		--noconvert (this will just try to read the file without converting)\n"\
+"		--noconvert (this will just read the file and check shapes and materials. The vertex arrays of meshes are only checked by their size)\n"\
 "		--uiselect (this will ignore the input file and will let you choose the file via ui)\n"\
 "		--errpause (this will pause after an error occured)\n"\
 "		--silent (this will supress warnings, infos and runtime infos during conversion)\n"\
 "		--dirhierarchy (assumes that filepaths are relative to the current .pbrt file)\n"\
 "		--swapaxis [a1] [a2] ([a1] [a2]...) (swaps to the given axis: --swapaxis x z)\n"\
 "       --autoedge [degree] uses the triangle normal for a vertex if the angle between triangle vertex and proposed normal is bigger than [degree]"\
-"       --autoflat creates flat normals for a model if no normals are present";
+"       --autoflat creates flat normals for a model if no normals are present\n"\
+"		--compact (mesh sizes are estimated for the compact layout of TriangleMesh::compact: 16 bit indices, octahedral normals/tangents.\n"\
+"			this only affects the memory budget decisions, exporters have to call compact())\n"\
+"		--quantize (together with --compact: the estimate assumes positions quantized to 16 bit within the mesh bounding box)\n"\
+"		--tessellate [tolerance] (replaces analytic shapes by triangle meshes with the given world space tolerance, default 0.01)\n"\
+"		--decimate [tolerance] (heightfields: merges blocks whose heights deviate at most [tolerance] from a plane, default 0)\n"\
+"		--bvh (builds a two level bvh over the scene shapes and saves it as [output].bvh)\n"\
+"		--stats [file] (prints time spent per conversion phase and counters, optionally saved as json to [file])\n"\
+"		--trace [file] (records parsing, shape and post processing events of all threads as chrome trace json in [file])\n"\
+"		--incremental (records the files of the conversion in [output].deps and keeps the parsed pbrt files in [output].cache. Unchanged files are not parsed again in the next conversion)\n"\
+"		--noprefetch (included, ply and spectrum files are read when the parser reaches them instead of being read ahead)\n"\
+"		--membudget [MB] (meshes are moved to a temporary spill file in TMPDIR above this budget, default 3/4 of the available memory)";
 
+const char* g_decoLine = "*----------------------------------*\n";
+
+bool convertScene(const std::string& sceneFile, const std::string& output);
+bool runBatch(const std::string& listFile);
 void handleSwapAxisParam(const std::vector<std::string>& axis);
 void doAxisSwap(PbrtScene& scene);
+void buildBvh(PbrtScene& scene, const std::string& output);
+void tessellateShapes(PbrtScene& scene, float tolerance);
 
 int main(int argc, char** argv)
 {
-	const char* decoLine = "*----------------------------------*\n";
+	int result = 0;
 	try
 	{
 		System::init();
+		const std::string mode = argc >= 2 ? argv[1] : "";
+		const bool batch = mode == "--batch";
+		const bool daemon = mode == "--daemon";
+		if (mode == "--connect")
+		{
+			// client of the daemon: the job is the rest of the command line
+			if (argc < 4 || (argc < 5 && std::string(argv[3]) != "--stop"))
+			{
+				System::error("insufficient arguments, please provide the socket + input file + output file name");
+				System::runtimeInfo(g_helpstring);
+				return 1;
+			}
+			std::vector<std::string> job(argv + 3, argv + argc);
+			if (job[0] == "--stop")
+				job = { "stop" };
+			const bool success = server::submit(argv[2], job);
+			System::displayErrors();
+			return success ? 0 : 1;
+		}
 		if (argc < 3)
 		{
-			System::error("insufficient arguments, please provide input file + output file name");
+			if (batch)
+				System::error("insufficient arguments, please provide the list file");
+			else if (daemon)
+				System::error("insufficient arguments, please provide the socket");
+			else
+				System::error("insufficient arguments, please provide input file + output file name");
 			System::runtimeInfo(g_helpstring);
 			return 1;
 		}
 
-		System::args.init(argc - 2, argv + 2);
+		// the list file and the socket are arguments of --batch and --daemon
+		if (batch || daemon)
+			System::args.init(argc - 1, argv + 1);
+		else
+			System::args.init(argc - 2, argv + 2);
 		System::argSilent = System::args.has("silent");
+		profiler::setEnabled(System::args.has("stats"));
+		if (System::args.has("trace"))
+		{
+			if (System::args.get<std::string>("trace", "true") == "true")
+				System::error("--trace requires a filename");
+			else profiler::startTrace();
+		}
 		std::cerr << std::boolalpha; // output bools as true or false
 
-		if (System::args.has("swapaxis"))
-			handleSwapAxisParam(System::args.getVector<std::string>("swapaxis"));
-
-		System::setOutputDirectory(argv[2]);
-
-		std::string sceneFile = argv[1];
-		if(System::args.has("uiselect"))
+		if (batch)
 		{
-			DialogOpenFile dlg = DialogOpenFile("pbrt");
-			dlg.Show();
-			if(dlg.IsSuccess())
-			{
-				sceneFile = dlg.GetName();
-			}
+			if (!runBatch(System::args.get<std::string>("batch", "")))
+				result = 1;
 		}
-
-		PbrtScene pbrtScene;
-		
-		std::cerr << decoLine << "INFO parsing scene\n" << decoLine;
-		if(parseFile(sceneFile, pbrtScene, "") && !System::args.has("noconvert"))
+		else if (daemon)
 		{
-			// swap axis for scene geomentry if required
-			if (System::hasAxisSwap())
-				doAxisSwap(pbrtScene);
-
-			// TODO convert to your own scene format here
-			// pbrtScene: c++ scene description
-			// argv[2] destination filename
+			if (!server::run(System::args.get<std::string>("daemon", ""), convertScene))
+				result = 1;
+		}
+		else
+		{
+			std::string sceneFile = argv[1];
+			if(System::args.has("uiselect"))
+			{
+				DialogOpenFile dlg = DialogOpenFile("pbrt");
+				dlg.Show();
+				if(dlg.IsSuccess())
+				{
+					sceneFile = dlg.GetName();
+				}
+			}
 
-			std::cerr << decoLine << "INFO finished converting\n" << decoLine;
+			std::cerr << g_decoLine << "INFO parsing scene\n" << g_decoLine;
+			if (convertScene(sceneFile, argv[2]) && !System::args.has("noconvert"))
+				std::cerr << g_decoLine << "INFO finished converting\n" << g_decoLine;
 		}
 	}
 	catch(const std::exception& e)
@@ -79,15 +148,158 @@ int main(int argc, char** argv)
 		std::cout << e.what() << std::endl;
 	}
 
-	std::cerr << decoLine << "INFO SUMMARY\n" << decoLine;
+	std::cerr << g_decoLine << "INFO SUMMARY\n" << g_decoLine;
 	System::displayErrors();
 	System::displayWarnings();
 	System::displayInfos();
+	profiler::displaySummary();
+	if (profiler::isEnabled())
+	{
+		const auto statsFile = System::args.get<std::string>("stats", "true");
+		if (statsFile != "true" && !profiler::saveJson(statsFile))
+			System::error("cannot write statistics to " + statsFile);
+	}
+	if (profiler::g_tracing)
+	{
+		const auto traceFile = System::args.get<std::string>("trace", "");
+		if (!profiler::saveTrace(traceFile))
+			System::error("cannot write trace to " + traceFile);
+	}
 
 	if (System::args.has("pause"))
 		system("pause");
 
-	return 0;
+	return result;
+}
+
+// converts one scene in the system context of the calling thread. Returns false if the scene could not be parsed
+bool convertScene(const std::string& sceneFile, const std::string& output)
+{
+	if (System::args.has("swapaxis"))
+		handleSwapAxisParam(System::args.getVector<std::string>("swapaxis"));
+
+	System::setOutputDirectory(output);
+	memory::updateBudget();
+
+	std::unique_ptr<incremental::Session> session;
+	if (System::args.has("incremental"))
+		session.reset(new incremental::Session(output));
+	incremental::Session::Scope sessionScope(session.get());
+
+	PbrtScene pbrtScene;
+	{
+		// files that are referenced by the scene are read ahead of the parser
+		std::unique_ptr<prefetch::Reader> reader;
+		if (!System::args.has("noprefetch"))
+			reader.reset(new prefetch::Reader());
+		prefetch::Reader::Scope readerScope(reader.get());
+		if (!parseFile(sceneFile, pbrtScene, ""))
+			return false;
+	}
+	if (session)
+		session->finish();
+	if (System::args.has("noconvert"))
+		return true;
+
+	// swap axis for scene geomentry if required
+	if (System::hasAxisSwap())
+		doAxisSwap(pbrtScene);
+
+	if (System::args.has("tessellate"))
+		tessellateShapes(pbrtScene, tessellation::getTolerance());
+
+	if (System::args.has("bvh"))
+		buildBvh(pbrtScene, output);
+
+	// TODO convert to your own scene format here
+	// pbrtScene: c++ scene description
+	// output: destination filename
+	return true;
+}
+
+struct BatchJob
+{
+	std::string input;
+	std::string output;
+	long long size;
+};
+
+// converts every scene of the list file on the work stealing pool. Every scene has its own system context,
+// the caches of the parser and the ply loader are shared. Returns false if a scene failed
+bool runBatch(const std::string& listFile)
+{
+	std::ifstream file(listFile);
+	if (!file.is_open())
+	{
+		System::error("cannot open batch file " + listFile);
+		return false;
+	}
+
+	std::vector<BatchJob> jobs;
+	std::string line;
+	for (size_t lineNum = 1; std::getline(file, line); ++lineNum)
+	{
+		std::istringstream words(line);
+		BatchJob job;
+		if (!(words >> job.input) || job.input[0] == '#')
+			continue;
+		if (!(words >> job.output))
+		{
+			System::error("batch file " + listFile + " line " + std::to_string(lineNum) + ": missing output");
+			continue;
+		}
+		// the scene size is only known after parsing, the file size is a good estimate
+		struct stat info;
+		job.size = stat(job.input.c_str(), &info) == 0 ? (long long)info.st_size : 0;
+		jobs.push_back(job);
+	}
+	// the biggest scenes start first so that they do not end up as the last long running jobs
+	std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b)
+	{
+		return a.size > b.size;
+	});
+	System::runtimeInfo("batch: converting " + std::to_string(jobs.size()) + " scenes");
+
+	parallel::Pool::instance().start(parallel::getThreadCount());
+	parallel::TaskGroup group;
+	std::mutex summaryMutex;
+	size_t finished = 0;
+	size_t failed = 0;
+	for (const auto& job : jobs)
+	{
+		const BatchJob* j = &job;
+		group.run([j, &jobs, &summaryMutex, &finished, &failed]()
+		{
+			System::Context context;
+			System::ContextScope scope(context);
+			bool success = false;
+			try
+			{
+				success = convertScene(j->input, j->output);
+			}
+			catch (const std::exception& e)
+			{
+				System::error(e.what());
+			}
+			// errors of the replay do not stop the conversion
+			success = success && System::getErrorCount() == 0;
+
+			std::lock_guard<std::mutex> lock(summaryMutex);
+			++finished;
+			if (!success)
+				++failed;
+			std::cerr << g_decoLine << "INFO " << (success ? "converted " : "FAILED ") << j->input << " -> " << j->output
+				<< " (" << finished << "/" << jobs.size() << ")\n" << g_decoLine;
+			System::displayErrors();
+			System::displayWarnings();
+			System::displayInfos();
+		});
+	}
+	group.wait();
+
+	if (failed)
+		System::error("batch: " + std::to_string(failed) + " of " + std::to_string(jobs.size()) + " scenes failed");
+	return failed == 0;
 }
 
 void handleSwapAxisParam(const std::vector<std::string>& args)
@@ -117,6 +329,7 @@ void handleSwapAxisParam(const std::vector<std::string>& args)
 
 void doAxisSwap(PbrtScene& scene)
 {
+	profiler::ScopedTimer timer(profiler::Phase::AxisSwap);
 	System::info("swapping axis");
 
 	for (auto& o : scene.getRenderOptions().shapes)
@@ -132,4 +345,60 @@ void doAxisSwap(PbrtScene& scene)
 
 	scene.getRenderOptions().cameraLookAt = Shape::transformPoint(scene.getRenderOptions().cameraLookAt, System::getAxisSwap());
 	scene.getRenderOptions().cameraPos = Shape::transformPoint(scene.getRenderOptions().cameraPos, System::getAxisSwap());
-}
\ No newline at end of file
+}
+
+void buildBvh(PbrtScene& scene, const std::string& output)
+{
+	profiler::ScopedTimer timer(profiler::Phase::Bvh);
+	System::info("building bvh");
+	scene.checkMemoryBudget(true);
+	const auto& accel = scene.getRenderOptions().accelerator;
+	if (accel.type.length() && accel.type != "bvh")
+		System::warning("scene requests accelerator " + accel.type + ". building bvh anyways");
+	const int maxPrims = accel.set.getInt("maxnodeprims", 4);
+
+	SceneBvh bvh;
+	bvh.build(scene.getRenderOptions().shapes, size_t(std::max(maxPrims, 1)));
+	bvh.save(output + ".bvh");
+	System::info("bvh: " + std::to_string(bvh.getNodeCount()) + " nodes, " + std::to_string(bvh.getLeafCount()) + " leafs ("
+		+ std::to_string(bvh.getBottomLevels().size()) + " bottom level) built in " + std::to_string(bvh.getBuildTime()) + " ms");
+}
+
+void tessellateShapes(PbrtScene& scene, float tolerance)
+{
+	profiler::ScopedTimer timer(profiler::Phase::Tessellate);
+	System::info("tessellating shapes");
+	auto& shapes = scene.getRenderOptions().shapes;
+	std::vector<char> tessellated(shapes.size());
+	// the new meshes are spilled between the blocks if they exceed the memory budget
+	const size_t blockSize = std::max(size_t(4096), shapes.size() / 16);
+	for (size_t block = 0; block < shapes.size(); block += blockSize)
+	{
+		parallel::forRange(std::min(blockSize, shapes.size() - block), 64, [&](size_t begin, size_t end)
+		{
+			for (size_t i = block + begin; i < block + end; ++i)
+			{
+				std::unique_ptr<Shape> mesh(shapes[i]->tessellate(tolerance));
+				if (mesh)
+				{
+					shapes[i] = std::move(mesh);
+					tessellated[i] = 1;
+				}
+			}
+		});
+		scene.checkMemoryBudget(true);
+	}
+	size_t count = 0;
+	std::unordered_set<const void*> geometries;
+	for (size_t i = 0; i < shapes.size(); ++i)
+	{
+		if (!tessellated[i])
+			continue;
+		++count;
+		const auto mesh = dynamic_cast<const TriangleMesh*>(shapes[i].get());
+		if (mesh)
+			geometries.insert(mesh->getGeometryId());
+	}
+	System::info("tessellated " + std::to_string(count) + " shapes into "
+		+ std::to_string(geometries.size()) + " distinct meshes");
+}
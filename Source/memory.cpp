@@ -0,0 +1,173 @@
+#include "memory.h"
+#include "system.h"
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <unistd.h>
+#endif
+
+static std::atomic<int64_t> s_used[size_t(memory::Category::SIZE)];
+
+void memory::add(Category category, int64_t bytes)
+{
+	s_used[size_t(category)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t memory::getUsed(Category category)
+{
+	return size_t(std::max(s_used[size_t(category)].load(std::memory_order_relaxed), int64_t(0)));
+}
+
+size_t memory::getUsed()
+{
+	size_t sum = 0;
+	for (size_t i = 0; i < size_t(Category::SIZE); ++i)
+		sum += getUsed(Category(i));
+	return sum;
+}
+
+static std::atomic<size_t> s_budget(0);
+
+size_t memory::getBudget()
+{
+	if (s_budget.load(std::memory_order_relaxed) == 0)
+		updateBudget();
+	return s_budget.load(std::memory_order_relaxed);
+}
+
+void memory::updateBudget()
+{
+	// --membudget belongs to the process (not to a daemon job)
+	const int mb = System::args.getMain().get("membudget", 0);
+	const size_t budget = mb > 0 ? size_t(mb) * 1024 * 1024 : (System::getAvailableRam() + getUsed()) / 4 * 3;
+	s_budget.store(std::max(budget, size_t(1)), std::memory_order_relaxed);
+}
+
+static void seek(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	_fseeki64(file, int64_t(offset), SEEK_SET);
+#else
+	fseeko(file, off_t(offset), SEEK_SET);
+#endif
+}
+
+memory::SpillFile::SpillFile(const std::string& directory)
+{
+#ifdef _WIN32
+	// D: deleted when the last handle is closed
+	char* name = _tempnam(directory.c_str(), "pbrtspill");
+	if (name)
+	{
+		m_file = fopen(name, "w+bD");
+		free(name);
+	}
+#else
+	std::string name = directory + "pbrtconverter-XXXXXX";
+	const int fd = mkstemp(&name[0]);
+	if (fd != -1)
+	{
+		// the data stays accessible through the descriptor
+		unlink(name.c_str());
+		m_file = fdopen(fd, "w+b");
+		if (!m_file)
+			close(fd);
+	}
+#endif
+	if (!m_file)
+		throw std::exception(("cannot create a spill file in " + directory).c_str());
+}
+
+memory::SpillFile::~SpillFile()
+{
+	fclose(m_file);
+}
+
+uint64_t memory::SpillFile::allocate(uint64_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// first fit
+	for (auto it = m_free.begin(); it != m_free.end(); ++it)
+	{
+		if (it->second < size)
+			continue;
+		const uint64_t offset = it->first;
+		const uint64_t rest = it->second - size;
+		m_free.erase(it);
+		if (rest)
+			m_free[offset + size] = rest;
+		return offset;
+	}
+	const uint64_t offset = m_size;
+	m_size += size;
+	return offset;
+}
+
+void memory::SpillFile::release(uint64_t offset, uint64_t size)
+{
+	if (size == 0)
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto next = m_free.lower_bound(offset);
+	if (next != m_free.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			size += prev->second;
+			m_free.erase(prev);
+		}
+	}
+	if (next != m_free.end() && offset + size == next->first)
+	{
+		size += next->second;
+		m_free.erase(next);
+	}
+	// the end of the file is allocated again from m_size
+	if (offset + size == m_size)
+		m_size = offset;
+	else
+		m_free[offset] = size;
+}
+
+void memory::SpillFile::write(uint64_t offset, const void* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	seek(m_file, offset);
+	if (fwrite(data, 1, size, m_file) != size)
+		throw std::exception("cannot write to the spill file");
+}
+
+void memory::SpillFile::read(uint64_t offset, void* dst, size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	seek(m_file, offset);
+	if (fread(dst, 1, size, m_file) != size)
+		throw std::exception("cannot read from the spill file");
+}
+
+memory::SpillFile& memory::getSpillFile()
+{
+	// never destroyed: cached geometry may release its extents during the static destruction.
+	// The operating system deletes the file with the process
+	static SpillFile* file = []()
+	{
+		const char* tmp = getenv("TMPDIR");
+#ifdef _WIN32
+		if (!tmp)
+			tmp = getenv("TEMP");
+		std::string dir = tmp ? tmp : ".";
+#else
+		std::string dir = tmp ? tmp : "/tmp";
+#endif
+		if (dir.size() && dir.back() != '/' && dir.back() != '\\')
+			dir += '/';
+		return new SpillFile(dir);
+	}();
+	return *file;
+}
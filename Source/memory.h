@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <cstdio>
+#include <map>
+
+// accounting of the large allocations (geometry, parameter lists, textures) and the memory budget (--membudget)
+namespace memory
+{
+	enum class Category
+	{
+		Geometry, // vertex and index arrays of triangle meshes
+		ParamSet, // parameter arrays
+		Texture,
+		SIZE
+	};
+
+	// bytes < 0 releases memory
+	void add(Category category, int64_t bytes);
+	size_t getUsed(Category category);
+	size_t getUsed();
+	// --membudget [MB] or 3/4 of the memory that was available at the last updateBudget()
+	size_t getBudget();
+	// computes the budget again (at the start of every conversion, the daemon runs for a long time)
+	void updateBudget();
+
+	// counts sizeof(TOwner) for the lifetime of the owner (use as member)
+	template<Category C, class TOwner>
+	class Counted
+	{
+	public:
+		Counted()
+		{
+			add(C, int64_t(sizeof(TOwner)));
+		}
+		Counted(const Counted&)
+			: Counted()
+		{}
+		Counted& operator=(const Counted&)
+		{
+			return *this;
+		}
+		~Counted()
+		{
+			add(C, -int64_t(sizeof(TOwner)));
+		}
+	};
+
+	// temporary file for spilled data with a unique name in directory. The file is deleted when it is closed
+	// or the process ends. Released extents are reused by the next allocations
+	class SpillFile
+	{
+	public:
+		explicit SpillFile(const std::string& directory);
+		~SpillFile();
+		SpillFile(const SpillFile&) = delete;
+		SpillFile& operator=(const SpillFile&) = delete;
+
+		// returns the offset of an extent of size bytes
+		uint64_t allocate(uint64_t size);
+		void release(uint64_t offset, uint64_t size);
+		void write(uint64_t offset, const void* data, size_t size);
+		void read(uint64_t offset, void* dst, size_t size);
+		uint64_t getSize() const
+		{
+			return m_size;
+		}
+	private:
+		std::mutex m_mutex;
+		FILE* m_file = nullptr;
+		uint64_t m_size = 0;
+		// offset -> size of the released extents (adjacent extents are merged)
+		std::map<uint64_t, uint64_t> m_free;
+	};
+
+	// spill file of the process in the temp directory (created on first use)
+	SpillFile& getSpillFile();
+}
@@ -0,0 +1,383 @@
+#pragma once
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <exception>
+#include "system.h"
+
+// minimal helpers to split loops over all hardware threads
+namespace parallel
+{
+	inline size_t getThreadCount()
+	{
+		static const size_t count = std::max(1u, std::thread::hardware_concurrency());
+		return count;
+	}
+
+	// true if the calling thread already works on a parallel region (nested regions run serially)
+	inline bool& isWorkerThread()
+	{
+		static thread_local bool worker = false;
+		return worker;
+	}
+
+	/**
+	 * \brief work stealing pool of the batch mode. Every worker owns a deque: tasks submitted by a worker
+	 *        are pushed to its deque and taken back lifo, idle workers take jobs from the shared queue
+	 *        (tasks submitted from other threads) or steal the oldest task of another worker
+	 */
+	class Pool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		static Pool& instance()
+		{
+			static Pool pool;
+			return pool;
+		}
+
+		~Pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (auto& t : m_threads)
+				t.join();
+		}
+
+		// starts the workers (only the first call has an effect)
+		void start(size_t numThreads)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_threads.size())
+				return;
+			numThreads = std::max(numThreads, size_t(1));
+			for (size_t i = 0; i < numThreads; ++i)
+				m_workers.emplace_back(new Worker());
+			for (size_t i = 0; i < numThreads; ++i)
+				m_threads.emplace_back(&Pool::workerLoop, this, int(i));
+		}
+
+		// index of the calling worker or -1
+		static int& workerIndex()
+		{
+			static thread_local int index = -1;
+			return index;
+		}
+		static bool isWorker()
+		{
+			return workerIndex() >= 0;
+		}
+
+		// the task must not throw
+		void submit(Task task)
+		{
+			const int index = workerIndex();
+			if (index >= 0)
+			{
+				std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+				m_workers[index]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (index < 0)
+					m_jobs.push_back(std::move(task));
+				++m_queued;
+			}
+			m_wake.notify_one();
+		}
+
+		// runs one task of the worker deques (own deque first). Whole jobs are not started
+		// because the caller is waiting for its sub tasks. Returns false if nothing was found
+		bool runSubTask()
+		{
+			Task task;
+			if (!takeTask(task, false))
+				return false;
+			task();
+			return true;
+		}
+
+	private:
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		bool takeTask(Task& task, bool jobs)
+		{
+			const int index = workerIndex();
+			bool found = false;
+			if (index >= 0)
+			{
+				auto& own = *m_workers[index];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (own.tasks.size())
+				{
+					task = std::move(own.tasks.back());
+					own.tasks.pop_back();
+					found = true;
+				}
+			}
+			if (!found && jobs)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_jobs.size())
+				{
+					task = std::move(m_jobs.front());
+					m_jobs.pop_front();
+					found = true;
+				}
+			}
+			for (size_t i = 1; !found && i <= m_workers.size(); ++i)
+			{
+				auto& victim = *m_workers[(size_t(index + 1) + i - 1) % m_workers.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.tasks.size())
+				{
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					found = true;
+				}
+			}
+			if (found)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				--m_queued;
+			}
+			return found;
+		}
+
+		void workerLoop(int index)
+		{
+			workerIndex() = index;
+			while (true)
+			{
+				Task task;
+				if (takeTask(task, true))
+				{
+					task();
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+				if (m_stop && m_queued == 0)
+					return;
+			}
+		}
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::vector<std::thread> m_threads;
+		// guarded by m_mutex
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::deque<Task> m_jobs;
+		size_t m_queued = 0;
+		bool m_stop = false;
+	};
+
+	/**
+	 * \brief tasks on the pool that can be waited for. The tasks run in the system context of the caller of run()
+	 */
+	class TaskGroup
+	{
+	public:
+		TaskGroup() = default;
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		template <class F>
+		void run(F func)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++m_pending;
+			}
+			System::Context& context = System::getContext();
+			Pool::instance().submit([this, func, &context]()
+			{
+				System::ContextScope scope(context);
+				std::exception_ptr error;
+				try
+				{
+					func();
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (error && !m_error)
+					m_error = error;
+				if (--m_pending == 0)
+					m_done.notify_all();
+			});
+		}
+
+		// waits for all tasks and rethrows the first exception. Workers help with sub tasks while waiting
+		void wait()
+		{
+			if (Pool::isWorker())
+			{
+				while (true)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						if (m_pending == 0)
+							break;
+					}
+					if (Pool::instance().runSubTask())
+						continue;
+					// the remaining tasks run on other workers. They could still submit sub tasks,
+					// so the wait is short instead of blocking until the group is done
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_done.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_pending == 0; });
+				}
+			}
+			else
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_done.wait(lock, [this]() { return m_pending == 0; });
+			}
+
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				std::swap(error, m_error);
+			}
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_done;
+		size_t m_pending = 0;
+		std::exception_ptr m_error;
+	};
+
+	/**
+	 * \brief calls func(begin, end) for disjoint chunks of [0, count)
+	 * \param minParallel the loop will run on the calling thread if count is smaller than this
+	 * \param func function that will be executed for every chunk (may be executed concurrently)
+	 */
+	template <class F>
+	void forRange(size_t count, size_t minParallel, F func)
+	{
+		const size_t numThreads = std::min(getThreadCount(), count / std::max(minParallel, size_t(1)));
+		if (numThreads <= 1 || isWorkerThread())
+		{
+			if (count)
+				func(size_t(0), count);
+			return;
+		}
+
+		const size_t chunk = (count + numThreads - 1) / numThreads;
+		if (Pool::isWorker())
+		{
+			// batch mode: the chunks are sub tasks of the pool
+			TaskGroup group;
+			for (size_t t = 1; t < numThreads; ++t)
+			{
+				group.run([&func, t, chunk, count]()
+				{
+					const size_t begin = t * chunk;
+					const size_t end = std::min(begin + chunk, count);
+					if (begin < end)
+						func(begin, end);
+				});
+			}
+			std::exception_ptr error;
+			try
+			{
+				func(size_t(0), std::min(chunk, count));
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			// the tasks reference func, wait in any case
+			try
+			{
+				group.wait();
+			}
+			catch (...)
+			{
+				if (!error)
+					error = std::current_exception();
+			}
+			if (error)
+				std::rethrow_exception(error);
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(numThreads);
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads - 1);
+		// the workers belong to the conversion of the caller
+		System::Context& context = System::getContext();
+		auto work = [&](size_t t)
+		{
+			System::ContextScope scope(context);
+			isWorkerThread() = true;
+			try
+			{
+				const size_t begin = t * chunk;
+				const size_t end = std::min(begin + chunk, count);
+				if (begin < end)
+					func(begin, end);
+			}
+			catch (...)
+			{
+				errors[t] = std::current_exception();
+			}
+			isWorkerThread() = false;
+		};
+		for (size_t t = 1; t < numThreads; ++t)
+			threads.emplace_back(work, t);
+		// the calling thread takes the first chunk
+		work(0);
+		for (auto& t : threads)
+			t.join();
+
+		for (const auto& e : errors)
+			if (e) std::rethrow_exception(e);
+	}
+
+	/**
+	 * \brief reduces [0, count) by calling map(begin, end) for chunks and combining the results with reduce(a, b)
+	 * \param init value for the reduction (returned if count is 0)
+	 */
+	template <class T, class Map, class Reduce>
+	T reduce(size_t count, size_t minParallel, T init, Map map, Reduce reduce)
+	{
+		const size_t numChunks = std::max(size_t(1), std::min(getThreadCount(), count / std::max(minParallel, size_t(1))));
+		const size_t chunk = (count + numChunks - 1) / numChunks;
+		std::vector<T> results(numChunks, init);
+		forRange(numChunks, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; ++c)
+			{
+				const size_t first = c * chunk;
+				const size_t last = std::min(first + chunk, count);
+				if (first < last)
+					results[c] = map(first, last);
+			}
+		});
+
+		T res = init;
+		for (const auto& r : results)
+			res = reduce(res, r);
+		return res;
+	}
+}
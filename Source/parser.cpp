@@ -6,19 +6,39 @@
 #include "parser_helper.h"
 #include "PBRT/TextureParams.h"
 #include "system.h"
+#include "profiler.h"
 
-#define API_MODUL(func) auto name = getString(cursor,end); ParamSet set; initParamSet(set, cursor,end); \
-						scene.func(name,set);
+// starts a command, the line is counted incrementally from the previous command
+#define COMMAND(op) out.begin(CommandStream::Op::op, lines.get(cursor))
+#define API_MODUL(op) COMMAND(op); out.writeString(getString(cursor,end)); out.beginParams(); initParamSet(out, cursor,end);
 
-#line 11 "../Source/raw_parser.h"
+#line 13 "../Source/raw_parser.h"
 
 
 void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene, std::string directory, const std::string& filename)
 {
 	System::setDirectory(directory);
+
+	// the whole file is tokenized before the commands are executed. Included files are parsed during the execution
+	CommandStream stream;
+	tokenize(data, length, stream, filename);
+	execute(stream, scene, filename);
+}
+
+void execute(const CommandStream& stream, PbrtScene& scene, const std::string& filename)
+{
 	// special case for --nodirhierarchy
-	directory = System::getCurrentDirectory();
+	const std::string directory = System::getCurrentDirectory();
+	System::runtimeInfo("executing commands");
+	replay(stream, scene, [&](const std::string& file)
+	{
+		parseFile(file, scene, directory);
+		System::setDirectory(directory);
+	}, filename);
+}
 
+void tokenize(const std::unique_ptr<char[]>& data, size_t length, CommandStream& out, const std::string& filename)
+{
 	const char* cursor = data.get();
 	const char* const end = data.get() + length;
 	const char* marker = nullptr;
@@ -26,6 +46,7 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 	System::runtimeInfo("removing comments");
 	// remove comments
 	{
+		profiler::ScopedTimer timer(profiler::Phase::Comments);
 		bool isComment = false;
 		bool isString = false;
 		char* c = data.get();
@@ -52,13 +73,15 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 		}
 	}
 	System::runtimeInfo("parsing commands");
+	profiler::ScopedTimer timer(profiler::Phase::Parse, filename);
+	LineCounter lines(data.get());
 	try
 	{
 		while (cursor < end && *cursor)
 		{
 			marker = nullptr;
 			
-#line 62 "<stdout>"
+#line 85 "<stdout>"
 {
 	char yych;
 	unsigned int yyaccept = 0;
@@ -84,14 +107,14 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 yy2:
 	++cursor;
 yy3:
-#line 65 "../Source/raw_parser.h"
+#line 88 "../Source/raw_parser.h"
 	{													continue; }
-#line 90 "<stdout>"
+#line 113 "<stdout>"
 yy4:
 	++cursor;
-#line 66 "../Source/raw_parser.h"
+#line 89 "../Source/raw_parser.h"
 	{ while(*cursor && *cursor != '\n') cursor++;		continue; }
-#line 95 "<stdout>"
+#line 118 "<stdout>"
 yy6:
 	yyaccept = 0;
 	yych = *(marker = ++cursor);
@@ -567,9 +590,9 @@ yy79:
 	}
 yy80:
 	++cursor;
-#line 90 "../Source/raw_parser.h"
-	{ API_MODUL(apiFilm);				continue; }
-#line 573 "<stdout>"
+#line 113 "../Source/raw_parser.h"
+	{ API_MODUL(Film);				continue; }
+#line 596 "<stdout>"
 yy82:
 	yych = *++cursor;
 	switch (yych) {
@@ -813,14 +836,14 @@ yy121:
 	}
 yy122:
 	++cursor;
-#line 70 "../Source/raw_parser.h"
-	{ scene.apiScale(getFloats(3,cursor,end));	continue; }
-#line 819 "<stdout>"
+#line 93 "../Source/raw_parser.h"
+	{ COMMAND(Scale); out.writeFloats(getFloats(3,cursor,end));	continue; }
+#line 842 "<stdout>"
 yy124:
 	++cursor;
-#line 97 "../Source/raw_parser.h"
-	{ API_MODUL(apiShape);				continue; }
-#line 824 "<stdout>"
+#line 120 "../Source/raw_parser.h"
+	{ API_MODUL(Shape);				continue; }
+#line 847 "<stdout>"
 yy126:
 	yych = *++cursor;
 	switch (yych) {
@@ -879,9 +902,9 @@ yy134:
 	}
 yy135:
 	++cursor;
-#line 88 "../Source/raw_parser.h"
-	{ API_MODUL(apiCamera);				continue; }
-#line 885 "<stdout>"
+#line 111 "../Source/raw_parser.h"
+	{ API_MODUL(Camera);				continue; }
+#line 908 "<stdout>"
 yy137:
 	yych = *++cursor;
 	switch (yych) {
@@ -920,9 +943,9 @@ yy142:
 	}
 yy143:
 	++cursor;
-#line 72 "../Source/raw_parser.h"
-	{ scene.apiLookAt(getFloats(9,cursor,end));	continue; }
-#line 926 "<stdout>"
+#line 95 "../Source/raw_parser.h"
+	{ COMMAND(LookAt); out.writeFloats(getFloats(9,cursor,end));	continue; }
+#line 949 "<stdout>"
 yy145:
 	yych = *++cursor;
 	switch (yych) {
@@ -969,9 +992,9 @@ yy151:
 	}
 yy152:
 	++cursor;
-#line 71 "../Source/raw_parser.h"
-	{ scene.apiRotate(getFloats(4,cursor,end));	continue; }
-#line 975 "<stdout>"
+#line 94 "../Source/raw_parser.h"
+	{ COMMAND(Rotate); out.writeFloats(getFloats(4,cursor,end));	continue; }
+#line 998 "<stdout>"
 yy154:
 	yych = *++cursor;
 	switch (yych) {
@@ -1010,9 +1033,9 @@ yy159:
 	default:	goto yy160;
 	}
 yy160:
-#line 107 "../Source/raw_parser.h"
-	{ API_MODUL(apiVolume);				continue; }
-#line 1016 "<stdout>"
+#line 130 "../Source/raw_parser.h"
+	{ API_MODUL(Volume);				continue; }
+#line 1039 "<stdout>"
 yy161:
 	yych = *++cursor;
 	switch (yych) {
@@ -1075,14 +1098,14 @@ yy170:
 	}
 yy171:
 	++cursor;
-#line 117 "../Source/raw_parser.h"
+#line 140 "../Source/raw_parser.h"
 	{	
-									auto filename = getString(cursor, end);
-									parseFile(filename,scene,directory); 
-									System::setDirectory(directory);
+									// the file is parsed when the command is executed
+									COMMAND(Include);
+									out.writeString(getString(cursor, end));
 									continue; 	
 								}
-#line 1086 "<stdout>"
+#line 1109 "<stdout>"
 yy173:
 	yych = *++cursor;
 	switch (yych) {
@@ -1145,9 +1168,9 @@ yy182:
 	}
 yy183:
 	++cursor;
-#line 89 "../Source/raw_parser.h"
-	{ API_MODUL(apiSampler);			continue; }
-#line 1151 "<stdout>"
+#line 112 "../Source/raw_parser.h"
+	{ API_MODUL(Sampler);			continue; }
+#line 1174 "<stdout>"
 yy185:
 	yych = *++cursor;
 	switch (yych) {
@@ -1156,16 +1179,16 @@ yy185:
 	}
 yy186:
 	++cursor;
-#line 108 "../Source/raw_parser.h"
+#line 131 "../Source/raw_parser.h"
 	{
-									auto name = getString(cursor,end);
-									auto type = getString(cursor,end);
-									auto clas = getString(cursor,end);
-									ParamSet set; initParamSet(set, cursor,end);
-									scene.apiTexture(name,type,clas,set);
+									COMMAND(Texture);
+									out.writeString(getString(cursor,end));
+									out.writeString(getString(cursor,end));
+									out.writeString(getString(cursor,end));
+									out.beginParams(); initParamSet(out, cursor,end);
 									continue;
 								}
-#line 1169 "<stdout>"
+#line 1192 "<stdout>"
 yy188:
 	yych = *++cursor;
 	switch (yych) {
@@ -1240,9 +1263,9 @@ yy199:
 	}
 yy200:
 	++cursor;
-#line 68 "../Source/raw_parser.h"
-	{ scene.apiIdentity();						continue; }
-#line 1246 "<stdout>"
+#line 91 "../Source/raw_parser.h"
+	{ COMMAND(Identity);						continue; }
+#line 1269 "<stdout>"
 yy202:
 	yych = *++cursor;
 	switch (yych) {
@@ -1257,9 +1280,9 @@ yy203:
 	}
 yy204:
 	++cursor;
-#line 104 "../Source/raw_parser.h"
-	{ API_MODUL(apiMaterial);			continue; }
-#line 1263 "<stdout>"
+#line 127 "../Source/raw_parser.h"
+	{ API_MODUL(Material);			continue; }
+#line 1286 "<stdout>"
 yy206:
 	yych = *++cursor;
 	switch (yych) {
@@ -1292,9 +1315,9 @@ yy210:
 	}
 yy211:
 	++cursor;
-#line 91 "../Source/raw_parser.h"
-	{ API_MODUL(apiRenderer);			continue; }
-#line 1298 "<stdout>"
+#line 114 "../Source/raw_parser.h"
+	{ API_MODUL(Renderer);			continue; }
+#line 1321 "<stdout>"
 yy213:
 	yych = *++cursor;
 	switch (yych) {
@@ -1333,9 +1356,9 @@ yy218:
 	}
 yy219:
 	++cursor;
-#line 86 "../Source/raw_parser.h"
-	{ scene.apiWorldEnd();				break; }
-#line 1339 "<stdout>"
+#line 109 "../Source/raw_parser.h"
+	{ COMMAND(WorldEnd);				break; }
+#line 1362 "<stdout>"
 yy221:
 	yych = *++cursor;
 	switch (yych) {
@@ -1405,9 +1428,9 @@ yy231:
 	}
 yy232:
 	++cursor;
-#line 99 "../Source/raw_parser.h"
-	{ scene.apiObjectEnd();				continue; }
-#line 1411 "<stdout>"
+#line 122 "../Source/raw_parser.h"
+	{ COMMAND(ObjectEnd);				continue; }
+#line 1434 "<stdout>"
 yy234:
 	yych = *++cursor;
 	switch (yych) {
@@ -1441,14 +1464,14 @@ yy238:
 	default:	goto yy239;
 	}
 yy239:
-#line 73 "../Source/raw_parser.h"
-	{ scene.apiTransform(getFloats(4 * 4,cursor,end));		continue; }
-#line 1447 "<stdout>"
+#line 96 "../Source/raw_parser.h"
+	{ COMMAND(Transform); out.writeFloats(getFloats(4 * 4,cursor,end));		continue; }
+#line 1470 "<stdout>"
 yy240:
 	++cursor;
-#line 69 "../Source/raw_parser.h"
-	{ scene.apiTranslate(getFloats(3,cursor,end));		continue; }
-#line 1452 "<stdout>"
+#line 92 "../Source/raw_parser.h"
+	{ COMMAND(Translate); out.writeFloats(getFloats(3,cursor,end));		continue; }
+#line 1475 "<stdout>"
 yy242:
 	yych = *++cursor;
 	switch (yych) {
@@ -1577,14 +1600,14 @@ yy262:
 	}
 yy263:
 	++cursor;
-#line 85 "../Source/raw_parser.h"
-	{ scene.apiWorldBegin();			continue; }
-#line 1583 "<stdout>"
+#line 108 "../Source/raw_parser.h"
+	{ COMMAND(WorldBegin);			continue; }
+#line 1606 "<stdout>"
 yy265:
 	++cursor;
-#line 94 "../Source/raw_parser.h"
-	{ API_MODUL(apiAccelerator);		continue; }
-#line 1588 "<stdout>"
+#line 117 "../Source/raw_parser.h"
+	{ API_MODUL(Accelerator);		continue; }
+#line 1611 "<stdout>"
 yy267:
 	yych = *++cursor;
 	switch (yych) {
@@ -1629,9 +1652,9 @@ yy273:
 	}
 yy274:
 	++cursor;
-#line 101 "../Source/raw_parser.h"
-	{ API_MODUL(apiLightSource);		continue; }
-#line 1635 "<stdout>"
+#line 124 "../Source/raw_parser.h"
+	{ API_MODUL(LightSource);		continue; }
+#line 1658 "<stdout>"
 yy276:
 	yych = *++cursor;
 	switch (yych) {
@@ -1646,9 +1669,9 @@ yy277:
 	}
 yy278:
 	++cursor;
-#line 98 "../Source/raw_parser.h"
-	{ scene.apiObjectBegin(getString(cursor,end)); continue; }
-#line 1652 "<stdout>"
+#line 121 "../Source/raw_parser.h"
+	{ COMMAND(ObjectBegin); out.writeString(getString(cursor,end)); continue; }
+#line 1675 "<stdout>"
 yy280:
 	yych = *++cursor;
 	switch (yych) {
@@ -1657,9 +1680,9 @@ yy280:
 	}
 yy281:
 	++cursor;
-#line 95 "../Source/raw_parser.h"
-	{ API_MODUL(apiPixelFilter);		continue; }
-#line 1663 "<stdout>"
+#line 118 "../Source/raw_parser.h"
+	{ API_MODUL(PixelFilter);		continue; }
+#line 1686 "<stdout>"
 yy283:
 	yych = *++cursor;
 	switch (yych) {
@@ -1710,9 +1733,9 @@ yy290:
 	}
 yy291:
 	++cursor;
-#line 82 "../Source/raw_parser.h"
-	{ scene.apiAttributeEnd();			continue; }
-#line 1716 "<stdout>"
+#line 105 "../Source/raw_parser.h"
+	{ COMMAND(AttributeEnd);			continue; }
+#line 1739 "<stdout>"
 yy293:
 	yych = *++cursor;
 	switch (yych) {
@@ -1769,9 +1792,9 @@ yy301:
 	}
 yy302:
 	++cursor;
-#line 84 "../Source/raw_parser.h"
-	{ scene.apiTransformEnd();			continue; }
-#line 1775 "<stdout>"
+#line 107 "../Source/raw_parser.h"
+	{ COMMAND(TransformEnd);			continue; }
+#line 1798 "<stdout>"
 yy304:
 	yych = *++cursor;
 	switch (yych) {
@@ -1822,9 +1845,9 @@ yy311:
 	}
 yy312:
 	++cursor;
-#line 106 "../Source/raw_parser.h"
-	{ scene.apiNamedMaterial(getString(cursor,end)); continue; }
-#line 1828 "<stdout>"
+#line 129 "../Source/raw_parser.h"
+	{ COMMAND(NamedMaterial); out.writeString(getString(cursor,end)); continue; }
+#line 1851 "<stdout>"
 yy314:
 	yych = *++cursor;
 	switch (yych) {
@@ -1869,9 +1892,9 @@ yy320:
 	}
 yy321:
 	++cursor;
-#line 81 "../Source/raw_parser.h"
-	{ scene.apiAttributeBegin();		continue; }
-#line 1875 "<stdout>"
+#line 104 "../Source/raw_parser.h"
+	{ COMMAND(AttributeBegin);		continue; }
+#line 1898 "<stdout>"
 yy323:
 	yych = *++cursor;
 	switch (yych) {
@@ -1898,9 +1921,9 @@ yy326:
 	}
 yy327:
 	++cursor;
-#line 100 "../Source/raw_parser.h"
-	{ scene.apiObjectInstance(getString(cursor,end)); continue; }
-#line 1904 "<stdout>"
+#line 123 "../Source/raw_parser.h"
+	{ COMMAND(ObjectInstance); out.writeString(getString(cursor,end)); continue; }
+#line 1927 "<stdout>"
 yy329:
 	yych = *++cursor;
 	switch (yych) {
@@ -1915,9 +1938,9 @@ yy330:
 	}
 yy331:
 	++cursor;
-#line 83 "../Source/raw_parser.h"
-	{ scene.apiTransformBegin();		continue; }
-#line 1921 "<stdout>"
+#line 106 "../Source/raw_parser.h"
+	{ COMMAND(TransformBegin);		continue; }
+#line 1944 "<stdout>"
 yy333:
 	yych = *++cursor;
 	switch (yych) {
@@ -1932,14 +1955,14 @@ yy334:
 	}
 yy335:
 	++cursor;
-#line 102 "../Source/raw_parser.h"
-	{ API_MODUL(apiAreaLightSource);	continue; }
-#line 1938 "<stdout>"
+#line 125 "../Source/raw_parser.h"
+	{ API_MODUL(AreaLightSource);	continue; }
+#line 1961 "<stdout>"
 yy337:
 	++cursor;
-#line 74 "../Source/raw_parser.h"
-	{ scene.apiConcatTransfrom(getFloats(4 * 4,cursor,end));	continue; }
-#line 1943 "<stdout>"
+#line 97 "../Source/raw_parser.h"
+	{ COMMAND(ConcatTransform); out.writeFloats(getFloats(4 * 4,cursor,end));	continue; }
+#line 1966 "<stdout>"
 yy339:
 	yych = *++cursor;
 	switch (yych) {
@@ -1992,9 +2015,9 @@ yy346:
 	}
 yy347:
 	++cursor;
-#line 78 "../Source/raw_parser.h"
-	{ scene.apiCoordinateSystem(getString(cursor,end));	continue; }
-#line 1998 "<stdout>"
+#line 101 "../Source/raw_parser.h"
+	{ COMMAND(CoordinateSystem); out.writeString(getString(cursor,end));	continue; }
+#line 2021 "<stdout>"
 yy349:
 	yych = *++cursor;
 	switch (yych) {
@@ -2015,9 +2038,9 @@ yy351:
 	}
 yy352:
 	++cursor;
-#line 93 "../Source/raw_parser.h"
-	{ API_MODUL(apiVolumeIntegrator);	continue; }
-#line 2021 "<stdout>"
+#line 116 "../Source/raw_parser.h"
+	{ API_MODUL(VolumeIntegrator);	continue; }
+#line 2044 "<stdout>"
 yy354:
 	yych = *++cursor;
 	switch (yych) {
@@ -2038,14 +2061,14 @@ yy356:
 	}
 yy357:
 	++cursor;
-#line 79 "../Source/raw_parser.h"
-	{ scene.apiCoordSysTransform(getString(cursor,end)); continue;}
-#line 2044 "<stdout>"
+#line 102 "../Source/raw_parser.h"
+	{ COMMAND(CoordSysTransform); out.writeString(getString(cursor,end)); continue;}
+#line 2067 "<stdout>"
 yy359:
 	++cursor;
-#line 105 "../Source/raw_parser.h"
-	{ API_MODUL(apiMakeNamedMaterial);	continue; }
-#line 2049 "<stdout>"
+#line 128 "../Source/raw_parser.h"
+	{ API_MODUL(MakeNamedMaterial);	continue; }
+#line 2072 "<stdout>"
 yy361:
 	yych = *++cursor;
 	switch (yych) {
@@ -2054,9 +2077,9 @@ yy361:
 	}
 yy362:
 	++cursor;
-#line 92 "../Source/raw_parser.h"
-	{ API_MODUL(apiSurfaceIntegrator);	continue; }
-#line 2060 "<stdout>"
+#line 115 "../Source/raw_parser.h"
+	{ API_MODUL(SurfaceIntegrator);	continue; }
+#line 2083 "<stdout>"
 yy364:
 	yych = *++cursor;
 	switch (yych) {
@@ -2077,14 +2100,14 @@ yy366:
 	}
 yy367:
 	++cursor;
-#line 103 "../Source/raw_parser.h"
-	{ scene.apiReverseOrientation();	continue; }
-#line 2083 "<stdout>"
+#line 126 "../Source/raw_parser.h"
+	{ COMMAND(ReverseOrientation);	continue; }
+#line 2106 "<stdout>"
 yy369:
 	++cursor;
-#line 77 "../Source/raw_parser.h"
-	{ scene.apiSetActiveTransform(true);		continue; }
-#line 2088 "<stdout>"
+#line 100 "../Source/raw_parser.h"
+	{ COMMAND(ActiveTransform); out.writeWord(1);		continue; }
+#line 2111 "<stdout>"
 yy371:
 	yych = *++cursor;
 	switch (yych) {
@@ -2135,9 +2158,9 @@ yy378:
 	}
 yy379:
 	++cursor;
-#line 76 "../Source/raw_parser.h"
-	{ scene.apiSetActiveTransform(false);		continue; }
-#line 2141 "<stdout>"
+#line 99 "../Source/raw_parser.h"
+	{ COMMAND(ActiveTransform); out.writeWord(0);		continue; }
+#line 2164 "<stdout>"
 yy381:
 	yych = *++cursor;
 	switch (yych) {
@@ -2152,11 +2175,11 @@ yy382:
 	}
 yy383:
 	++cursor;
-#line 75 "../Source/raw_parser.h"
-	{ scene.apiSetActiveTransform(true);	continue; }
-#line 2158 "<stdout>"
+#line 98 "../Source/raw_parser.h"
+	{ COMMAND(ActiveTransform); out.writeWord(1);	continue; }
+#line 2181 "<stdout>"
 }
-#line 124 "../Source/raw_parser.h"
+#line 147 "../Source/raw_parser.h"
 
 		}
 	}
@@ -2166,7 +2189,7 @@ yy383:
 		size_t line = 1;
 		const char* cur = data.get();
 		while (cur < e.where()) { if (*cur == '\n')++line;++cur; }
-		System::error("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
+		out.fail("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
 	}
 	catch(const std::exception& e)
 	{
@@ -2174,7 +2197,7 @@ yy383:
 		size_t line = 1;
 		const char* cur = data.get();
 		while (cur < cursor) { if (*cur == '\n')++line; ++cur; }
-		System::error("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
+		out.fail("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
 	}
 }
 
@@ -2184,7 +2207,7 @@ pbrtParamType getParamTypeFromString(const std::string& s)
 	const char* end = cursor + s.length();
 	const char* marker = nullptr;
 	
-#line 2188 "<stdout>"
+#line 2211 "<stdout>"
 {
 	char yych;
 	yych = *cursor;
@@ -2205,9 +2228,9 @@ pbrtParamType getParamTypeFromString(const std::string& s)
 yy387:
 	++cursor;
 yy388:
-#line 156 "../Source/raw_parser.h"
+#line 179 "../Source/raw_parser.h"
 	{return pbrtParamType::ERROR;}
-#line 2211 "<stdout>"
+#line 2234 "<stdout>"
 yy389:
 	yych = *(marker = ++cursor);
 	switch (yych) {
@@ -2401,9 +2424,9 @@ yy420:
 	}
 yy421:
 	++cursor;
-#line 166 "../Source/raw_parser.h"
+#line 189 "../Source/raw_parser.h"
 	{return pbrtParamType::RGB; }
-#line 2407 "<stdout>"
+#line 2430 "<stdout>"
 yy423:
 	yych = *++cursor;
 	switch (yych) {
@@ -2430,9 +2453,9 @@ yy426:
 	}
 yy427:
 	++cursor;
-#line 167 "../Source/raw_parser.h"
+#line 190 "../Source/raw_parser.h"
 	{return pbrtParamType::XYZ; }
-#line 2436 "<stdout>"
+#line 2459 "<stdout>"
 yy429:
 	yych = *++cursor;
 	switch (yych) {
@@ -2441,9 +2464,9 @@ yy429:
 	}
 yy430:
 	++cursor;
-#line 159 "../Source/raw_parser.h"
+#line 182 "../Source/raw_parser.h"
 	{return pbrtParamType::Bool; }
-#line 2447 "<stdout>"
+#line 2470 "<stdout>"
 yy432:
 	yych = *++cursor;
 	switch (yych) {
@@ -2506,14 +2529,14 @@ yy441:
 	}
 yy442:
 	++cursor;
-#line 165 "../Source/raw_parser.h"
+#line 188 "../Source/raw_parser.h"
 	{return pbrtParamType::Color; }
-#line 2512 "<stdout>"
+#line 2535 "<stdout>"
 yy444:
 	++cursor;
-#line 158 "../Source/raw_parser.h"
+#line 181 "../Source/raw_parser.h"
 	{return pbrtParamType::Float; }
-#line 2517 "<stdout>"
+#line 2540 "<stdout>"
 yy446:
 	yych = *++cursor;
 	switch (yych) {
@@ -2528,9 +2551,9 @@ yy447:
 	}
 yy448:
 	++cursor;
-#line 160 "../Source/raw_parser.h"
+#line 183 "../Source/raw_parser.h"
 	{return pbrtParamType::Point; }
-#line 2534 "<stdout>"
+#line 2557 "<stdout>"
 yy450:
 	yych = *++cursor;
 	switch (yych) {
@@ -2569,9 +2592,9 @@ yy455:
 	}
 yy456:
 	++cursor;
-#line 162 "../Source/raw_parser.h"
+#line 185 "../Source/raw_parser.h"
 	{return pbrtParamType::Normal; }
-#line 2575 "<stdout>"
+#line 2598 "<stdout>"
 yy458:
 	yych = *++cursor;
 	switch (yych) {
@@ -2580,9 +2603,9 @@ yy458:
 	}
 yy459:
 	++cursor;
-#line 163 "../Source/raw_parser.h"
+#line 186 "../Source/raw_parser.h"
 	{return pbrtParamType::String; }
-#line 2586 "<stdout>"
+#line 2609 "<stdout>"
 yy461:
 	yych = *++cursor;
 	switch (yych) {
@@ -2591,9 +2614,9 @@ yy461:
 	}
 yy462:
 	++cursor;
-#line 161 "../Source/raw_parser.h"
+#line 184 "../Source/raw_parser.h"
 	{return pbrtParamType::Vector; }
-#line 2597 "<stdout>"
+#line 2620 "<stdout>"
 yy464:
 	yych = *++cursor;
 	switch (yych) {
@@ -2602,9 +2625,9 @@ yy464:
 	}
 yy465:
 	++cursor;
-#line 157 "../Source/raw_parser.h"
+#line 180 "../Source/raw_parser.h"
 	{return pbrtParamType::Integer; }
-#line 2608 "<stdout>"
+#line 2631 "<stdout>"
 yy467:
 	yych = *++cursor;
 	switch (yych) {
@@ -2613,9 +2636,9 @@ yy467:
 	}
 yy468:
 	++cursor;
-#line 168 "../Source/raw_parser.h"
+#line 191 "../Source/raw_parser.h"
 	{return pbrtParamType::Texture; }
-#line 2619 "<stdout>"
+#line 2642 "<stdout>"
 yy470:
 	yych = *++cursor;
 	switch (yych) {
@@ -2624,16 +2647,16 @@ yy470:
 	}
 yy471:
 	++cursor;
-#line 164 "../Source/raw_parser.h"
+#line 187 "../Source/raw_parser.h"
 	{return pbrtParamType::Spectrum; }
-#line 2630 "<stdout>"
+#line 2653 "<stdout>"
 yy473:
 	++cursor;
-#line 169 "../Source/raw_parser.h"
+#line 192 "../Source/raw_parser.h"
 	{return pbrtParamType::Spectrum; }
-#line 2635 "<stdout>"
+#line 2658 "<stdout>"
 }
-#line 170 "../Source/raw_parser.h"
+#line 193 "../Source/raw_parser.h"
 
 	return pbrtParamType::ERROR;
 }
@@ -2644,7 +2667,7 @@ PbrtScene::ShapeType getShapeTypeFromString(const std::string& s)
 	const char* end = cursor + s.length();
 	const char* marker = nullptr;
 	
-#line 2648 "<stdout>"
+#line 2671 "<stdout>"
 {
 	char yych;
 	yych = *cursor;
@@ -2662,9 +2685,9 @@ PbrtScene::ShapeType getShapeTypeFromString(const std::string& s)
 yy477:
 	++cursor;
 yy478:
-#line 185 "../Source/raw_parser.h"
+#line 208 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::ERROR;}
-#line 2668 "<stdout>"
+#line 2691 "<stdout>"
 yy479:
 	yych = *(marker = ++cursor);
 	switch (yych) {
@@ -2853,9 +2876,9 @@ yy509:
 	}
 yy510:
 	++cursor;
-#line 186 "../Source/raw_parser.h"
+#line 209 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Cone; }
-#line 2859 "<stdout>"
+#line 2882 "<stdout>"
 yy512:
 	yych = *++cursor;
 	switch (yych) {
@@ -2864,9 +2887,9 @@ yy512:
 	}
 yy513:
 	++cursor;
-#line 188 "../Source/raw_parser.h"
+#line 211 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Disk; }
-#line 2870 "<stdout>"
+#line 2893 "<stdout>"
 yy515:
 	yych = *++cursor;
 	switch (yych) {
@@ -2941,9 +2964,9 @@ yy526:
 	}
 yy527:
 	++cursor;
-#line 192 "../Source/raw_parser.h"
+#line 215 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Nurbs; }
-#line 2947 "<stdout>"
+#line 2970 "<stdout>"
 yy529:
 	yych = *++cursor;
 	switch (yych) {
@@ -3006,9 +3029,9 @@ yy538:
 	}
 yy539:
 	++cursor;
-#line 194 "../Source/raw_parser.h"
+#line 217 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Sphere; }
-#line 3012 "<stdout>"
+#line 3035 "<stdout>"
 yy541:
 	yych = *++cursor;
 	switch (yych) {
@@ -3047,9 +3070,9 @@ yy546:
 	}
 yy547:
 	++cursor;
-#line 196 "../Source/raw_parser.h"
+#line 219 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Plymesh; }
-#line 3053 "<stdout>"
+#line 3076 "<stdout>"
 yy549:
 	yych = *++cursor;
 	switch (yych) {
@@ -3058,9 +3081,9 @@ yy549:
 	}
 yy550:
 	++cursor;
-#line 187 "../Source/raw_parser.h"
+#line 210 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Cylinder; }
-#line 3064 "<stdout>"
+#line 3087 "<stdout>"
 yy552:
 	yych = *++cursor;
 	switch (yych) {
@@ -3135,14 +3158,14 @@ yy563:
 	}
 yy564:
 	++cursor;
-#line 191 "../Source/raw_parser.h"
+#line 214 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Loopsubdiv; }
-#line 3141 "<stdout>"
+#line 3164 "<stdout>"
 yy566:
 	++cursor;
-#line 193 "../Source/raw_parser.h"
+#line 216 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Paraboloid; }
-#line 3146 "<stdout>"
+#line 3169 "<stdout>"
 yy568:
 	yych = *++cursor;
 	switch (yych) {
@@ -3151,14 +3174,14 @@ yy568:
 	}
 yy569:
 	++cursor;
-#line 190 "../Source/raw_parser.h"
+#line 213 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Heightfield; }
-#line 3157 "<stdout>"
+#line 3180 "<stdout>"
 yy571:
 	++cursor;
-#line 189 "../Source/raw_parser.h"
+#line 212 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Hyperboloid; }
-#line 3162 "<stdout>"
+#line 3185 "<stdout>"
 yy573:
 	yych = *++cursor;
 	switch (yych) {
@@ -3167,11 +3190,11 @@ yy573:
 	}
 yy574:
 	++cursor;
-#line 195 "../Source/raw_parser.h"
+#line 218 "../Source/raw_parser.h"
 	{return PbrtScene::ShapeType::Trianglemesh; }
-#line 3173 "<stdout>"
+#line 3196 "<stdout>"
 }
-#line 197 "../Source/raw_parser.h"
+#line 220 "../Source/raw_parser.h"
 
 	return PbrtScene::ShapeType::ERROR;
 }
@@ -3182,7 +3205,7 @@ Light::Type getLightTypeFromString(const std::string& s)
 	const char* end = cursor + s.length();
 	const char* marker = nullptr;
 	
-#line 3186 "<stdout>"
+#line 3209 "<stdout>"
 {
 	char yych;
 	yych = *cursor;
@@ -3197,9 +3220,9 @@ Light::Type getLightTypeFromString(const std::string& s)
 yy578:
 	++cursor;
 yy579:
-#line 212 "../Source/raw_parser.h"
+#line 235 "../Source/raw_parser.h"
 	{return Light::Type::ERROR;}
-#line 3203 "<stdout>"
+#line 3226 "<stdout>"
 yy580:
 	yych = *(marker = ++cursor);
 	switch (yych) {
@@ -3338,9 +3361,9 @@ yy602:
 	}
 yy603:
 	++cursor;
-#line 218 "../Source/raw_parser.h"
+#line 241 "../Source/raw_parser.h"
 	{return Light::Type::Spot; }
-#line 3344 "<stdout>"
+#line 3367 "<stdout>"
 yy605:
 	yych = *++cursor;
 	switch (yych) {
@@ -3361,9 +3384,9 @@ yy607:
 	}
 yy608:
 	++cursor;
-#line 216 "../Source/raw_parser.h"
+#line 239 "../Source/raw_parser.h"
 	{return Light::Type::Point; }
-#line 3367 "<stdout>"
+#line 3390 "<stdout>"
 yy610:
 	yych = *++cursor;
 	switch (yych) {
@@ -3396,9 +3419,9 @@ yy614:
 	}
 yy615:
 	++cursor;
-#line 213 "../Source/raw_parser.h"
+#line 236 "../Source/raw_parser.h"
 	{return Light::Type::Distant; }
-#line 3402 "<stdout>"
+#line 3425 "<stdout>"
 yy617:
 	yych = *++cursor;
 	switch (yych) {
@@ -3425,9 +3448,9 @@ yy620:
 	}
 yy621:
 	++cursor;
-#line 215 "../Source/raw_parser.h"
+#line 238 "../Source/raw_parser.h"
 	{return Light::Type::Infinite; }
-#line 3431 "<stdout>"
+#line 3454 "<stdout>"
 yy623:
 	yych = *++cursor;
 	switch (yych) {
@@ -3454,16 +3477,16 @@ yy626:
 	}
 yy627:
 	++cursor;
-#line 217 "../Source/raw_parser.h"
+#line 240 "../Source/raw_parser.h"
 	{return Light::Type::Projection; }
-#line 3460 "<stdout>"
+#line 3483 "<stdout>"
 yy629:
 	++cursor;
-#line 214 "../Source/raw_parser.h"
+#line 237 "../Source/raw_parser.h"
 	{return Light::Type::Goniometric; }
-#line 3465 "<stdout>"
+#line 3488 "<stdout>"
 }
-#line 219 "../Source/raw_parser.h"
+#line 242 "../Source/raw_parser.h"
 
 	return Light::Type::ERROR;
 }
@@ -3477,7 +3500,7 @@ Material::Type getMaterialTypeFromString(const std::string& s)
 	const char* end = cursor + s.length();
 	const char* marker = nullptr;
 	
-#line 3481 "<stdout>"
+#line 3504 "<stdout>"
 {
 	char yych;
 	yych = *cursor;
@@ -3496,9 +3519,9 @@ Material::Type getMaterialTypeFromString(const std::string& s)
 yy633:
 	++cursor;
 yy634:
-#line 237 "../Source/raw_parser.h"
+#line 260 "../Source/raw_parser.h"
 	{return Material::Type::ERROR;}
-#line 3502 "<stdout>"
+#line 3525 "<stdout>"
 yy635:
 	yych = *(marker = ++cursor);
 	switch (yych) {
@@ -3683,9 +3706,9 @@ yy664:
 	}
 yy665:
 	++cursor;
-#line 244 "../Source/raw_parser.h"
+#line 267 "../Source/raw_parser.h"
 	{return Material::Type::Mix; }
-#line 3689 "<stdout>"
+#line 3712 "<stdout>"
 yy667:
 	yych = *++cursor;
 	switch (yych) {
@@ -3730,9 +3753,9 @@ yy673:
 	}
 yy674:
 	++cursor;
-#line 251 "../Source/raw_parser.h"
+#line 274 "../Source/raw_parser.h"
 	{return Material::Type::Hair; }
-#line 3736 "<stdout>"
+#line 3759 "<stdout>"
 yy676:
 	yych = *++cursor;
 	switch (yych) {
@@ -3790,9 +3813,9 @@ yy684:
 	}
 yy685:
 	++cursor;
-#line 250 "../Source/raw_parser.h"
+#line 273 "../Source/raw_parser.h"
 	{return Material::Type::Uber; }
-#line 3796 "<stdout>"
+#line 3819 "<stdout>"
 yy687:
 	yych = *++cursor;
 	switch (yych) {
@@ -3801,9 +3824,9 @@ yy687:
 	}
 yy688:
 	++cursor;
-#line 238 "../Source/raw_parser.h"
+#line 261 "../Source/raw_parser.h"
 	{return Material::Type::Glass; }
-#line 3807 "<stdout>"
+#line 3830 "<stdout>"
 yy690:
 	yych = *++cursor;
 	switch (yych) {
@@ -3812,9 +3835,9 @@ yy690:
 	}
 yy691:
 	++cursor;
-#line 240 "../Source/raw_parser.h"
+#line 263 "../Source/raw_parser.h"
 	{return Material::Type::Matte; }
-#line 3818 "<stdout>"
+#line 3841 "<stdout>"
 yy693:
 	yych = *++cursor;
 	switch (yych) {
@@ -3823,9 +3846,9 @@ yy693:
 	}
 yy694:
 	++cursor;
-#line 242 "../Source/raw_parser.h"
+#line 265 "../Source/raw_parser.h"
 	{return Material::Type::Metal; }
-#line 3829 "<stdout>"
+#line 3852 "<stdout>"
 yy696:
 	yych = *++cursor;
 	switch (yych) {
@@ -3882,9 +3905,9 @@ yy704:
 	}
 yy705:
 	++cursor;
-#line 243 "../Source/raw_parser.h"
+#line 266 "../Source/raw_parser.h"
 	{return Material::Type::Mirror; }
-#line 3888 "<stdout>"
+#line 3911 "<stdout>"
 yy707:
 	yych = *++cursor;
 	switch (yych) {
@@ -3917,9 +3940,9 @@ yy711:
 	}
 yy712:
 	++cursor;
-#line 252 "../Source/raw_parser.h"
+#line 275 "../Source/raw_parser.h"
 	{return Material::Type::Fourier; }
-#line 3923 "<stdout>"
+#line 3946 "<stdout>"
 yy714:
 	yych = *++cursor;
 	switch (yych) {
@@ -3934,9 +3957,9 @@ yy715:
 	}
 yy716:
 	++cursor;
-#line 245 "../Source/raw_parser.h"
+#line 268 "../Source/raw_parser.h"
 	{return Material::Type::Plastic; }
-#line 3940 "<stdout>"
+#line 3963 "<stdout>"
 yy718:
 	yych = *++cursor;
 	switch (yych) {
@@ -3969,9 +3992,9 @@ yy722:
 	}
 yy723:
 	++cursor;
-#line 241 "../Source/raw_parser.h"
+#line 264 "../Source/raw_parser.h"
 	{return Material::Type::Measured; }
-#line 3975 "<stdout>"
+#line 3998 "<stdout>"
 yy725:
 	yych = *++cursor;
 	switch (yych) {
@@ -4010,9 +4033,9 @@ yy730:
 	}
 yy731:
 	++cursor;
-#line 247 "../Source/raw_parser.h"
+#line 270 "../Source/raw_parser.h"
 	{return Material::Type::Substrate; }
-#line 4016 "<stdout>"
+#line 4039 "<stdout>"
 yy733:
 	yych = *++cursor;
 	switch (yych) {
@@ -4033,14 +4056,14 @@ yy735:
 	}
 yy736:
 	++cursor;
-#line 246 "../Source/raw_parser.h"
+#line 269 "../Source/raw_parser.h"
 	{return Material::Type::Shinymetal; }
-#line 4039 "<stdout>"
+#line 4062 "<stdout>"
 yy738:
 	++cursor;
-#line 248 "../Source/raw_parser.h"
+#line 271 "../Source/raw_parser.h"
 	{return Material::Type::Subsurface; }
-#line 4044 "<stdout>"
+#line 4067 "<stdout>"
 yy740:
 	yych = *++cursor;
 	switch (yych) {
@@ -4055,16 +4078,16 @@ yy741:
 	}
 yy742:
 	++cursor;
-#line 249 "../Source/raw_parser.h"
+#line 272 "../Source/raw_parser.h"
 	{return Material::Type::Translucent; }
-#line 4061 "<stdout>"
+#line 4084 "<stdout>"
 yy744:
 	++cursor;
-#line 239 "../Source/raw_parser.h"
+#line 262 "../Source/raw_parser.h"
 	{return Material::Type::Kdsubsurface; }
-#line 4066 "<stdout>"
+#line 4089 "<stdout>"
 }
-#line 253 "../Source/raw_parser.h"
+#line 276 "../Source/raw_parser.h"
 
 	return Material::Type::ERROR;
 }
@@ -4075,7 +4098,7 @@ size_t getTextureTypeFromString(const std::string& s)
 	const char* end = cursor + s.length();
 	const char* marker = nullptr;
 	
-#line 4079 "<stdout>"
+#line 4102 "<stdout>"
 {
 	char yych;
 	yych = *cursor;
@@ -4094,9 +4117,9 @@ size_t getTextureTypeFromString(const std::string& s)
 yy748:
 	++cursor;
 yy749:
-#line 268 "../Source/raw_parser.h"
+#line 291 "../Source/raw_parser.h"
 	{return Texture<int>::Type::ERROR;}
-#line 4100 "<stdout>"
+#line 4123 "<stdout>"
 yy750:
 	yych = *(marker = ++cursor);
 	switch (yych) {
@@ -4213,9 +4236,9 @@ yy768:
 	}
 yy769:
 	++cursor;
-#line 278 "../Source/raw_parser.h"
+#line 301 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Uv; }
-#line 4219 "<stdout>"
+#line 4242 "<stdout>"
 yy771:
 	yych = *++cursor;
 	switch (yych) {
@@ -4254,9 +4277,9 @@ yy776:
 	}
 yy777:
 	++cursor;
-#line 273 "../Source/raw_parser.h"
+#line 296 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Fbm; }
-#line 4260 "<stdout>"
+#line 4283 "<stdout>"
 yy779:
 	yych = *++cursor;
 	switch (yych) {
@@ -4271,9 +4294,9 @@ yy780:
 	}
 yy781:
 	++cursor;
-#line 276 "../Source/raw_parser.h"
+#line 299 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Mix; }
-#line 4277 "<stdout>"
+#line 4300 "<stdout>"
 yy783:
 	yych = *++cursor;
 	switch (yych) {
@@ -4312,9 +4335,9 @@ yy788:
 	}
 yy789:
 	++cursor;
-#line 272 "../Source/raw_parser.h"
+#line 295 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Dots; }
-#line 4318 "<stdout>"
+#line 4341 "<stdout>"
 yy791:
 	yych = *++cursor;
 	switch (yych) {
@@ -4377,14 +4400,14 @@ yy800:
 	}
 yy801:
 	++cursor;
-#line 277 "../Source/raw_parser.h"
+#line 300 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Scale; }
-#line 4383 "<stdout>"
+#line 4406 "<stdout>"
 yy803:
 	++cursor;
-#line 279 "../Source/raw_parser.h"
+#line 302 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Windy; }
-#line 4388 "<stdout>"
+#line 4411 "<stdout>"
 yy805:
 	yych = *++cursor;
 	switch (yych) {
@@ -4393,9 +4416,9 @@ yy805:
 	}
 yy806:
 	++cursor;
-#line 269 "../Source/raw_parser.h"
+#line 292 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Bilerp; }
-#line 4399 "<stdout>"
+#line 4422 "<stdout>"
 yy808:
 	yych = *++cursor;
 	switch (yych) {
@@ -4416,9 +4439,9 @@ yy810:
 	}
 yy811:
 	++cursor;
-#line 275 "../Source/raw_parser.h"
+#line 298 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Marble; }
-#line 4422 "<stdout>"
+#line 4445 "<stdout>"
 yy813:
 	yych = *++cursor;
 	switch (yych) {
@@ -4457,19 +4480,19 @@ yy818:
 	}
 yy819:
 	++cursor;
-#line 271 "../Source/raw_parser.h"
+#line 294 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Constant; }
-#line 4463 "<stdout>"
+#line 4486 "<stdout>"
 yy821:
 	++cursor;
-#line 274 "../Source/raw_parser.h"
+#line 297 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Imagemap; }
-#line 4468 "<stdout>"
+#line 4491 "<stdout>"
 yy823:
 	++cursor;
-#line 280 "../Source/raw_parser.h"
+#line 303 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Wrinkled; }
-#line 4473 "<stdout>"
+#line 4496 "<stdout>"
 yy825:
 	yych = *++cursor;
 	switch (yych) {
@@ -4490,11 +4513,11 @@ yy827:
 	}
 yy828:
 	++cursor;
-#line 270 "../Source/raw_parser.h"
+#line 293 "../Source/raw_parser.h"
 	{return Texture<int>::Type::Checkerboard; }
-#line 4496 "<stdout>"
+#line 4519 "<stdout>"
 }
-#line 281 "../Source/raw_parser.h"
+#line 304 "../Source/raw_parser.h"
 
 	return Texture<int>::ERROR;
 }
\ No newline at end of file
@@ -2,9 +2,18 @@
 #include <memory>
 #include "PBRT/PbrtScene.h"
 #include "file.h"
+#include "profiler.h"
+#include "command_stream.h"
+#include "incremental.h"
+#include "stream_cache.h"
 
 // directory like: "mySceneDirectory/"
 void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene, std::string directory, const std::string& filename);
+// first phase of parse(): removes the comments from data and appends the commands to the stream.
+// errors are stored in the stream (reported by replay)
+void tokenize(const std::unique_ptr<char[]>& data, size_t length, CommandStream& out, const std::string& filename);
+// second phase of parse(): executes the commands of filename (the directory of the file has to be set)
+void execute(const CommandStream& stream, PbrtScene& scene, const std::string& filename);
 
 inline bool parseFile(std::string filename, PbrtScene& scene, std::string curDirectory)
 {
@@ -17,25 +26,100 @@ inline bool parseFile(std::string filename, PbrtScene& scene, std::string curDir
 	}
 	filename = System::fixPath(filename);
 
-	size_t filesize;
-	auto file = openFile(filename, filesize);
-	if(file)
+	// get directory
+	std::string fileDirectory = filename;
+	auto lastSlash = fileDirectory.find_last_of("\\");
+	if (lastSlash == std::string::npos)
+		lastSlash = fileDirectory.find_last_of("/");
+
+	if(lastSlash != std::string::npos)
 	{
-		// get directory
-		curDirectory = filename;
-		auto lastSlash = curDirectory.find_last_of("\\");
-		if (lastSlash == std::string::npos)
-			lastSlash = curDirectory.find_last_of("/");
+		fileDirectory = fileDirectory.substr(0, lastSlash + 1);
+	}
+	else fileDirectory = "";
+	// spectra of the file are relative to the current directory (the one of the scene without --dirhierarchy)
+	const std::string previousDirectory = System::getCurrentDirectory();
+	System::setDirectory(fileDirectory);
+	const std::string directory = System::getCurrentDirectory();
 
-		if(lastSlash != std::string::npos)
+	// --incremental: the stream of an unchanged file is loaded from the cache
+	incremental::Session* session = incremental::Session::getCurrent();
+	std::shared_ptr<const CommandStream> cached;
+	if (session)
+		cached = session->findStream(filename, directory);
+	// stream of a file that was tokenized before by this process
+	std::shared_ptr<const StreamCache::Entry> entry;
+	if (!cached)
+	{
+		entry = StreamCache::instance().find(filename, directory);
+		if (entry)
+			cached = entry->stream;
+	}
+
+	size_t filesize = 0;
+	std::unique_ptr<char[]> file;
+	StreamCache::FileStamp stamp;
+	// hash and size of the bytes on the disk. --incremental compares them with the files of the next run,
+	// so compressed files are hashed before they are decoded
+	uint64_t hash = 0;
+	size_t diskSize = 0;
+	if(!cached)
+	{
+		profiler::ScopedTimer timer(profiler::Phase::ReadFile, filename);
+		stamp = StreamCache::getFileStamp(filename);
+		file = readFile(filename, filesize);
+		if (file)
 		{
-			curDirectory = curDirectory.substr(0, lastSlash + 1);
+			hash = incremental::hashData(file.get(), filesize);
+			diskSize = filesize;
+			file = decodeFile(filename, std::move(file), filesize);
 		}
-		else curDirectory = "";
-
-		parse(file, filesize, scene, curDirectory, filename);
+	}
+	if(file || cached)
+	{
+		profiler::count(profiler::Counter::Files);
+		profiler::count(profiler::Counter::Bytes, filesize);
+		if (session)
+			session->enter(filename);
+		if(cached)
+		{
+			if (entry)
+			{
+				profiler::count(profiler::Counter::CachedFiles);
+				if (session)
+				{
+					session->addStream(filename, directory, entry->hash, size_t(entry->file.size), cached);
+					for (const auto& s : entry->spectra)
+						session->addFile(incremental::Kind::Spectrum, s.filename);
+				}
+			}
+			System::runtimeInfo("parsing " + filename + " (cached)");
+			execute(*cached, scene, filename);
+		}
+		else
+		{
+			auto e = std::make_shared<StreamCache::Entry>();
+			e->file = stamp;
+			e->hash = hash;
+			// the referenced files are read while this file is tokenized and executed
+			if (auto reader = prefetch::Reader::getCurrent())
+				prefetch::scan(*reader, file.get(), file.get() + filesize, directory, !session);
+			auto stream = std::make_shared<CommandStream>();
+			{
+				StreamCache::Recorder recorder(e->spectra);
+				tokenize(file, filesize, *stream, filename);
+			}
+			if (session)
+				session->addStream(filename, directory, e->hash, diskSize, stream);
+			e->stream = stream;
+			StreamCache::instance().store(filename, directory, e);
+			execute(*stream, scene, filename);
+		}
+		if (session)
+			session->leave();
 		return true;
 	}
+	System::setDirectory(previousDirectory);
 	System::error("cannot open file " + filename);
 	return false;
 }
\ No newline at end of file
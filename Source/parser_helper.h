@@ -1,9 +1,16 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <ctype.h>
 #include "parser_exception.h"
 #include "PBRT/PbrtScene.h"
 #include "PBRT/ParamSet.h"
+#include "profiler.h"
+#include "file.h"
+#include "scan.h"
+#include "incremental.h"
+#include "stream_cache.h"
 
 enum class pbrtParamType
 {
@@ -25,26 +32,24 @@ enum class pbrtParamType
 
 inline const char* skipSpace(const char* c)
 {
-	while (*c && isspace(*c)) c++;
+	while (*c && scan::isSpace(*c)) c++;
 	return c;
 }
 
 inline const char* skipSpace(const char* c, const char* end)
 {
-	while (*c && c < end && isspace(*c)) c++;
-	return c;
+	return scan::skipSpace(c, end);
 }
 
 inline const char* skipText(const char* c)
 {
-	while (*c && !isspace(*c)) c++;
+	while (*c && !scan::isSpace(*c)) c++;
 	return c;
 }
 
 inline const char* skipText(const char* c, const char* end)
 {
-	while(*c && c < end && !isspace(*c)) c++;
-	return c;
+	return scan::findSpace(c, end);
 }
 
 inline std::string extractString(const char* begin, const char* end)
@@ -53,12 +58,33 @@ inline std::string extractString(const char* begin, const char* end)
 	return s;
 }
 
+// line numbers of increasing positions in a file
+class LineCounter
+{
+public:
+	explicit LineCounter(const char* begin)
+		:
+	m_cur(begin)
+	{}
 
-// reads a file filled with floating point values
-inline std::vector<float> readFloatingFile(std::string filename)
+	uint32_t get(const char* pos)
+	{
+		if (pos > m_cur)
+		{
+			m_line += uint32_t(std::count(m_cur, pos, '\n'));
+			m_cur = pos;
+		}
+		return m_line;
+	}
+private:
+	const char* m_cur;
+	uint32_t m_line = 1;
+};
+
+
+// parses a file filled with floating point values
+inline std::vector<float> loadFloatingFile(const std::string& filename)
 {
-	// TODO cache spectra?
-	filename = System::fixPath(System::getCurrentDirectory() + filename);
 	std::vector<float> data;
 	size_t size = 0;
 	auto file = openFile(filename, size);
@@ -90,11 +116,11 @@ inline std::vector<float> readFloatingFile(std::string filename)
 		}
 	}
 
-	cur = skipSpace(cur);
+	cur = skipSpace(cur, end);
 
 	while(*cur && cur < end)
 	{
-		auto send = skipText(cur);
+		auto send = skipText(cur, end);
 		auto text = extractString(cur, send);
 		cur = send;
 		try
@@ -109,24 +135,44 @@ inline std::vector<float> readFloatingFile(std::string filename)
 		{
 			throw std::exception(("cannot convert " + text + " to float in file: " + filename).c_str());
 		}
-		cur = skipSpace(cur);
+		cur = skipSpace(cur, end);
 	}
 
 	return data;
 }
 
+// reads a file filled with floating point values (e.g. spds/metals/*.spd).
+// files are only parsed once (see FloatFileCache)
+inline std::vector<float> readFloatingFile(std::string filename)
+{
+	filename = System::fixPath(System::getCurrentDirectory() + filename);
+	if (auto session = incremental::Session::getCurrent())
+		session->addFile(incremental::Kind::Spectrum, filename);
+	const auto stamp = StreamCache::getFileStamp(filename);
+	// the values become part of the cached command stream
+	StreamCache::addSpectrum(stamp);
+	std::vector<float> data;
+	if (stamp.size >= 0 && FloatFileCache::instance().find(filename, data))
+		return data;
+
+	data = loadFloatingFile(filename);
+	if (stamp.size >= 0)
+		FloatFileCache::instance().store(stamp, data);
+	return data;
+}
+
 inline std::vector<float> getFloats(size_t num, const char*& cur, const char* end)
 {
 	std::vector<float> v;
-	cur = skipSpace(cur);
+	cur = skipSpace(cur, end);
 	if (*cur == '[')
 		++cur;
 
 	while (*cur && cur < end && v.size() < num)
 	{
-		cur = skipSpace(cur);
+		cur = skipSpace(cur, end);
 		// read float
-		auto send = skipText(cur);
+		auto send = skipText(cur, end);
 		auto text = extractString(cur, send);
 		cur = send;
 		try
@@ -151,22 +197,22 @@ inline std::vector<float> getFloats(size_t num, const char*& cur, const char* en
 // reads next string
 inline std::string getRawString(const char*& cur, const char* end)
 {
-	cur = skipSpace(cur);
+	cur = skipSpace(cur, end);
 	auto begin = cur;
-	cur = skipText(cur);
+	cur = skipText(cur, end);
 	return extractString(begin, cur);
 }
 
 // gets array surrounded by two tokens
 inline void getArrayBorders(const char*& cur, const char* end, const char*& abegin, const char*& aend, char sToken, char eToken)
 {
-	cur = skipSpace(cur);
+	cur = skipSpace(cur, end);
 	if (*cur != sToken)
 		throw InvalidToken(cur, *cur, std::string(&sToken,1));
 	// start token found
 	abegin = cur++;
 	// skip till next token
-	while (*cur && cur < end && *cur != eToken) ++cur;
+	cur = scan::findOrNull(cur, end, eToken);
 
 	if(*cur != eToken)
 		throw InvalidToken(cur, *cur, std::string(&eToken, 1));
@@ -255,8 +301,7 @@ inline std::vector<std::string> getStringVector(const char* begin, const char* e
 		auto sbegin = ++begin;
 
 		// search string end
-		while (begin < end && *begin != '\"')
-			begin++;
+		begin = scan::find(begin, end, '\"');
 
 		if (*begin != '\"')
 			throw InvalidToken(begin, *begin, "\"");
@@ -310,23 +355,48 @@ inline std::vector<int> getIntVector(const char* begin, const char* end)
 }
 inline std::vector<Vector> getVectorVector(const char* begin, const char* end)
 {
-	auto floats = getFloatVector(begin, end);
-	if (floats.size() % 3 != 0)
-		throw InvalidArgCount(end, floats.size(), (floats.size() / 3 + 1) * 3);
+	const auto raw = getRawStringVector(begin, end);
+	if (raw.size() % 3 != 0)
+		throw InvalidArgCount(end, raw.size(), (raw.size() / 3 + 1) * 3);
 	std::vector<Vector> args;
-	for(size_t i = 0; i < floats.size(); i += 3)
+	args.reserve(raw.size() / 3);
+	for(size_t i = 0; i < raw.size(); i += 3)
 	{
-		args.push_back(Vector(floats[i], floats[i + 1], floats[i + 2]));
+		const float x = convertRawToFloat(raw[i], end);
+		const float y = convertRawToFloat(raw[i + 1], end);
+		const float z = convertRawToFloat(raw[i + 2], end);
+		args.push_back(Vector(x, y, z));
 	}
 	return args;
 }
 
+// numeric arrays with more text are stored unconverted (ParamSet::LazyArray)
+static const size_t LAZY_ARRAY_BYTES = 4096;
+
+// converters for lazy array text
+inline std::vector<float> decodeFloats(const std::string& s)
+{
+	return getFloatVector(s.data(), s.data() + s.size());
+}
+inline std::vector<int> decodeInts(const std::string& s)
+{
+	return getIntVector(s.data(), s.data() + s.size());
+}
+inline std::vector<Vector> decodeVectors(const std::string& s)
+{
+	return getVectorVector(s.data(), s.data() + s.size());
+}
+
 // reads construct like: "float fov" [56]
-inline void initParamSet(ParamSet& p, const char*& cur, const char* end)
+// TParams: CommandStream (ParamSet interface + addArrayText for large numeric arrays)
+template<class TParams>
+void initParamSet(TParams& p, const char*& cur, const char* end)
 {
-	cur = skipSpace(cur);
+	profiler::ScopedTimer timer(profiler::Phase::ParamSet);
+	cur = skipSpace(cur, end);
 	while(*cur == '"') // next is probably another argument "type name" [args]
 	{
+		profiler::count(profiler::Counter::Parameters);
 		// determine type and name
 		const char* tbegin = nullptr;
 		const char* tend = nullptr;
@@ -347,7 +417,7 @@ inline void initParamSet(ParamSet& p, const char*& cur, const char* end)
 		if (paramType == pbrtParamType::ERROR)
 			throw InvalidArgument(cur, type);
 
-		cur = skipSpace(cur);
+		cur = skipSpace(cur, end);
 		char nextToken = *cur;
 		// because sometimes its "string name" "text" and sometimes "string name" ["text"] ...
 		// and sometimes its even "float name" 60 .. (single parameter)
@@ -359,7 +429,11 @@ inline void initParamSet(ParamSet& p, const char*& cur, const char* end)
 			++tbegin;
 
 			// integrate data
-			switch (paramType)
+			const bool isNumeric = paramType == pbrtParamType::Float || paramType == pbrtParamType::Integer ||
+				paramType == pbrtParamType::Point || paramType == pbrtParamType::Vector || paramType == pbrtParamType::Normal;
+			if (isNumeric && size_t(tend - tbegin) >= LAZY_ARRAY_BYTES)
+				p.addArrayText(paramType, name, tbegin, tend);
+			else switch (paramType)
 			{
 			case pbrtParamType::Float:
 				p.addFloat(name, getFloatVector(tbegin, tend));
@@ -447,6 +521,6 @@ inline void initParamSet(ParamSet& p, const char*& cur, const char* end)
 				throw InvalidToken(cur, nextToken, "[");
 			}
 		}
-		cur = skipSpace(cur);
+		cur = skipSpace(cur, end);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,339 @@
+#include "prefetch.h"
+#include "memory.h"
+#include "system.h"
+#include "profiler.h"
+#include "scan.h"
+#include "stream_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <sys/stat.h>
+
+using prefetch::Reader;
+
+namespace
+{
+	thread_local Reader* s_reader = nullptr;
+
+	// reads wait for the storage, so there are more threads than cores of a small machine
+	const size_t IO_THREADS = 8;
+
+	// threads of the reads of all readers
+	class IoQueue
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		static IoQueue& instance()
+		{
+			static IoQueue queue;
+			return queue;
+		}
+
+		~IoQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (auto& t : m_threads)
+				t.join();
+		}
+
+		void submit(Task task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				// the threads are started with the first read
+				if (m_threads.empty())
+					for (size_t i = 0; i < IO_THREADS; ++i)
+						m_threads.emplace_back(&IoQueue::loop, this);
+				m_tasks.push_back(std::move(task));
+			}
+			m_wake.notify_one();
+		}
+
+	private:
+		void loop()
+		{
+			while (true)
+			{
+				Task task;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_wake.wait(lock, [this]() { return m_stop || m_tasks.size(); });
+					if (m_tasks.empty())
+						return;
+					task = std::move(m_tasks.front());
+					m_tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::deque<Task> m_tasks;
+		std::vector<std::thread> m_threads;
+		bool m_stop = false;
+	};
+
+	// errors are reported by the reader of the file
+	std::unique_ptr<char[]> readFile(const std::string& filename, size_t size)
+	{
+		FILE* file = fopen(filename.c_str(), "rb");
+		if (!file)
+			return nullptr;
+		std::unique_ptr<char[]> data(new char[size + prefetch::PADDING]);
+		const size_t count = fread(data.get(), 1, size, file);
+		fclose(file);
+		if (count != size)
+			return nullptr;
+		memset(data.get() + size, 0, prefetch::PADDING);
+		return data;
+	}
+
+	bool isWordStart(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+	}
+
+	// "type name" of a parameter declaration
+	bool getDeclaration(const std::string& s, std::string& type, std::string& name)
+	{
+		const size_t typeStart = s.find_first_not_of(" \t");
+		if (typeStart == std::string::npos)
+			return false;
+		const size_t typeEnd = s.find_first_of(" \t", typeStart);
+		if (typeEnd == std::string::npos)
+			return false;
+		const size_t nameStart = s.find_first_not_of(" \t", typeEnd);
+		if (nameStart == std::string::npos)
+			return false;
+		const size_t nameEnd = s.find_first_of(" \t", nameStart);
+		type = s.substr(typeStart, typeEnd - typeStart);
+		name = s.substr(nameStart, nameEnd == std::string::npos ? std::string::npos : nameEnd - nameStart);
+		return true;
+	}
+}
+
+Reader::Reader()
+	:
+m_limit(memory::getBudget() / 8)
+{}
+
+Reader::~Reader()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	// queued reads are skipped
+	m_cancelled = true;
+	m_done.wait(lock, [this]() { return m_pending == 0; });
+	if (s_reader == this)
+		s_reader = nullptr;
+}
+
+Reader* Reader::getCurrent()
+{
+	return s_reader;
+}
+
+Reader::Scope::Scope(Reader* reader)
+	:
+m_previous(s_reader)
+{
+	s_reader = reader;
+}
+
+Reader::Scope::~Scope()
+{
+	s_reader = m_previous;
+}
+
+void Reader::request(const std::string& filename)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bytes >= m_limit || !m_entries.insert(std::make_pair(filename, Entry())).second)
+			return;
+		++m_pending;
+	}
+	IoQueue::instance().submit([this, filename]()
+	{
+		read(filename);
+	});
+}
+
+std::unique_ptr<char[]> Reader::take(const std::string& filename, size_t& size)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(filename);
+	if (it == m_entries.end())
+		return nullptr;
+	Entry& e = it->second;
+	// a read that did not start is not faster than reading the file directly
+	if (e.state == State::Queued)
+		e.state = State::Taken;
+	m_done.wait(lock, [&e]() { return e.state != State::Reading; });
+	if (e.state != State::Done)
+		return nullptr;
+
+	e.state = State::Taken;
+	m_bytes -= e.size;
+	size = e.size;
+	profiler::count(profiler::Counter::PrefetchedFiles);
+	return std::move(e.data);
+}
+
+void Reader::read(const std::string& filename)
+{
+	Entry* e;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		e = &m_entries[filename];
+		if (e->state != State::Queued || m_cancelled)
+			e = nullptr;
+		else
+			e->state = State::Reading;
+	}
+
+	std::unique_ptr<char[]> data;
+	size_t size = 0;
+	if (e)
+	{
+		struct stat info;
+		if (stat(filename.c_str(), &info) == 0)
+		{
+			size = size_t(info.st_size);
+			bool fits;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				fits = m_bytes + size <= m_limit;
+				// reserved while reading
+				if (fits)
+					m_bytes += size;
+			}
+			if (fits)
+			{
+				data = readFile(filename, size);
+				if (!data)
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_bytes -= size;
+				}
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (e)
+		{
+			e->state = data ? State::Done : State::Taken;
+			e->data = std::move(data);
+			e->size = size;
+		}
+		--m_pending;
+	}
+	m_done.notify_all();
+}
+
+void prefetch::scan(Reader& reader, const char* c, const char* end, const std::string& directory, bool includes)
+{
+	enum class Value
+	{
+		None,
+		Include,
+		Ply,
+		Spectrum
+	};
+	// last keyword and whether its first string (the shape type) was seen
+	std::string directive;
+	bool hasType = false;
+	bool plymesh = false;
+	// file that is named by the next string
+	Value pending = Value::None;
+	bool inArray = false;
+	// includes are tokenized with their own directory with --dirhierarchy (see parseFile)
+	const bool dirHierarchy = System::args.get("dirhierarchy", false);
+
+	while (c < end && *c)
+	{
+		if (*c == '#')
+		{
+			auto line = static_cast<const char*>(memchr(c, '\n', end - c));
+			c = line ? line : end;
+			continue;
+		}
+		if (*c == '"')
+		{
+			const char* start = ++c;
+			auto quote = static_cast<const char*>(memchr(c, '"', end - c));
+			c = quote ? quote + 1 : end;
+			const std::string s(start, quote ? quote : end);
+
+			if (pending != Value::None)
+			{
+				// files that are cached are not read
+				const std::string filename = System::fixPath(directory + s);
+				bool cached = false;
+				if (pending == Value::Include)
+				{
+					const auto slash = filename.find_last_of("\\/");
+					const std::string includeDirectory = dirHierarchy && slash != std::string::npos ? filename.substr(0, slash + 1) : directory;
+					cached = !includes || StreamCache::instance().contains(filename, includeDirectory);
+				}
+				else if (pending == Value::Spectrum)
+					cached = FloatFileCache::instance().contains(filename);
+				if (!cached)
+					reader.request(filename);
+				pending = Value::None;
+				continue;
+			}
+			if (!hasType)
+			{
+				hasType = true;
+				plymesh = directive == "Shape" && s == "plymesh";
+				continue;
+			}
+			std::string type, name;
+			if (!getDeclaration(s, type, name))
+				continue;
+			if (type == "spectrum" || type == "blackbody")
+				pending = Value::Spectrum;
+			else if (plymesh && type == "string" && name == "filename")
+				pending = Value::Ply;
+			continue;
+		}
+		if (isWordStart(*c))
+		{
+			const char* start = c;
+			while (c < end && (isWordStart(*c) || (*c >= '0' && *c <= '9')))
+				++c;
+			directive.assign(start, c);
+			hasType = false;
+			inArray = false;
+			plymesh = false;
+			pending = directive == "Include" ? Value::Include : Value::None;
+			continue;
+		}
+		// the value of a file can be in brackets
+		if (*c == '[' || *c == ']')
+		{
+			inArray = *c++ == '[';
+			continue;
+		}
+		if (::scan::isSpace(*c))
+		{
+			c = ::scan::skipSpace(c, end);
+			continue;
+		}
+		// a number ends the parameter. Numeric arrays are skipped up to the closing bracket,
+		// single numbers as a whole token (because of exponents like 1e5)
+		c = inArray ? ::scan::findOrNull(c, end, ']') : ::scan::findSpace(c, end);
+		pending = Value::None;
+	}
+}
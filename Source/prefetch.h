@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+// read ahead of the files that are referenced by a pbrt file. parseFile scans the text of a file for Include
+// statements, plymesh filenames and spectrum files before the tokenization and requests them. The reads run on
+// a few i/o threads, so the bytes are already in memory (or in flight) when the parser reaches the statement
+// instead of blocking on every file of a network mounted asset store
+namespace prefetch
+{
+	// zero bytes after the data (same as openFile)
+	static const size_t PADDING = 100;
+
+	// reads of one conversion. The reader has to be bound to the thread that parses the scene (see Scope).
+	// Buffers that were not taken are released with the reader
+	class Reader
+	{
+	public:
+		Reader();
+		// waits for the reads in flight
+		~Reader();
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		// reader of the calling thread or nullptr
+		static Reader* getCurrent();
+
+		class Scope
+		{
+		public:
+			explicit Scope(Reader* reader);
+			~Scope();
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			Reader* m_previous;
+		};
+
+		// starts reading filename unless it was requested before
+		void request(const std::string& filename);
+		// data of a requested file (waits for a read in flight) or nullptr if the caller has to read the file
+		// itself: not requested, not started yet, failed or above the memory limit
+		std::unique_ptr<char[]> take(const std::string& filename, size_t& size);
+
+	private:
+		enum class State
+		{
+			Queued,
+			Reading,
+			Done,
+			Taken // or failed
+		};
+		struct Entry
+		{
+			State state = State::Queued;
+			std::unique_ptr<char[]> data;
+			size_t size = 0;
+		};
+
+		void read(const std::string& filename);
+
+		std::mutex m_mutex;
+		std::condition_variable m_done;
+		std::unordered_map<std::string, Entry> m_entries;
+		// bytes that were read and not taken
+		size_t m_bytes = 0;
+		size_t m_limit;
+		size_t m_pending = 0;
+		bool m_cancelled = false;
+	};
+
+	// requests the files that are referenced by the pbrt text [c, end). directory: current directory of the file,
+	// includes: false if the included files are read from a cache (--incremental). Includes and spectra that are
+	// in the StreamCache or FloatFileCache are not requested
+	void scan(Reader& reader, const char* c, const char* end, const std::string& directory, bool includes);
+}
@@ -0,0 +1,230 @@
+#include "profiler.h"
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+bool profiler::g_enabled = false;
+bool profiler::g_tracing = false;
+
+static const char* s_phaseNames[] = { "read_file", "decompress", "comments", "parse", "replay", "param_set", "shape", "plymesh", "material", "normals",
+	"axis_swap", "tessellate", "bvh" };
+static const char* s_counterNames[] = { "files", "bytes", "cached_files", "prefetched_files", "parameters", "ply_vertices", "ply_faces", "spilled_meshes", "spilled_bytes" };
+static_assert(sizeof(s_phaseNames) / sizeof(s_phaseNames[0]) == size_t(profiler::Phase::SIZE), "missing phase name");
+static_assert(sizeof(s_counterNames) / sizeof(s_counterNames[0]) == size_t(profiler::Counter::SIZE), "missing counter name");
+
+static std::atomic<uint64_t> s_phaseTime[size_t(profiler::Phase::SIZE)];
+static std::atomic<uint64_t> s_phaseCalls[size_t(profiler::Phase::SIZE)];
+static std::atomic<uint64_t> s_counters[size_t(profiler::Counter::SIZE)];
+// nesting depth of the phases on this thread
+static thread_local int s_depth[size_t(profiler::Phase::SIZE)];
+
+// completed timer scopes of one thread. The mutex guards the events against saveTrace
+struct TraceBuffer
+{
+	std::mutex mutex;
+	struct Event
+	{
+		profiler::Phase phase;
+		int64_t begin; // nanoseconds since the trace start
+		int64_t duration;
+		std::string detail;
+	};
+	size_t threadId = 0;
+	std::vector<Event> events;
+	size_t next = 0; // oldest event once the buffer wrapped around
+	size_t dropped = 0;
+};
+
+static size_t s_traceCapacity = 0;
+static std::chrono::steady_clock::time_point s_traceStart;
+static std::mutex s_traceMutex;
+// all buffers stay alive until the trace was saved (threads of parallel.h may end before)
+static std::vector<std::unique_ptr<TraceBuffer>> s_traceBuffers;
+static thread_local TraceBuffer* s_traceBuffer = nullptr;
+
+static TraceBuffer& getTraceBuffer()
+{
+	if (!s_traceBuffer)
+	{
+		std::lock_guard<std::mutex> lock(s_traceMutex);
+		s_traceBuffers.emplace_back(new TraceBuffer());
+		s_traceBuffer = s_traceBuffers.back().get();
+		s_traceBuffer->threadId = s_traceBuffers.size();
+	}
+	return *s_traceBuffer;
+}
+
+static void record(profiler::Phase phase, std::chrono::steady_clock::time_point start,
+	std::chrono::steady_clock::time_point end, const std::string& detail)
+{
+	auto& buffer = getTraceBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	TraceBuffer::Event* e;
+	if (buffer.events.size() < s_traceCapacity)
+	{
+		buffer.events.emplace_back();
+		e = &buffer.events.back();
+	}
+	else
+	{
+		e = &buffer.events[buffer.next];
+		buffer.next = (buffer.next + 1) % buffer.events.size();
+		++buffer.dropped;
+	}
+	e->phase = phase;
+	e->begin = std::chrono::duration_cast<std::chrono::nanoseconds>(start - s_traceStart).count();
+	e->duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	e->detail = detail;
+}
+
+void profiler::setEnabled(bool enabled)
+{
+	g_enabled = enabled;
+}
+
+void profiler::addCount(Counter counter, uint64_t value)
+{
+	s_counters[size_t(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+std::chrono::steady_clock::time_point profiler::enter(Phase phase)
+{
+	++s_depth[size_t(phase)];
+	return std::chrono::steady_clock::now();
+}
+
+void profiler::leave(Phase phase, std::chrono::steady_clock::time_point start, const std::string& detail)
+{
+	const auto end = std::chrono::steady_clock::now();
+	const auto idx = size_t(phase);
+	const bool outermost = --s_depth[idx] == 0;
+	if (g_enabled)
+	{
+		s_phaseCalls[idx].fetch_add(1, std::memory_order_relaxed);
+		if (outermost)
+		{
+			const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			s_phaseTime[idx].fetch_add(uint64_t(ns), std::memory_order_relaxed);
+		}
+	}
+	if (g_tracing)
+		record(phase, start, end, detail);
+}
+
+static double getMilliseconds(size_t phase)
+{
+	return double(s_phaseTime[phase].load()) / 1e6;
+}
+
+void profiler::displaySummary()
+{
+	if (!g_enabled)
+		return;
+
+	std::cerr << "STATISTICS:\n";
+	const auto flags = std::cerr.flags();
+	std::cerr << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < size_t(Phase::SIZE); ++i)
+	{
+		if (s_phaseCalls[i].load() == 0)
+			continue;
+		std::cerr << std::left << std::setw(16) << s_phaseNames[i] << std::right << std::setw(14) << getMilliseconds(i)
+			<< " ms (" << s_phaseCalls[i].load() << " calls)\n";
+	}
+	for (size_t i = 0; i < size_t(Counter::SIZE); ++i)
+	{
+		if (s_counters[i].load() == 0)
+			continue;
+		std::cerr << std::left << std::setw(16) << s_counterNames[i] << std::right << std::setw(14) << s_counters[i].load() << "\n";
+	}
+	std::cerr.flags(flags);
+}
+
+bool profiler::saveJson(const std::string& filename)
+{
+	std::ofstream file(filename);
+	if (!file)
+		return false;
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\n\t\"phases\": {";
+	for (size_t i = 0; i < size_t(Phase::SIZE); ++i)
+	{
+		file << (i ? "," : "") << "\n\t\t\"" << s_phaseNames[i] << "\": { \"ms\": " << getMilliseconds(i)
+			<< ", \"calls\": " << s_phaseCalls[i].load() << " }";
+	}
+	file << "\n\t},\n\t\"counters\": {";
+	for (size_t i = 0; i < size_t(Counter::SIZE); ++i)
+	{
+		file << (i ? "," : "") << "\n\t\t\"" << s_counterNames[i] << "\": " << s_counters[i].load();
+	}
+	file << "\n\t}\n}\n";
+	return bool(file);
+}
+
+void profiler::startTrace(size_t eventsPerThread)
+{
+	s_traceCapacity = std::max(eventsPerThread, size_t(1));
+	s_traceStart = std::chrono::steady_clock::now();
+	g_tracing = true;
+}
+
+static void writeJsonString(std::ostream& o, const std::string& s)
+{
+	o << '"';
+	for (const char c : s)
+	{
+		if (c == '"' || c == '\\')
+			o << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			o << ' ';
+		else
+			o << c;
+	}
+	o << '"';
+}
+
+bool profiler::saveTrace(const std::string& filename)
+{
+	if (!g_tracing)
+		return false;
+
+	std::ofstream file(filename);
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(s_traceMutex);
+	size_t dropped = 0;
+	bool first = true;
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	for (const auto& buffer : s_traceBuffers)
+	{
+		std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+		dropped += buffer->dropped;
+		file << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->threadId
+			<< ", \"args\": {\"name\": \"thread " << buffer->threadId << "\"}}";
+		first = false;
+		// oldest first
+		for (size_t i = 0; i < buffer->events.size(); ++i)
+		{
+			const auto& e = buffer->events[(buffer->next + i) % buffer->events.size()];
+			file << ",\n{\"name\": \"" << s_phaseNames[size_t(e.phase)] << "\", \"cat\": \"pbrt\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+				<< buffer->threadId << ", \"ts\": " << double(e.begin) / 1000.0 << ", \"dur\": " << double(e.duration) / 1000.0;
+			if (!e.detail.empty())
+			{
+				file << ", \"args\": {\"detail\": ";
+				writeJsonString(file, e.detail);
+				file << "}";
+			}
+			file << "}";
+		}
+	}
+	file << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+	return bool(file);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+// phase timers and counters for --stats and chrome trace events for --trace.
+// When disabled a timer or counter costs a single branch
+namespace profiler
+{
+	enum class Phase
+	{
+		ReadFile, // loading scene files into memory
+		Decompress, // decoding gzip and zstd compressed scene files (part of ReadFile)
+		Comments, // comment removal pass
+		Parse, // tokenizing the commands into a CommandStream
+		Replay, // executing the commands (includes included files and the phases below)
+		ParamSet, // parameter lists (tokenizing, large arrays are converted on access)
+		Shape, // apiShape (includes shape file loading)
+		Plymesh, // Plymesh::init
+		Material, // material creation (named materials and the materials of shapes)
+		Normals, // flat and edge normal generation
+		AxisSwap, // post processing of the scene
+		Tessellate,
+		Bvh,
+		SIZE
+	};
+
+	enum class Counter
+	{
+		Files,
+		Bytes,
+		CachedFiles, // includes that were replayed from the stream cache
+		PrefetchedFiles, // files that were read ahead of the parser
+		Parameters,
+		PlyVertices,
+		PlyFaces,
+		SpilledMeshes,
+		SpilledBytes,
+		SIZE
+	};
+
+	extern bool g_enabled;
+	extern bool g_tracing;
+
+	inline bool isEnabled()
+	{
+		return g_enabled;
+	}
+	void setEnabled(bool enabled);
+
+	void addCount(Counter counter, uint64_t value);
+	inline void count(Counter counter, uint64_t value = 1)
+	{
+		if (g_enabled)
+			addCount(counter, value);
+	}
+
+	std::chrono::steady_clock::time_point enter(Phase phase);
+	void leave(Phase phase, std::chrono::steady_clock::time_point start, const std::string& detail);
+
+	// measures the time until the end of the scope. Only the outermost timer of a phase
+	// adds time per thread (parse calls itself for includes), calls are always counted.
+	// While tracing every timer is recorded as an event with a copy of detail (e.g. the filename)
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Phase phase, const char* detail = nullptr)
+			: m_phase(phase), m_active(g_enabled || g_tracing)
+		{
+			if (g_tracing && detail)
+				m_detail = detail;
+			if (m_active)
+				m_start = enter(phase);
+		}
+		ScopedTimer(Phase phase, const std::string& detail)
+			: m_phase(phase), m_active(g_enabled || g_tracing)
+		{
+			if (g_tracing)
+				m_detail = detail;
+			if (m_active)
+				m_start = enter(phase);
+		}
+		~ScopedTimer()
+		{
+			if (m_active)
+				leave(m_phase, m_start, m_detail);
+		}
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	private:
+		Phase m_phase;
+		bool m_active;
+		std::string m_detail;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// prints the phase times and counters
+	void displaySummary();
+	// writes the phase times and counters as json
+	bool saveJson(const std::string& filename);
+
+	// starts recording events into per thread ring buffers (the oldest events of a thread are dropped when it is full)
+	void startTrace(size_t eventsPerThread = 1 << 18);
+	// writes the recorded events in the chrome trace format (chrome://tracing, ui.perfetto.dev)
+	bool saveTrace(const std::string& filename);
+}
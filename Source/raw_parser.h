@@ -4,18 +4,38 @@
 #include "parser_helper.h"
 #include "PBRT/TextureParams.h"
 #include "system.h"
+#include "profiler.h"
 
-#define API_MODUL(func) auto name = getString(cursor,end); ParamSet set; initParamSet(set, cursor,end); \
-						scene.func(name,set);
+// starts a command, the line is counted incrementally from the previous command
+#define COMMAND(op) out.begin(CommandStream::Op::op, lines.get(cursor))
+#define API_MODUL(op) COMMAND(op); out.writeString(getString(cursor,end)); out.beginParams(); initParamSet(out, cursor,end);
 
 /*!re2c re2c:define:YYCTYPE = "char"; */
 
 void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene, std::string directory, const std::string& filename)
 {
 	System::setDirectory(directory);
+
+	// the whole file is tokenized before the commands are executed. Included files are parsed during the execution
+	CommandStream stream;
+	tokenize(data, length, stream, filename);
+	execute(stream, scene, filename);
+}
+
+void execute(const CommandStream& stream, PbrtScene& scene, const std::string& filename)
+{
 	// special case for --nodirhierarchy
-	directory = System::getCurrentDirectory();
+	const std::string directory = System::getCurrentDirectory();
+	System::runtimeInfo("executing commands");
+	replay(stream, scene, [&](const std::string& file)
+	{
+		parseFile(file, scene, directory);
+		System::setDirectory(directory);
+	}, filename);
+}
 
+void tokenize(const std::unique_ptr<char[]>& data, size_t length, CommandStream& out, const std::string& filename)
+{
 	const char* cursor = data.get();
 	const char* const end = data.get() + length;
 	const char* marker = nullptr;
@@ -23,6 +43,7 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 	System::runtimeInfo("removing comments");
 	// remove comments
 	{
+		profiler::ScopedTimer timer(profiler::Phase::Comments);
 		bool isComment = false;
 		bool isString = false;
 		char* c = data.get();
@@ -49,6 +70,8 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 		}
 	}
 	System::runtimeInfo("parsing commands");
+	profiler::ScopedTimer timer(profiler::Phase::Parse, filename);
+	LineCounter lines(data.get());
 	try
 	{
 		while (cursor < end && *cursor)
@@ -65,59 +88,59 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 			*	{													continue; }
 			"#"	{ while(*cursor && *cursor != '\n') cursor++;		continue; }
 
-			"Identity"	{ scene.apiIdentity();						continue; }
-			"Translate"	{ scene.apiTranslate(getFloats(3,cursor,end));		continue; }
-			"Scale"		{ scene.apiScale(getFloats(3,cursor,end));	continue; }
-			"Rotate"	{ scene.apiRotate(getFloats(4,cursor,end));	continue; }
-			"LookAt"	{ scene.apiLookAt(getFloats(9,cursor,end));	continue; }
-			"Transform"	{ scene.apiTransform(getFloats(4 * 4,cursor,end));		continue; }
-			"ConcatTransform"	{ scene.apiConcatTransfrom(getFloats(4 * 4,cursor,end));	continue; }
-			"ActiveTransform StartTime" { scene.apiSetActiveTransform(true);	continue; }
-			"ActiveTransform EndTime" { scene.apiSetActiveTransform(false);		continue; }
-			"ActiveTransform All"	{ scene.apiSetActiveTransform(true);		continue; }
-			"CoordinateSystem"		{ scene.apiCoordinateSystem(getString(cursor,end));	continue; }
-			"CoordSysTransform"		{ scene.apiCoordSysTransform(getString(cursor,end)); continue;}
+			"Identity"	{ COMMAND(Identity);						continue; }
+			"Translate"	{ COMMAND(Translate); out.writeFloats(getFloats(3,cursor,end));		continue; }
+			"Scale"		{ COMMAND(Scale); out.writeFloats(getFloats(3,cursor,end));	continue; }
+			"Rotate"	{ COMMAND(Rotate); out.writeFloats(getFloats(4,cursor,end));	continue; }
+			"LookAt"	{ COMMAND(LookAt); out.writeFloats(getFloats(9,cursor,end));	continue; }
+			"Transform"	{ COMMAND(Transform); out.writeFloats(getFloats(4 * 4,cursor,end));		continue; }
+			"ConcatTransform"	{ COMMAND(ConcatTransform); out.writeFloats(getFloats(4 * 4,cursor,end));	continue; }
+			"ActiveTransform StartTime" { COMMAND(ActiveTransform); out.writeWord(1);	continue; }
+			"ActiveTransform EndTime" { COMMAND(ActiveTransform); out.writeWord(0);		continue; }
+			"ActiveTransform All"	{ COMMAND(ActiveTransform); out.writeWord(1);		continue; }
+			"CoordinateSystem"		{ COMMAND(CoordinateSystem); out.writeString(getString(cursor,end));	continue; }
+			"CoordSysTransform"		{ COMMAND(CoordSysTransform); out.writeString(getString(cursor,end)); continue;}
 
-			"AttributeBegin"	{ scene.apiAttributeBegin();		continue; }
-			"AttributeEnd"		{ scene.apiAttributeEnd();			continue; }
-			"TransformBegin"	{ scene.apiTransformBegin();		continue; }
-			"TransformEnd"		{ scene.apiTransformEnd();			continue; }
-			"WorldBegin"		{ scene.apiWorldBegin();			continue; }
-			"WorldEnd"			{ scene.apiWorldEnd();				break; }
+			"AttributeBegin"	{ COMMAND(AttributeBegin);		continue; }
+			"AttributeEnd"		{ COMMAND(AttributeEnd);			continue; }
+			"TransformBegin"	{ COMMAND(TransformBegin);		continue; }
+			"TransformEnd"		{ COMMAND(TransformEnd);			continue; }
+			"WorldBegin"		{ COMMAND(WorldBegin);			continue; }
+			"WorldEnd"			{ COMMAND(WorldEnd);				break; }
 
-			"Camera"			{ API_MODUL(apiCamera);				continue; }
-			"Sampler"			{ API_MODUL(apiSampler);			continue; }
-			"Film"				{ API_MODUL(apiFilm);				continue; }
-			"Renderer"			{ API_MODUL(apiRenderer);			continue; }
-			"SurfaceIntegrator"	{ API_MODUL(apiSurfaceIntegrator);	continue; }
-			"VolumeIntegrator"	{ API_MODUL(apiVolumeIntegrator);	continue; }
-			"Accelerator"		{ API_MODUL(apiAccelerator);		continue; }
-			"PixelFilter"		{ API_MODUL(apiPixelFilter);		continue; }
+			"Camera"			{ API_MODUL(Camera);				continue; }
+			"Sampler"			{ API_MODUL(Sampler);			continue; }
+			"Film"				{ API_MODUL(Film);				continue; }
+			"Renderer"			{ API_MODUL(Renderer);			continue; }
+			"SurfaceIntegrator"	{ API_MODUL(SurfaceIntegrator);	continue; }
+			"VolumeIntegrator"	{ API_MODUL(VolumeIntegrator);	continue; }
+			"Accelerator"		{ API_MODUL(Accelerator);		continue; }
+			"PixelFilter"		{ API_MODUL(PixelFilter);		continue; }
 			
-			"Shape"				{ API_MODUL(apiShape);				continue; }
-			"ObjectBegin"		{ scene.apiObjectBegin(getString(cursor,end)); continue; }
-			"ObjectEnd"			{ scene.apiObjectEnd();				continue; }
-			"ObjectInstance"	{ scene.apiObjectInstance(getString(cursor,end)); continue; }
-			"LightSource"		{ API_MODUL(apiLightSource);		continue; }
-			"AreaLightSource"	{ API_MODUL(apiAreaLightSource);	continue; }
-			"ReverseOrientation"{ scene.apiReverseOrientation();	continue; }
-			"Material"			{ API_MODUL(apiMaterial);			continue; }
-			"MakeNamedMaterial"	{ API_MODUL(apiMakeNamedMaterial);	continue; }
-			"NamedMaterial"		{ scene.apiNamedMaterial(getString(cursor,end)); continue; }
-			"Volume"			{ API_MODUL(apiVolume);				continue; }
+			"Shape"				{ API_MODUL(Shape);				continue; }
+			"ObjectBegin"		{ COMMAND(ObjectBegin); out.writeString(getString(cursor,end)); continue; }
+			"ObjectEnd"			{ COMMAND(ObjectEnd);				continue; }
+			"ObjectInstance"	{ COMMAND(ObjectInstance); out.writeString(getString(cursor,end)); continue; }
+			"LightSource"		{ API_MODUL(LightSource);		continue; }
+			"AreaLightSource"	{ API_MODUL(AreaLightSource);	continue; }
+			"ReverseOrientation"{ COMMAND(ReverseOrientation);	continue; }
+			"Material"			{ API_MODUL(Material);			continue; }
+			"MakeNamedMaterial"	{ API_MODUL(MakeNamedMaterial);	continue; }
+			"NamedMaterial"		{ COMMAND(NamedMaterial); out.writeString(getString(cursor,end)); continue; }
+			"Volume"			{ API_MODUL(Volume);				continue; }
 			"Texture"			{
-									auto name = getString(cursor,end);
-									auto type = getString(cursor,end);
-									auto clas = getString(cursor,end);
-									ParamSet set; initParamSet(set, cursor,end);
-									scene.apiTexture(name,type,clas,set);
+									COMMAND(Texture);
+									out.writeString(getString(cursor,end));
+									out.writeString(getString(cursor,end));
+									out.writeString(getString(cursor,end));
+									out.beginParams(); initParamSet(out, cursor,end);
 									continue;
 								}
 
 			"Include"			{	
-									auto filename = getString(cursor, end);
-									parseFile(filename,scene,directory); 
-									System::setDirectory(directory);
+									// the file is parsed when the command is executed
+									COMMAND(Include);
+									out.writeString(getString(cursor, end));
 									continue; 	
 								}
 			
@@ -130,7 +153,7 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 		size_t line = 1;
 		const char* cur = data.get();
 		while (cur < e.where()) { if (*cur == '\n')++line;++cur; }
-		System::error("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
+		out.fail("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
 	}
 	catch(const std::exception& e)
 	{
@@ -138,7 +161,7 @@ void parse(const std::unique_ptr<char[]>& data, size_t length, PbrtScene& scene,
 		size_t line = 1;
 		const char* cur = data.get();
 		while (cur < cursor) { if (*cur == '\n')++line; ++cur; }
-		System::error("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
+		out.fail("line: " + std::to_string(line) + " : " + std::string(e.what()) + " in file: " + filename);
 	}
 }
 
@@ -195,6 +195,8 @@ typedef struct t_ply_ {
     char *obj_info;
     long nobj_infos;
     FILE *fp;
+    p_ply_input_cb input_cb;
+    void *input_data;
     int rn;
     char buffer[BUFFERSIZE];
     size_t buffer_first, buffer_token, buffer_last;
@@ -302,6 +304,12 @@ static int ply_read_scalar_property(p_ply ply, p_ply_element element,
 /* consumes data from buffer */
 #define BSKIP(p, s) (p->buffer_first += s)
 
+/* reads from the file or the input callback */
+static size_t ply_read_raw(p_ply ply, char *buffer, size_t size) {
+    if (ply->input_cb) return ply->input_cb(ply->input_data, buffer, size);
+    return fread(buffer, 1, size, ply->fp);
+}
+
 /* refills the buffer */
 static int BREFILL(p_ply ply) {
     /* move untouched data to beginning of buffer */
@@ -310,7 +318,7 @@ static int BREFILL(p_ply ply) {
     ply->buffer_last = size;
     ply->buffer_first = ply->buffer_token = 0;
     /* fill remaining with new data */
-    size = fread(ply->buffer + size, 1, BUFFERSIZE - size - 1, ply->fp);
+    size = ply_read_raw(ply, ply->buffer + size, BUFFERSIZE - size - 1);
     /* place sentinel so we can use str* functions with buffer */
     ply->buffer[BUFFERSIZE - 1] = '\0';
     /* check if read failed */
@@ -354,6 +362,30 @@ static int ply_read_header_magic(p_ply ply) {
 p_ply ply_open(const char *name, p_ply_error_cb error_cb, long idata,
                void *pdata) {
     FILE *fp = NULL;
+    p_ply ply = NULL;
+    if (error_cb == NULL) error_cb = ply_error_cb;
+    assert(name);
+    fp = fopen(name, "rb");
+    if (!fp) {
+        error_cb(NULL, "Unable to open file");
+        return NULL;
+    }
+    ply = ply_open_from_file(fp, error_cb, idata, pdata);
+    if (!ply) fclose(fp);
+    return ply;
+}
+
+p_ply ply_open_from_file(FILE *fp, p_ply_error_cb error_cb, long idata,
+               void *pdata) {
+    p_ply ply = NULL;
+    assert(fp);
+    ply = ply_open_from_callback(NULL, NULL, error_cb, idata, pdata);
+    if (ply) ply->fp = fp;
+    return ply;
+}
+
+p_ply ply_open_from_callback(p_ply_input_cb input_cb, void *input_data,
+               p_ply_error_cb error_cb, long idata, void *pdata) {
     p_ply ply = ply_alloc();
     if (error_cb == NULL) error_cb = ply_error_cb;
     if (!ply) {
@@ -369,19 +401,13 @@ p_ply ply_open(const char *name, p_ply_error_cb error_cb, long idata,
         free(ply);
         return NULL;
     }
-    assert(name);
-    fp = fopen(name, "rb");
-    if (!fp) {
-        error_cb(ply, "Unable to open file");
-        free(ply);
-        return NULL;
-    }
-    ply->fp = fp;
+    ply->input_cb = input_cb;
+    ply->input_data = input_data;
     return ply;
 }
 
 int ply_read_header(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     if (!ply_read_header_magic(ply)) return 0;
     if (!ply_read_word(ply)) return 0;
     /* parse file format */
@@ -427,7 +453,7 @@ long ply_set_read_cb(p_ply ply, const char *element_name,
 int ply_read(p_ply ply) {
     long i;
     p_ply_argument argument;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     argument = &ply->argument;
     /* for each element type */
     for (i = 0; i < ply->nelements; i++) {
@@ -670,7 +696,7 @@ int ply_write(p_ply ply, double value) {
 
 int ply_close(p_ply ply) {
     long i;
-    assert(ply && ply->fp);
+    assert(ply && (ply->fp || ply->input_cb));
     assert(ply->element || ply->nelements == 0);
     assert(!ply->element || ply->nelements > 0);
     /* write last chunk to file */
@@ -679,7 +705,7 @@ int ply_close(p_ply ply) {
         ply_ferror(ply, "Error closing up");
         return 0;
     }
-    fclose(ply->fp);
+    if (ply->fp) fclose(ply->fp);
     /* free all memory used by handle */
     if (ply->element) {
         for (i = 0; i < ply->nelements; i++) {
@@ -945,7 +971,7 @@ static int ply_check_word(p_ply ply) {
 
 static int ply_read_word(p_ply ply) {
     size_t t = 0;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     /* skip leading blanks */
     while (1) {
         t = strspn(BFIRST(ply), " \n\r\t");
@@ -1003,7 +1029,7 @@ static int ply_check_line(p_ply ply) {
 
 static int ply_read_line(p_ply ply) {
     const char *end = NULL;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     /* look for a end of line */
     end = strchr(BFIRST(ply), '\n');
     /* if we didn't reach the end of the buffer, we are done */
@@ -1039,7 +1065,7 @@ static int ply_read_line(p_ply ply) {
 static int ply_read_chunk(p_ply ply, void *anybuffer, size_t size) {
     char *buffer = (char *)anybuffer;
     size_t i = 0;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     assert(ply->buffer_first <= ply->buffer_last);
     while (i < size) {
         if (ply->buffer_first < ply->buffer_last) {
@@ -1048,7 +1074,7 @@ static int ply_read_chunk(p_ply ply, void *anybuffer, size_t size) {
             i++;
         } else {
             ply->buffer_first = 0;
-            ply->buffer_last = fread(ply->buffer, 1, BUFFERSIZE, ply->fp);
+            ply->buffer_last = ply_read_raw(ply, ply->buffer, BUFFERSIZE);
             if (ply->buffer_last <= 0) return 0;
         }
     }
@@ -1184,7 +1210,7 @@ static p_ply_property ply_grow_property(p_ply ply, p_ply_element element) {
 }
 
 static int ply_read_header_format(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "format")) return 0;
     if (!ply_read_word(ply)) return 0;
     ply->storage_mode =
@@ -1203,7 +1229,7 @@ static int ply_read_header_format(p_ply ply) {
 }
 
 static int ply_read_header_comment(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "comment")) return 0;
     if (!ply_read_line(ply)) return 0;
     if (!ply_add_comment(ply, BLINE(ply))) return 0;
@@ -1212,7 +1238,7 @@ static int ply_read_header_comment(p_ply ply) {
 }
 
 static int ply_read_header_obj_info(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "obj_info")) return 0;
     if (!ply_read_line(ply)) return 0;
     if (!ply_add_obj_info(ply, BLINE(ply))) return 0;
@@ -1253,7 +1279,7 @@ static int ply_read_header_property(p_ply ply) {
 static int ply_read_header_element(p_ply ply) {
     p_ply_element element = NULL;
     long dummy;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->input_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "element")) return 0;
     /* allocate room for new element */
     element = ply_grow_element(ply);
@@ -20,6 +20,8 @@
 #define RPLY_COPYRIGHT "Copyright (C) 2003-2013 Diego Nehab"
 #define RPLY_AUTHORS "Diego Nehab"
 
+#include <stdio.h>
+
 /* ----------------------------------------------------------------------
  * Types
  * ---------------------------------------------------------------------- */
@@ -66,6 +68,16 @@ typedef enum e_ply_type {
  * ---------------------------------------------------------------------- */
 typedef void (*p_ply_error_cb)(p_ply ply, const char *message);
 
+/* ----------------------------------------------------------------------
+ * Input callback prototype
+ *
+ * data: pointer given to ply_open_from_callback
+ * buffer: destination of at most size bytes
+ *
+ * Returns the number of bytes written to buffer, 0 at the end or on error
+ * ---------------------------------------------------------------------- */
+typedef size_t (*p_ply_input_cb)(void *data, char *buffer, size_t size);
+
 /* ----------------------------------------------------------------------
  * Gets user data from within an error callback
  *
@@ -86,6 +98,32 @@ int ply_get_ply_user_data(p_ply ply, void **pdata, long *idata);
 p_ply ply_open(const char *name, p_ply_error_cb error_cb, long idata,
                void *pdata);
 
+/* ----------------------------------------------------------------------
+ * Same as ply_open, but reads from an open file (closed by ply_close)
+ *
+ * fp: file opened in binary mode
+ * error_cb: error callback function
+ * idata,pdata: contextual information available to users
+ *
+ * Returns 1 if successful, 0 otherwise
+ * ---------------------------------------------------------------------- */
+p_ply ply_open_from_file(FILE *fp, p_ply_error_cb error_cb, long idata,
+               void *pdata);
+
+/* ----------------------------------------------------------------------
+ * Same as ply_open, but the data is read through a callback (memory,
+ * compressed streams)
+ *
+ * input_cb: input callback function
+ * input_data: pointer passed to input_cb (has to outlive the handle)
+ * error_cb: error callback function
+ * idata,pdata: contextual information available to users
+ *
+ * Returns 1 if successful, 0 otherwise
+ * ---------------------------------------------------------------------- */
+p_ply ply_open_from_callback(p_ply_input_cb input_cb, void *input_data,
+               p_ply_error_cb error_cb, long idata, void *pdata);
+
 /* ----------------------------------------------------------------------
  * Reads and parses the header of a PLY file returned by ply_open
  *
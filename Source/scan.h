@@ -0,0 +1,195 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_USE_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// text scanning primitives of the parser. The functions only read [c, end) and return end
+// when nothing was found (c if c >= end). '\0' ends the text except for find() and countTokens().
+// whitespace is the isspace set of the "C" locale: ' ', \t, \n, \v, \f, \r
+namespace scan
+{
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || unsigned((unsigned char)c) - 9u < 5u;
+	}
+
+	// byte by byte versions (used for the tail and when no simd is available)
+	namespace scalar
+	{
+		// first whitespace or '\0'
+		inline const char* findSpace(const char* c, const char* end)
+		{
+			while (c < end && *c && !isSpace(*c)) ++c;
+			return c;
+		}
+
+		// first byte that is no whitespace
+		inline const char* skipSpace(const char* c, const char* end)
+		{
+			while (c < end && *c && isSpace(*c)) ++c;
+			return c;
+		}
+
+		// first token
+		inline const char* find(const char* c, const char* end, char token)
+		{
+			while (c < end && *c != token) ++c;
+			return c;
+		}
+
+		// first token or '\0'
+		inline const char* findOrNull(const char* c, const char* end, char token)
+		{
+			while (c < end && *c && *c != token) ++c;
+			return c;
+		}
+	}
+
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+	namespace detail
+	{
+#ifdef SCAN_USE_AVX2
+		typedef __m256i Block;
+		static const size_t BLOCK_SIZE = 32;
+		inline Block load(const char* c) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c)); }
+		inline Block set(char v) { return _mm256_set1_epi8(v); }
+		inline Block eq(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+		inline Block less(Block a, Block b) { return _mm256_cmpgt_epi8(b, a); }
+		inline Block add(Block a, Block b) { return _mm256_add_epi8(a, b); }
+		inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+		inline uint32_t mask(Block a) { return uint32_t(_mm256_movemask_epi8(a)); }
+		static const uint32_t FULL_MASK = 0xFFFFFFFFu;
+#else
+		typedef __m128i Block;
+		static const size_t BLOCK_SIZE = 16;
+		inline Block load(const char* c) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(c)); }
+		inline Block set(char v) { return _mm_set1_epi8(v); }
+		inline Block eq(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+		inline Block less(Block a, Block b) { return _mm_cmplt_epi8(a, b); }
+		inline Block add(Block a, Block b) { return _mm_add_epi8(a, b); }
+		inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+		inline uint32_t mask(Block a) { return uint32_t(_mm_movemask_epi8(a)); }
+		static const uint32_t FULL_MASK = 0xFFFFu;
+#endif
+
+		inline uint32_t firstBit(uint32_t m)
+		{
+#ifdef _MSC_VER
+			unsigned long i;
+			_BitScanForward(&i, m);
+			return uint32_t(i);
+#else
+			return uint32_t(__builtin_ctz(m));
+#endif
+		}
+
+		// bit set for whitespace bytes. 9..13 are moved to -128..-124 for the signed compare
+		inline uint32_t spaceMask(Block b)
+		{
+			return mask(either(eq(b, set(' ')), less(add(b, set(char(0x80 - 9))), set(char(0x80 + 5)))));
+		}
+
+		inline uint32_t bitCount(uint32_t m)
+		{
+			m = m - ((m >> 1) & 0x55555555u);
+			m = (m & 0x33333333u) + ((m >> 2) & 0x33333333u);
+			return (((m + (m >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+		}
+
+		// first byte with a bit in stop(block). Returns the start of the last partial block if nothing was found
+		template<class TStop>
+		const char* findFirst(const char* c, const char* end, TStop stop)
+		{
+			while (c < end && size_t(end - c) >= BLOCK_SIZE)
+			{
+				const uint32_t m = stop(load(c));
+				if (m)
+					return c + firstBit(m);
+				c += BLOCK_SIZE;
+			}
+			return c;
+		}
+	}
+#endif
+
+	// first whitespace or '\0'
+	inline const char* findSpace(const char* c, const char* end)
+	{
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+		using namespace detail;
+		c = findFirst(c, end, [](Block b) { return spaceMask(b) | mask(eq(b, set(0))); });
+#endif
+		return scalar::findSpace(c, end);
+	}
+
+	// first byte that is no whitespace (or '\0')
+	inline const char* skipSpace(const char* c, const char* end)
+	{
+		// mostly single spaces between tokens
+		if (c < end && !isSpace(*c))
+			return c;
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+		using namespace detail;
+		c = findFirst(c, end, [](Block b) { return ~spaceMask(b) & FULL_MASK; });
+#endif
+		return scalar::skipSpace(c, end);
+	}
+
+	// first token (does not stop at '\0')
+	inline const char* find(const char* c, const char* end, char token)
+	{
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+		using namespace detail;
+		const Block t = set(token);
+		c = findFirst(c, end, [t](Block b) { return mask(eq(b, t)); });
+#endif
+		return scalar::find(c, end, token);
+	}
+
+	// first token or '\0'
+	inline const char* findOrNull(const char* c, const char* end, char token)
+	{
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+		using namespace detail;
+		const Block t = set(token);
+		c = findFirst(c, end, [t](Block b) { return mask(either(eq(b, t), eq(b, set(0)))); });
+#endif
+		return scalar::findOrNull(c, end, token);
+	}
+
+	// number of whitespace separated tokens
+	inline size_t countTokens(const char* c, const char* end)
+	{
+		size_t count = 0;
+		bool prevSpace = true;
+#if defined(SCAN_USE_AVX2) || defined(SCAN_USE_SSE2)
+		using namespace detail;
+		while (c < end && size_t(end - c) >= BLOCK_SIZE)
+		{
+			// a token starts at a byte that is no whitespace after a whitespace
+			const uint32_t space = spaceMask(load(c));
+			count += bitCount(~space & ((space << 1) | uint32_t(prevSpace)) & FULL_MASK);
+			prevSpace = ((space >> (BLOCK_SIZE - 1)) & 1) != 0;
+			c += BLOCK_SIZE;
+		}
+#endif
+		for (; c < end; ++c)
+		{
+			const bool space = isSpace(*c);
+			if (prevSpace && !space)
+				++count;
+			prevSpace = space;
+		}
+		return count;
+	}
+}
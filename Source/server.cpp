@@ -0,0 +1,333 @@
+#include "server.h"
+#include "system.h"
+#include "parallel.h"
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+	// clients that do not send their request within this time are dropped
+	const int REQUEST_TIMEOUT_SECONDS = 10;
+
+	// line based reading and writing on a socket
+	class Connection
+	{
+	public:
+		explicit Connection(int fd)
+			: m_fd(fd)
+		{}
+		~Connection()
+		{
+			close(m_fd);
+		}
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+
+		// returns false at the end of the stream and after the receive timeout
+		bool readLine(std::string& line)
+		{
+			while (true)
+			{
+				const auto pos = m_buffer.find('\n');
+				if (pos != std::string::npos)
+				{
+					line = m_buffer.substr(0, pos);
+					m_buffer.erase(0, pos + 1);
+					return true;
+				}
+				char chunk[4096];
+				const ssize_t count = recv(m_fd, chunk, sizeof(chunk), 0);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count < 0)
+				{
+					// timeout or broken connection
+					m_buffer.clear();
+					return false;
+				}
+				if (count == 0)
+				{
+					// last line without line break
+					line.swap(m_buffer);
+					m_buffer.clear();
+					return line.size() != 0;
+				}
+				m_buffer.append(chunk, size_t(count));
+			}
+		}
+
+		// can be called from multiple threads. Lines are dropped after the other side disconnected
+		void writeLine(const std::string& line)
+		{
+			const std::string data = line + '\n';
+			std::lock_guard<std::mutex> lock(m_writeMutex);
+			const char* c = data.data();
+			size_t left = data.size();
+			while (left && !m_broken)
+			{
+				const ssize_t count = send(m_fd, c, left, 0);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+				{
+					m_broken = true;
+					break;
+				}
+				c += count;
+				left -= size_t(count);
+			}
+		}
+	private:
+		int m_fd;
+		std::string m_buffer;
+		std::mutex m_writeMutex;
+		bool m_broken = false;
+	};
+
+	bool makeAddress(const std::string& socketPath, sockaddr_un& addr)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (socketPath.size() >= sizeof(addr.sun_path))
+		{
+			System::error("socket path is too long: " + socketPath);
+			return false;
+		}
+		strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+		return true;
+	}
+
+	// paths of a job are relative to the working directory of the client
+	std::string makeAbsolute(const std::string& path)
+	{
+		char cwd[4096];
+		if (path.empty() || path[0] == '/' || !getcwd(cwd, sizeof(cwd)))
+			return path;
+		return std::string(cwd) + "/" + path;
+	}
+
+	// connects to the socket. Returns false if nobody listens
+	bool probe(const sockaddr_un& addr)
+	{
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return false;
+		const bool connected = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+		close(fd);
+		return connected;
+	}
+
+	void runJob(Connection& connection, const std::vector<std::string>& args, const server::ConvertFunc& convert)
+	{
+		if (args.size() < 2)
+		{
+			connection.writeLine("msg ERROR: insufficient arguments, please provide input file + output file name");
+			connection.writeLine("end failed");
+			return;
+		}
+
+		// the options are parsed like the command line of main
+		std::vector<std::string> strings(args.begin() + 2, args.end());
+		std::vector<char*> argv;
+		for (auto& s : strings)
+			argv.push_back(&s[0]);
+		util::ArgumentSet options;
+		options.init(int(argv.size()), argv.data());
+		// the profiler is shared by all jobs of the daemon
+		if (options.has("stats") || options.has("trace"))
+		{
+			connection.writeLine("msg ERROR: --stats and --trace are options of the daemon, not of a job");
+			connection.writeLine("end failed");
+			return;
+		}
+
+		System::Context context;
+		context.setArgs(&options);
+		context.setOutput([&connection](const std::string& line)
+		{
+			connection.writeLine("msg " + line);
+		});
+		System::ContextScope scope(context);
+
+		bool success = false;
+		try
+		{
+			success = convert(args[0], args[1]);
+		}
+		catch (const std::exception& e)
+		{
+			System::error(e.what());
+		}
+		System::displayErrors();
+		System::displayWarnings();
+		System::displayInfos();
+		connection.writeLine(success ? "end ok" : "end failed");
+	}
+}
+
+bool server::run(const std::string& socketPath, ConvertFunc convert)
+{
+	// writes to disconnected clients must not end the daemon
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr))
+		return false;
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		System::error("cannot create socket: " + std::string(strerror(errno)));
+		return false;
+	}
+	// socket file of a previous daemon that was not shut down
+	struct stat info;
+	if (lstat(socketPath.c_str(), &info) == 0)
+	{
+		if (!S_ISSOCK(info.st_mode) || probe(addr))
+		{
+			System::error("cannot listen on " + socketPath + ": " + (S_ISSOCK(info.st_mode) ? "a daemon is running" : "the file exists"));
+			close(fd);
+			return false;
+		}
+		unlink(socketPath.c_str());
+	}
+	// only the user of the daemon can submit jobs
+	const mode_t mask = umask(0077);
+	const bool bound = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+	umask(mask);
+	if (!bound || chmod(socketPath.c_str(), 0600) < 0 || listen(fd, 16) < 0)
+	{
+		System::error("cannot listen on " + socketPath + ": " + std::string(strerror(errno)));
+		close(fd);
+		return false;
+	}
+	System::runtimeInfo("daemon: listening on " + socketPath);
+
+	parallel::Pool::instance().start(parallel::getThreadCount());
+	parallel::TaskGroup jobs;
+	std::atomic<bool> stop(false);
+	std::atomic<size_t> numJobs(0);
+	while (!stop)
+	{
+		const int client = accept(fd, nullptr, nullptr);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			System::error("daemon: accept failed: " + std::string(strerror(errno)));
+			break;
+		}
+		if (stop)
+		{
+			close(client);
+			break;
+		}
+		timeval timeout = { REQUEST_TIMEOUT_SECONDS, 0 };
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		// the request is read on the pool so that a slow client does not block the accept loop
+		std::shared_ptr<Connection> connection = std::make_shared<Connection>(client);
+		jobs.run([connection, &addr, &convert, &stop, &numJobs]()
+		{
+			std::string command;
+			if (!connection->readLine(command))
+				return;
+			if (command == "stop")
+			{
+				connection->writeLine("end ok");
+				// wakes up the accept loop
+				stop = true;
+				probe(addr);
+				return;
+			}
+			if (command != "convert")
+			{
+				connection->writeLine("msg ERROR: unknown command " + command);
+				connection->writeLine("end failed");
+				return;
+			}
+			std::vector<std::string> args;
+			std::string line;
+			while (connection->readLine(line) && line.size())
+				args.push_back(line);
+
+			System::runtimeInfo("daemon: job " + std::to_string(++numJobs) + (args.size() ? ": " + args[0] : ""));
+			runJob(*connection, args, convert);
+		});
+	}
+
+	System::runtimeInfo("daemon: waiting for running jobs");
+	jobs.wait();
+	close(fd);
+	unlink(socketPath.c_str());
+	return true;
+}
+
+bool server::submit(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr))
+		return false;
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		System::error("cannot create socket: " + std::string(strerror(errno)));
+		return false;
+	}
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+	{
+		System::error("cannot connect to daemon at " + socketPath + ": " + std::string(strerror(errno)));
+		close(fd);
+		return false;
+	}
+	Connection connection(fd);
+
+	if (args.size() == 1 && args[0] == "stop")
+		connection.writeLine("stop");
+	else
+	{
+		connection.writeLine("convert");
+		for (size_t i = 0; i < args.size(); ++i)
+			connection.writeLine(i < 2 ? makeAbsolute(args[i]) : args[i]);
+		connection.writeLine("");
+	}
+
+	std::string line;
+	while (connection.readLine(line))
+	{
+		if (line.compare(0, 4, "msg ") == 0)
+			std::cerr << line.substr(4) << std::endl;
+		else if (line.compare(0, 4, "end ") == 0)
+			return line.substr(4) == "ok";
+	}
+	System::error("daemon closed the connection");
+	return false;
+}
+#else
+// unix domain sockets are not supported on windows
+bool server::run(const std::string& socketPath, ConvertFunc convert)
+{
+	System::error("the daemon is not available on windows");
+	return false;
+}
+
+bool server::submit(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	System::error("the daemon is not available on windows");
+	return false;
+}
+#endif
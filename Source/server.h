@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+// conversion daemon (--daemon). Jobs are received over a unix domain socket and converted on the pool of the
+// batch mode, the caches of the process (spectra, ply files, tessellated geometry) stay warm between the jobs.
+// protocol (text lines):
+//   client: "convert", the arguments of the job like on the command line (input_pbrt, output, options) one per line and an empty line
+//           or "stop" to shut the daemon down
+//   daemon: "msg <console line>" for the messages of the job and finally "end ok" or "end failed"
+namespace server
+{
+	// converts a scene with the options of the current context (System::args). Returns false if the scene failed
+	typedef std::function<bool(const std::string& input, const std::string& output)> ConvertFunc;
+
+	// serves jobs until a stop request arrives. Returns false if the socket could not be created
+	bool run(const std::string& socketPath, ConvertFunc convert);
+
+	// sends the job (or "stop" as only argument) and prints the messages of the daemon. Returns false if the job failed
+	bool submit(const std::string& socketPath, const std::vector<std::string>& args);
+}
@@ -0,0 +1,164 @@
+#include "stream_cache.h"
+#include "command_stream.h"
+#include "memory.h"
+#include "incremental.h"
+#include <chrono>
+#include <sys/stat.h>
+
+static thread_local std::vector<StreamCache::FileStamp>* s_recorder = nullptr;
+
+static std::string getKey(const std::string& filename, const std::string& directory)
+{
+	return filename + '\n' + directory;
+}
+
+// files that were modified within this time before the stamp are racy (covers timestamps of whole seconds and fat)
+static const long long RACY_NANOSECONDS = 2000000000ll;
+
+static long long getModificationTime(const struct stat& info)
+{
+#if defined(_WIN32)
+	return (long long)info.st_mtime * 1000000000ll;
+#elif defined(__APPLE__)
+	return (long long)info.st_mtimespec.tv_sec * 1000000000ll + (long long)info.st_mtimespec.tv_nsec;
+#else
+	return (long long)info.st_mtim.tv_sec * 1000000000ll + (long long)info.st_mtim.tv_nsec;
+#endif
+}
+
+StreamCache::Recorder::Recorder(std::vector<FileStamp>& files)
+	:
+m_previous(s_recorder)
+{
+	s_recorder = &files;
+}
+
+StreamCache::Recorder::~Recorder()
+{
+	s_recorder = m_previous;
+}
+
+void StreamCache::addSpectrum(const FileStamp& stamp)
+{
+	if (s_recorder)
+		s_recorder->push_back(stamp);
+}
+
+StreamCache& StreamCache::instance()
+{
+	static StreamCache cache;
+	return cache;
+}
+
+StreamCache::FileStamp StreamCache::getFileStamp(const std::string& filename)
+{
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0)
+		return FileStamp{ filename, -1, 0, false, 0 };
+	FileStamp stamp = { filename, (long long)info.st_size, getModificationTime(info), false, 0 };
+	const long long now = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	if (stamp.mtime > now - RACY_NANOSECONDS)
+		stamp.racy = incremental::hashFile(filename, stamp.hash);
+	return stamp;
+}
+
+bool StreamCache::isUnchanged(const FileStamp& stamp)
+{
+	struct stat info;
+	if (stat(stamp.filename.c_str(), &info) != 0)
+		return stamp.size == -1;
+	if (stamp.size != (long long)info.st_size || stamp.mtime != getModificationTime(info))
+		return false;
+	uint64_t hash;
+	return !stamp.racy || (incremental::hashFile(stamp.filename, hash) && hash == stamp.hash);
+}
+
+std::shared_ptr<const StreamCache::Entry> StreamCache::find(const std::string& filename, const std::string& directory)
+{
+	std::shared_ptr<const Entry> entry;
+	const std::string key = getKey(filename, directory);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_items.find(key);
+		if (it == m_items.end())
+			return nullptr;
+		entry = it->second.entry;
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+	}
+
+	// the files are checked without the lock
+	bool changed = !isUnchanged(entry->file);
+	for (size_t i = 0; i < entry->spectra.size() && !changed; ++i)
+		changed = !isUnchanged(entry->spectra[i]);
+	if (!changed)
+		return entry;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_items.find(key);
+	if (it != m_items.end() && it->second.entry == entry)
+		remove(it);
+	return nullptr;
+}
+
+void StreamCache::store(const std::string& filename, const std::string& directory, std::shared_ptr<const Entry> entry)
+{
+	const std::string key = getKey(filename, directory);
+	const size_t bytes = entry->stream->getMemorySize();
+	const size_t budget = memory::getBudget() / 4;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// files that are only parsed once are not kept
+	if (m_seen.insert(key).second || bytes > budget)
+		return;
+	auto it = m_items.find(key);
+	if (it != m_items.end())
+		remove(it);
+	while (m_bytes + bytes > budget && m_lru.size())
+		remove(m_items.find(m_lru.back()));
+
+	m_lru.push_front(key);
+	m_items[key] = Item{ std::move(entry), bytes, m_lru.begin() };
+	m_bytes += bytes;
+}
+
+bool StreamCache::contains(const std::string& filename, const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_items.count(getKey(filename, directory)) != 0;
+}
+
+void StreamCache::remove(std::unordered_map<std::string, Item>::iterator it)
+{
+	m_bytes -= it->second.bytes;
+	m_lru.erase(it->second.lru);
+	m_items.erase(it);
+}
+
+FloatFileCache& FloatFileCache::instance()
+{
+	static FloatFileCache cache;
+	return cache;
+}
+
+bool FloatFileCache::find(const std::string& filename, std::vector<float>& data)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(filename);
+	if (it == m_entries.end() || !StreamCache::isUnchanged(it->second.stamp))
+		return false;
+	data = it->second.data;
+	return true;
+}
+
+void FloatFileCache::store(const StreamCache::FileStamp& stamp, const std::vector<float>& data)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries[stamp.filename] = Entry{ stamp, data };
+}
+
+bool FloatFileCache::contains(const std::string& filename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.count(filename) != 0;
+}
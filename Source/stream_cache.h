@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+class CommandStream;
+
+// tokenized pbrt files of the process. A file is kept after it was tokenized a second time (libraries that are
+// included from many places, files shared by the scenes of a batch or a daemon) and later includes replay the
+// cached commands. Entries are checked against the modification time and size of the file and of the spectra
+// that were read during its tokenization. The least recently used streams are dropped above a quarter of the memory budget.
+// FileStamp is also used by the caches of spectra (readFloatingFile) and ply files
+class StreamCache
+{
+public:
+	struct FileStamp
+	{
+		std::string filename;
+		long long size; // -1 if the file did not exist
+		long long mtime; // nanoseconds
+		// the file was modified shortly before the stamp was taken. A later change could keep the modification time
+		// (coarse file system timestamps), these stamps are checked with the content hash
+		bool racy;
+		uint64_t hash; // content hash of racy stamps
+	};
+	struct Entry
+	{
+		std::shared_ptr<const CommandStream> stream;
+		FileStamp file;
+		uint64_t hash; // content hash of the file on the disk (compressed files are hashed before decoding)
+		std::vector<FileStamp> spectra; // read during the tokenization
+	};
+
+	// collects the spectra that are read by the tokenizer of the calling thread
+	class Recorder
+	{
+	public:
+		explicit Recorder(std::vector<FileStamp>& files);
+		~Recorder();
+		Recorder(const Recorder&) = delete;
+		Recorder& operator=(const Recorder&) = delete;
+	private:
+		std::vector<FileStamp>* m_previous;
+	};
+	// called by readFloatingFile
+	static void addSpectrum(const FileStamp& stamp);
+
+	static StreamCache& instance();
+	static FileStamp getFileStamp(const std::string& filename);
+	// true if the file still matches the stamp
+	static bool isUnchanged(const FileStamp& stamp);
+
+	// directory: current directory during the tokenization (spectra are relative to it). nullptr if the file is not cached or changed
+	std::shared_ptr<const Entry> find(const std::string& filename, const std::string& directory);
+	// keeps the entry if the file was tokenized before
+	void store(const std::string& filename, const std::string& directory, std::shared_ptr<const Entry> entry);
+	// true if there is an entry (without checking the file). Used to skip the read ahead of includes
+	bool contains(const std::string& filename, const std::string& directory);
+
+private:
+	typedef std::list<std::string> LruList;
+	struct Item
+	{
+		std::shared_ptr<const Entry> entry;
+		size_t bytes;
+		LruList::iterator lru;
+	};
+
+	void remove(std::unordered_map<std::string, Item>::iterator it);
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, Item> m_items;
+	// files that were tokenized once
+	std::unordered_set<std::string> m_seen;
+	// most recently used first
+	LruList m_lru;
+	size_t m_bytes = 0;
+};
+
+// values of the files of readFloatingFile (spectra), keyed by the resolved path. The files are small and stay cached
+class FloatFileCache
+{
+public:
+	static FloatFileCache& instance();
+
+	// false if the file is not cached or changed
+	bool find(const std::string& filename, std::vector<float>& data);
+	void store(const StreamCache::FileStamp& stamp, const std::vector<float>& data);
+	// true if there is an entry (without checking the file). Used to skip the read ahead of spectra
+	bool contains(const std::string& filename);
+
+private:
+	struct Entry
+	{
+		StreamCache::FileStamp stamp;
+		std::vector<float> data;
+	};
+	std::mutex m_mutex;
+	std::unordered_map<std::string, Entry> m_entries;
+};
@@ -3,20 +3,131 @@
 #include <iostream>
 #include <cassert>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+using WORD = unsigned short;
+#endif
 
-std::string System::s_curDir;
 bool System::argSilent = false;
-util::ArgumentSet System::args;
-static std::string s_outDir;
+System::Arguments System::args;
 
-static std::vector<std::pair<std::string,size_t>> s_warnings;
-static std::vector<std::pair<std::string, size_t>> s_errors;
-static std::vector<std::pair<std::string, size_t>> s_infos;
-static ei::Mat4x4 s_axisSwap = ei::identity4x4();
+// counts how often every message was reported. The messages are distributed over
+// independently locked hash maps so that worker threads rarely wait for each other
+class MessageLog
+{
+	static const size_t SHARDS = 16;
+public:
+	// returns true if it should be displayed
+	bool add(const std::string& msg)
+	{
+		const size_t hash = std::hash<std::string>()(msg);
+		auto& shard = m_shards[hash % SHARDS];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.entries.find(msg);
+		if (it == shard.entries.end())
+		{
+			shard.entries.emplace(msg, Entry{ 1, m_order++ });
+			return true;
+		}
+		it->second.count++;
+		// only display messages up to 10 times
+		return it->second.count < 10;
+	}
+	// (message, count) in the order of the first occurrence
+	std::vector<std::pair<std::string, size_t>> getMessages()
+	{
+		std::vector<std::pair<size_t, std::pair<std::string, size_t>>> sorted;
+		for (auto& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			for (const auto& e : shard.entries)
+				sorted.push_back(std::make_pair(e.second.order, std::make_pair(e.first, e.second.count)));
+		}
+		std::sort(sorted.begin(), sorted.end());
+		std::vector<std::pair<std::string, size_t>> res;
+		res.reserve(sorted.size());
+		for (auto& e : sorted)
+			res.push_back(std::move(e.second));
+		return res;
+	}
+private:
+	struct Entry
+	{
+		size_t count;
+		size_t order;
+	};
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, Entry> entries;
+	};
+	Shard m_shards[SHARDS];
+	std::atomic<size_t> m_order{ 0 };
+};
+
+struct System::Context::Messages
+{
+	MessageLog warnings;
+	MessageLog errors;
+	MessageLog infos;
+};
+
+System::Context::Context()
+	:
+m_messages(new Messages)
+{}
+
+System::Context::~Context()
+{}
+
+static System::Context& getDefaultContext()
+{
+	static System::Context context;
+	return context;
+}
+static thread_local System::Context* s_context = nullptr;
+
+System::ContextScope::ContextScope(Context& context)
+	:
+m_previous(s_context)
+{
+	s_context = &context;
+}
 
+System::ContextScope::~ContextScope()
+{
+	s_context = m_previous;
+}
+
+System::Context& System::getContext()
+{
+	return s_context ? *s_context : getDefaultContext();
+}
+
+const util::ArgumentSet& System::Arguments::current() const
+{
+	const auto* args = getContext().m_args;
+	return args ? *args : m_main;
+}
+
+static bool isSilent()
+{
+	return System::getContext().getArgs() ? System::args.has("silent") : System::argSilent;
+}
+
+// keeps the console color and the message line together
+static std::mutex s_consoleMutex;
+
+#ifdef _WIN32
 static 	HANDLE hstdout = nullptr;
 
 void System::init()
@@ -32,45 +143,81 @@ void setConsoleColorDefault()
 {
 	SetConsoleTextAttribute(hstdout, 0x07);
 }
-// returns true if it should be displayed
-bool addMessage(std::vector<std::pair<std::string, size_t>>& vec, const std::string& msg)
+#else
+void System::init()
 {
-	for(auto& e : vec)
+}
+
+// console colors are only used on windows
+void setConsoleColor(WORD)
+{
+}
+void setConsoleColorDefault()
+{
+}
+#endif
+// writes a line to the console with the given color (or to the output of the context)
+static void printLine(WORD color, const char* prefix, const std::string& txt)
+{
+	const auto& output = System::getContext().getOutput();
+	if (output)
 	{
-		if(e.first == msg)
-		{
-			e.second++;
-			// only display messages up to 10 times
-			return e.second < 10;
-		}
+		output(prefix + txt);
+		return;
 	}
-	vec.push_back(std::make_pair(msg, 1));
-	return true;
+	std::lock_guard<std::mutex> lock(s_consoleMutex);
+	setConsoleColor(color);
+	std::cerr << prefix << txt << std::endl;
+	setConsoleColorDefault();
+}
+
+void System::setDirectory(const std::string& dir)
+{
+	auto& c = getContext();
+	// only the first directory (the one of the scene file) is used without --dirhierarchy
+	if(args.get("dirhierarchy", false) || !c.m_hasDirectory)
+		c.m_curDir = dir;
+	c.m_hasDirectory = true;
 }
 
+std::string System::getCurrentDirectory()
+{
+	return getContext().m_curDir;
+}
+
+// native path separator (the other one is converted by fixPath)
+#ifdef _WIN32
+static const char s_separator = '\\';
+static const char s_otherSeparator = '/';
+#else
+static const char s_separator = '/';
+static const char s_otherSeparator = '\\';
+#endif
+
 std::string System::fixPath(std::string s)
 {
-	// make / to \"
+	// make / to \ (on windows)
 	for (auto& c : s)
-		if (c == '/')
-			c = '\\';
+		if (c == s_otherSeparator)
+			c = s_separator;
 
 	// remove double /'s
+	const std::string doubleSeparator(2, s_separator);
 	size_t p = 0;
-	while ((p = s.find("\\\\")) != std::string::npos)
+	while ((p = s.find(doubleSeparator)) != std::string::npos)
 	{
 		s = s.substr(0, p) + s.substr(p + 1, s.length() - p - 1);
 	}
 
 	// make path\path2\..\file -> path\file
-
-	while ((p = s.find("\\..\\")) != std::string::npos)
+	const std::string parent = std::string(1, s_separator) + ".." + s_separator;
+	while ((p = s.find(parent)) != std::string::npos)
 	{
 		// scroll back till "\"
 		size_t end = p + 3;
 		if (p > 0)
 			p--;
-		while (p > 0 && s.at(p) != '\\') p--;
+		while (p > 0 && s.at(p) != s_separator) p--;
 		// cut
 		s = s.substr(0, p) + s.substr(end, s.length() - end);
 	}
@@ -104,7 +251,7 @@ std::string System::getFileDirectory(std::string s)
 std::string System::getFilename(std::string s)
 {
 	s = fixPath(s);
-	auto pos = s.find_last_of('\\');
+	auto pos = s.find_last_of(s_separator);
 	if (pos != std::string::npos)
 		s = s.substr(pos + 1, s.length() - pos - 1);
 	return s;
@@ -112,96 +259,144 @@ std::string System::getFilename(std::string s)
 
 void System::warning(const std::string& txt)
 {
-	setConsoleColor(0x0E);
-	if(addMessage(s_warnings, txt) && !argSilent)
-		std::cerr << "WARNING: " << txt << std::endl;
-	setConsoleColorDefault();
+	if(getContext().m_messages->warnings.add(txt) && !isSilent())
+		printLine(0x0E, "WARNING: ", txt);
 }
 
 void System::info(const std::string& txt)
 {
-	if(addMessage(s_infos, txt) && !argSilent)
-		std::cerr << "INFO: " << txt << std::endl;
+	if(getContext().m_messages->infos.add(txt) && !isSilent())
+		printLine(0x07, "INFO: ", txt);
 }
 
 void System::runtimeInfo(const std::string& txt)
 {
-	if(!argSilent)
-		std::cerr << "INFO: " << txt << std::endl;
+	if(!isSilent())
+		printLine(0x07, "INFO: ", txt);
 }
 
 void System::runtimeInfoSpam(const std::string& txt)
 {
-	if(!argSilent)
+	if(!isSilent())
 	{
-		static auto last = std::chrono::high_resolution_clock::now();
-		auto now = std::chrono::high_resolution_clock::now();
-		if(std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count() > 200)
-		{
-			last = now;
+		// time of the last displayed message in milliseconds. only the thread that advances it prints
+		static std::atomic<long long> last(0);
+		const long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		long long prev = last.load(std::memory_order_relaxed);
+		if(now - prev > 200 && last.compare_exchange_strong(prev, now, std::memory_order_relaxed))
 			runtimeInfo(txt);
-		}
 	}
 }
 
 void System::error(const std::string& txt)
 {
-	setConsoleColor(0x0C);
-	addMessage(s_errors, txt);
-	std::cerr << "ERROR: " << txt << std::endl;
-	setConsoleColorDefault();
+	getContext().m_messages->errors.add(txt);
+	printLine(0x0C, "ERROR: ", txt);
 	if (args.has("errpause"))
+	{
+		std::lock_guard<std::mutex> lock(s_consoleMutex);
 		system("pause");
+	}
 }
 
-void displayStrings(const std::vector<std::pair<std::string,size_t>>& vec, const std::string& name)
+void displayStrings(MessageLog& log, WORD color, const std::string& name)
 {
+	const auto messages = log.getMessages();
 	size_t count = 0;
-	for (const auto& e : vec)
+	for (const auto& e : messages)
 		count += e.second;
-	if(count)
+	if(count && System::getContext().getOutput())
 	{
+		const auto& output = System::getContext().getOutput();
+		output(name + " (" + std::to_string(count) + "):");
+		for (const auto& e : messages)
+			output("(" + std::to_string(e.second) + ") " + e.first);
+	}
+	else if(count)
+	{
+		std::lock_guard<std::mutex> lock(s_consoleMutex);
+		setConsoleColor(color);
 		std::cerr << name << " (" << count << "):\n";
-		for (const auto& e : vec)
+		for (const auto& e : messages)
 		{
 			std::cerr << "(" << e.second << ") " << e.first << std::endl;
 		}
+		setConsoleColorDefault();
 	}
 }
 
 void System::displayWarnings()
 {
-	setConsoleColor(0x0E);
-	displayStrings(s_warnings, "WARNINGS");
-	setConsoleColorDefault();
+	displayStrings(getContext().m_messages->warnings, 0x0E, "WARNINGS");
 }
 
 void System::displayErrors()
 {
-	setConsoleColor(0x0C);
-	displayStrings(s_errors, "ERRORS");
-	setConsoleColorDefault();
+	displayStrings(getContext().m_messages->errors, 0x0C, "ERRORS");
 }
 
 void System::displayInfos()
 {
-	setConsoleColor(0x0A);
-	displayStrings(s_infos, "INFOS");
-	setConsoleColorDefault();
+	displayStrings(getContext().m_messages->infos, 0x0A, "INFOS");
 }
 
+size_t System::getErrorCount()
+{
+	size_t count = 0;
+	for (const auto& e : getContext().m_messages->errors.getMessages())
+		count += e.second;
+	return count;
+}
+
+#ifndef _WIN32
+// first number in the file (false for "max" or missing files)
+static bool readNumber(const char* filename, unsigned long long& value)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file)
+		return false;
+	const bool res = fscanf(file, "%llu", &value) == 1;
+	fclose(file);
+	return res;
+}
+#endif
+
 size_t System::getAvailableRam()
 {
+#ifdef _WIN32
 	MEMORYSTATUSEX memInfo;
 	memInfo.dwLength = sizeof(memInfo);
 	GlobalMemoryStatusEx(&memInfo);
 
 	return memInfo.ullAvailPhys;
+#else
+	unsigned long long available = 0;
+	bool found = false;
+	if (FILE* file = fopen("/proc/meminfo", "r"))
+	{
+		char line[256];
+		while (!found && fgets(line, sizeof(line), file))
+			found = sscanf(line, "MemAvailable: %llu kB", &available) == 1;
+		fclose(file);
+		available *= 1024;
+	}
+	if (!found)
+		available = (unsigned long long)sysconf(_SC_AVPHYS_PAGES) * (unsigned long long)sysconf(_SC_PAGESIZE);
+
+	// containers are killed at their cgroup limit long before the machine runs out of memory (cgroup v2, then v1)
+	unsigned long long limit = 0, usage = 0;
+	if ((readNumber("/sys/fs/cgroup/memory.max", limit) && readNumber("/sys/fs/cgroup/memory.current", usage)) ||
+		(readNumber("/sys/fs/cgroup/memory/memory.limit_in_bytes", limit) && readNumber("/sys/fs/cgroup/memory/memory.usage_in_bytes", usage)))
+		available = std::min(available, limit > usage ? limit - usage : 0ull);
+
+	return size_t(available);
+#endif
 }
 
 void System::setOutputDirectory(const std::string& dir)
 {
-	s_outDir = getFileDirectory(dir);
+	getContext().m_outDir = getFileDirectory(dir);
 	// test if you can save files in the output directory
 	// create dummy file
 	FILE* tmp = fopen((dir + "tmp").c_str(), "wb");
@@ -217,7 +412,7 @@ void System::setOutputDirectory(const std::string& dir)
 
 std::string System::getOutputDirectory()
 {
-	return s_outDir;
+	return getContext().m_outDir;
 }
 
 void System::setAxisSwap(int a1, int a2)
@@ -231,15 +426,15 @@ void System::setAxisSwap(int a1, int a2)
 	// swap row vectors
 	std::swap(swapMat(a1), swapMat(a2));
 
-	s_axisSwap *= swapMat;
+	getContext().m_axisSwap *= swapMat;
 }
 
 ei::Mat4x4 System::getAxisSwap()
 {
-	return s_axisSwap;
+	return getContext().m_axisSwap;
 }
 
 bool System::hasAxisSwap()
 {
-	return s_axisSwap != ei::identity4x4();
+	return getContext().m_axisSwap != ei::identity4x4();
 }
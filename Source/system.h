@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <memory>
+#include <vector>
+#include <functional>
 #include <ei/vector.hpp>
 #include "ArgumentSet.h"
 
@@ -8,23 +11,101 @@
 class System
 {
 public:
-	static void init();
-	// like directory/
-	static void setDirectory(const std::string& dir)
+	// state of one conversion: directories, axis swap and messages.
+	// the functions below work on the context of the calling thread (see ContextScope)
+	class Context
 	{
-		static bool firstTime = true;
-		if(args.get("dirhierarchy", false) || firstTime)
-			s_curDir = dir;
-		firstTime = false;
-	}
-	static std::string getCurrentDirectory()
+	public:
+		Context();
+		~Context();
+		Context(const Context&) = delete;
+		Context& operator=(const Context&) = delete;
+
+		// options of this conversion instead of the command line (the set has to outlive the context)
+		void setArgs(const util::ArgumentSet* args)
+		{
+			m_args = args;
+		}
+		const util::ArgumentSet* getArgs() const
+		{
+			return m_args;
+		}
+		// receives the console lines of this context instead of stderr (may be called concurrently)
+		void setOutput(std::function<void(const std::string&)> output)
+		{
+			m_output = std::move(output);
+		}
+		const std::function<void(const std::string&)>& getOutput() const
+		{
+			return m_output;
+		}
+	private:
+		friend class System;
+		struct Messages;
+
+		std::string m_curDir;
+		bool m_hasDirectory = false;
+		std::string m_outDir;
+		ei::Mat4x4 m_axisSwap = ei::identity4x4();
+		std::unique_ptr<Messages> m_messages;
+		const util::ArgumentSet* m_args = nullptr;
+		std::function<void(const std::string&)> m_output;
+	};
+	// binds the context to the calling thread until the scope ends (threads without a scope use a default context).
+	// parallel.h workers use the context of the caller
+	class ContextScope
 	{
-		return s_curDir;
-	}
+	public:
+		explicit ContextScope(Context& context);
+		~ContextScope();
+		ContextScope(const ContextScope&) = delete;
+		ContextScope& operator=(const ContextScope&) = delete;
+	private:
+		Context* m_previous;
+	};
+	static Context& getContext();
+
+	// command line options. Reads use the options of the current context if it has its own (see Context::setArgs)
+	class Arguments
+	{
+	public:
+		// options of main (read only after main has set them)
+		void init(int argc, char** argv)
+		{
+			m_main.init(argc, argv);
+		}
+		bool has(const std::string& name) const
+		{
+			return current().has(name);
+		}
+		template <class T>
+		T get(const std::string& name, T def) const
+		{
+			return current().get<T>(name, def);
+		}
+		template <class T>
+		std::vector<T> getVector(const std::string& name) const
+		{
+			return current().getVector<T>(name);
+		}
+		const util::ArgumentSet& getMain() const
+		{
+			return m_main;
+		}
+	private:
+		const util::ArgumentSet& current() const;
+		util::ArgumentSet m_main;
+	};
+
+	static void init();
+	// like directory/
+	static void setDirectory(const std::string& dir);
+	static std::string getCurrentDirectory();
 	static std::string fixPath(std::string s);
 	static std::string removeFileEnding(std::string s);
 	static std::string getFileDirectory(std::string s);
 	static std::string getFilename(std::string s);
+	// the message functions can be used from worker threads
 	static void warning(const std::string& txt);
 	// information that will be saved (like "bla" not supported)
 	static void info(const std::string& txt);
@@ -36,6 +117,9 @@ public:
 	static void displayWarnings();
 	static void displayErrors();
 	static void displayInfos();
+	// number of errors reported in the context of the calling thread
+	static size_t getErrorCount();
+	// available physical memory in bytes (limited by the cgroup on linux)
 	static size_t getAvailableRam();
 	static void setOutputDirectory(const std::string& dir);
 	static std::string getOutputDirectory();
@@ -44,8 +128,7 @@ public:
 	static ei::Mat4x4 getAxisSwap();
 	static bool hasAxisSwap();
 public:
+	// --silent of main (contexts with their own options use their --silent)
 	static bool argSilent;
-	static util::ArgumentSet args;
-private:
-	static std::string s_curDir;
+	static Arguments args;
 };